@@ -0,0 +1,57 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// helpers shared by the benchmarks, which are plain programs that print a table
+namespace bench
+{
+	using clock = std::chrono::steady_clock;
+
+	inline double millis(clock::duration d)
+	{
+		return std::chrono::duration<double, std::milli>(d).count();
+	}
+
+	// the best of runs, the least disturbed one
+	template <typename F>
+	double best(int runs, F f)
+	{
+		double ms = 1e300;
+		for (int i = 0; i < runs; i++)
+		{
+			clock::time_point start = clock::now();
+			f();
+			ms = (std::min)(ms, millis(clock::now() - start));
+		}
+		return ms;
+	}
+
+	// burns about ns nanoseconds, the cost of a system call in a fake
+	inline void spin(long ns)
+	{
+		if (ns <= 0)
+			return;
+		const clock::time_point until = clock::now() + std::chrono::nanoseconds(ns);
+		while (clock::now() < until)
+			;
+	}
+
+	// the numeric argument i or fallback
+	inline long arg(int argc, char* argv[], int i, long fallback)
+	{
+		return i < argc ? std::strtol(argv[i], nullptr, 0) : fallback;
+	}
+
+	inline volatile char sink;
+
+	// keeps the optimizer from dropping a result
+	template <typename T>
+	inline void keep(const T& value)
+	{
+		sink = *(const volatile char*)&value;
+	}
+}
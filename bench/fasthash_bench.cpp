@@ -0,0 +1,68 @@
+// GB/s of FastHash for one buffer, per page and spread over a WorkPool, from a page that stays
+// in cache to a buffer larger than it. make builds it once per instruction set:
+// fasthash_bench with what the compiler targets by default, fasthash_avx2_bench with -mavx2 and
+// fasthash_scalar_bench with FASTHASH_SCALAR. the check hash has to be the same for all of them
+//   fasthash_bench [MB of the largest buffer]
+#include "bench.hpp"
+#include "injectory/fasthash.hpp"
+#include <random>
+#include <string>
+#include <thread>
+
+#if defined(FASTHASH_AVX2)
+static const char* const simd = "avx2";
+#elif defined(FASTHASH_SSE2)
+static const char* const simd = "sse2";
+#else
+static const char* const simd = "scalar";
+#endif
+
+int main(int argc, char* argv[])
+{
+#if defined(FASTHASH_AVX2) && defined(__GNUC__)
+	if (!__builtin_cpu_supports("avx2"))
+	{
+		std::printf("no avx2 on this cpu\n");
+		return 0;
+	}
+#endif
+	const size_t largest = (size_t)bench::arg(argc, argv, 1, 64) << 20;
+	const unsigned threads = (std::max)(std::thread::hardware_concurrency(), 1u);
+
+	std::vector<uint8_t> data(largest);
+	std::mt19937_64 rng(66);
+	for (size_t i = 0; i < data.size(); i += 8)
+	{
+		const uint64_t v = rng();
+		std::memcpy(&data[i], &v, (std::min)((size_t)8, data.size() - i));
+	}
+
+	WorkPool pool(threads);
+	std::printf("%s, %u threads in the pool, check %016llx\n", simd, threads,
+		(unsigned long long)FastHash::hash(data.data(), (std::min)(data.size(), (size_t)1 << 20), 66));
+	std::printf("%10s %10s %10s %10s %10s\n", "size", "hash", "pages", "pool", "digest");
+	for (size_t size = 4096; size <= largest; size *= 16)
+	{
+		// enough rounds for about 256 MB per measurement
+		const size_t rounds = (std::max)((size_t)1, ((size_t)256 << 20) / size);
+		auto gbs = [&](auto f)
+		{
+			const double ms = bench::best(3, [&]
+			{
+				for (size_t r = 0; r < rounds; r++)
+					f();
+			});
+			return (double)size * rounds / ms / 1e6;
+		};
+
+		const double one = gbs([&] { bench::keep(FastHash::hash(data.data(), size)); });
+		const double pages = gbs([&] { bench::keep(FastHash::chunks(data.data(), size, 0x1000)[0]); });
+		const double pooled = gbs([&] { bench::keep(FastHash::chunks(data.data(), size, 0x1000, &pool)[0]); });
+		const double digest = gbs([&] { bench::keep(FastHash::digest(data.data(), size, &pool)); });
+
+		const std::string label = size < (1 << 20) ? std::to_string(size >> 10) + " kB" : std::to_string(size >> 20) + " MB";
+		std::printf("%10s %10.2f %10.2f %10.2f %10.2f\n", label.c_str(), one, pages, pooled, digest);
+	}
+	std::printf("in GB/s\n");
+	return 0;
+}
@@ -0,0 +1,61 @@
+// remote calls, bytes moved and time of planned reads for gap thresholds from none to many
+// pages, against a fake target whose every call costs about as much as ReadProcessMemory
+//   ioplan_bench [spans] [ns per call]
+#include "bench.hpp"
+#include "test/fakememory.hpp"
+#include <random>
+#include <string>
+
+int main(int argc, char* argv[])
+{
+	const long count = bench::arg(argc, argv, 1, 4000);
+	const long callNs = bench::arg(argc, argv, 2, 2000);
+
+	// small reads in clusters, like the headers, import descriptors and relocation blocks of the
+	// modules of a target, spread over 64 MB
+	const uintptr_t base = 0x10000000;
+	FakeMemory memory(base, 64 << 20);
+	std::mt19937 rng(63);
+	std::vector<std::vector<uint8_t>> locals(count);
+	std::vector<IoSpan> spans;
+	uintptr_t cluster = 0;
+	for (long i = 0; i < count; i++)
+	{
+		if (i % 32 == 0)
+			cluster = base + rng() % (memory.size() - (1 << 20));
+		locals[i].resize(8 + rng() % 256);
+		spans.push_back({ cluster + rng() % (1 << 20), locals[i].data(), locals[i].size() });
+	}
+	size_t wanted = 0;
+	for (const IoSpan& s : spans)
+		wanted += s.size;
+
+	std::printf("%ld spans, %zu bytes, %ld ns per call\n", count, wanted, callNs);
+	std::printf("%10s %10s %12s %10s\n", "gap", "calls", "MB moved", "ms");
+	auto row = [&](const char* gap, auto read)
+	{
+		memory.calls = memory.moved = 0;
+		read();
+		const size_t calls = memory.calls, moved = memory.moved;
+		const double ms = bench::best(3, [&]
+		{
+			read();
+			bench::spin(calls * callNs);
+		});
+		std::printf("%10s %10zu %12.2f %10.2f\n", gap, calls, moved / 1048576.0, ms);
+	};
+
+	// one call per span, what readv replaced
+	row("unplanned", [&]
+	{
+		for (const IoSpan& s : spans)
+			memory.read(s.remote, s.local, s.size);
+	});
+	for (uintptr_t pages : { 0, 1, 2, 4, 8, 16, 64, 256 })
+	{
+		const std::string gap = std::to_string(pages) + (pages == 1 ? " page" : " pages");
+		row(gap.c_str(), [&] { memory.readv(spans, pages * IoPlan::pageSize); });
+	}
+	bench::keep(locals[count / 2][0]);
+	return 0;
+}
@@ -0,0 +1,80 @@
+// the linux memory and query layer against a cooperative child: remote reads and writes of
+// different sizes, vectored against one call per span, and maps, region and thread queries.
+// the child is forked after its buffers are set up, so both know where they are
+//   procfs_bench [spans]
+#include "bench.hpp"
+#include "injectory/procfs.hpp"
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+
+int main(int argc, char* argv[])
+{
+	const size_t count = (size_t)bench::arg(argc, argv, 1, 256);
+	const size_t size = 4 << 20;
+	std::vector<uint8_t> shared(size);
+	for (size_t i = 0; i < size; i++)
+		shared[i] = (uint8_t)(i * 131);
+
+	int ready[2];
+	if (::pipe(ready) != 0)
+		return 1;
+	const pid_t pid = ::fork();
+	if (pid == 0)
+	{
+		// a few threads to enumerate, then wait to be killed
+		std::vector<std::thread> threads;
+		for (int i = 0; i < 3; i++)
+			threads.emplace_back([] { for (;;) ::pause(); });
+		char c = 1;
+		if (::write(ready[1], &c, 1) != 1)
+			::_exit(1);
+		for (;;)
+			::pause();
+	}
+	char c;
+	if (pid < 0 || ::read(ready[0], &c, 1) != 1)
+		return 1;
+
+	LinuxProcess child(pid);
+	std::vector<uint8_t> local(size);
+	const uintptr_t remote = (uintptr_t)shared.data();
+
+	std::printf("child %d, %zu regions, %zu threads\n", (int)pid, child.maps().size(), child.threads().size());
+	std::printf("%-36s %12s %10s\n", "", "us per call", "GB/s");
+	auto row = [](const char* name, size_t bytes, size_t calls, auto f)
+	{
+		const double ms = bench::best(5, [&] { for (size_t i = 0; i < calls; i++) f(); });
+		if (bytes)
+			std::printf("%-36s %12.2f %10.2f\n", name, ms * 1000 / calls, bytes * calls / ms / 1e6);
+		else
+			std::printf("%-36s %12.2f %10s\n", name, ms * 1000 / calls, "-");
+	};
+
+	row("read 8 bytes", 8, 10000, [&] { bench::keep(child.memory<uint64_t>(remote)); });
+	row("read 4 kB", 4096, 2000, [&] { child.read(remote, local.data(), 4096); });
+	row("read 64 kB", 64 << 10, 500, [&] { child.read(remote, local.data(), 64 << 10); });
+	row("read 4 MB", size, 10, [&] { child.read(remote, local.data(), size); });
+	row("write 64 kB", 64 << 10, 500, [&] { child.write(remote, local.data(), 64 << 10); });
+
+	LinuxMemoryArea area(child, remote, 64 << 10);
+	row("memory area read 64 kB", 64 << 10, 500, [&] { bench::keep(area.read()[0]); });
+	row("memory area write 64 kB", 64 << 10, 500, [&] { area.write(local.data()); });
+
+	// small spans a page apart, like import thunks and relocation blocks
+	std::vector<IoSpan> spans;
+	for (size_t i = 0; i < count; i++)
+		spans.push_back({ remote + (i * 0x1000 + i * 24) % (size - 64), local.data() + i * 64, 64 });
+	const std::string name = std::to_string(count) + " spans of 64 bytes";
+	row((name + ", readv").c_str(), count * 64, 200, [&] { child.readv(spans); });
+	row((name + ", one by one").c_str(), count * 64, 200, [&] { for (const IoSpan& s : spans) child.read(s.remote, s.local, s.size); });
+	row((name + ", writev").c_str(), count * 64, 200, [&] { child.writev(spans); });
+
+	row("maps", 0, 200, [&] { bench::keep(child.maps().size()); });
+	row("regions", 0, 200, [&] { bench::keep(child.regions().modules().size()); });
+	row("threads", 0, 200, [&] { bench::keep(child.threads().size()); });
+
+	::kill(pid, SIGKILL);
+	::waitpid(pid, nullptr, 0);
+	return 0;
+}
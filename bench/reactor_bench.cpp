@@ -0,0 +1,125 @@
+// throughput and fairness of the WaitReactor with many handles in flight. windows only, make
+// leaves it out, build it with every injectory\*.cpp but main.cpp, e.g. from bench\:
+//   cl /std:c++17 /EHsc /O2 /I.. /I%BOOST_ROOT% reactor_bench.cpp ..\injectory\*.cpp (without main.cpp)
+//   reactor_bench [rounds per handle]
+// a signaler thread sets armed events in random order, every callback records how long its
+// event waited to be noticed and arms it again. WaitForMultipleObjects reports the lowest
+// signaled index, so the handles late in a waiter's list are the ones that could starve, the
+// Jain index over the mean latency of each handle is 1 when all are served alike
+#include "bench.hpp"
+#include "injectory/reactor.hpp"
+#include <atomic>
+#include <memory>
+#include <random>
+
+namespace
+{
+	struct Slot
+	{
+		WinHandle event;
+		std::atomic<bool> armed = false;
+		std::atomic<int64_t> signaledAt = 0;
+		vector<double> latencies;	// in us, only touched by the callback of the slot
+	};
+
+	int64_t now()
+	{
+		return bench::clock::now().time_since_epoch().count();
+	}
+
+	double jain(const vector<double>& x)
+	{
+		double sum = 0, squares = 0;
+		for (double v : x)
+		{
+			sum += v;
+			squares += v * v;
+		}
+		return squares > 0 ? sum * sum / (x.size() * squares) : 1;
+	}
+
+	void run(WaitReactor& reactor, size_t handles, int rounds)
+	{
+		vector<std::unique_ptr<Slot>> slots;
+		std::atomic<size_t> finished = 0;
+		for (size_t i = 0; i < handles; i++)
+		{
+			slots.push_back(std::make_unique<Slot>());
+			slots.back()->event = WinHandle(CreateEventW(nullptr, TRUE, FALSE, nullptr), CloseHandle);
+		}
+
+		function<void(Slot&)> arm = [&](Slot& slot)
+		{
+			reactor.watch(slot.event, [&, s = &slot](DWORD waitResult)
+			{
+				if (waitResult == WAIT_FAILED)
+				{
+					std::fprintf(stderr, "wait failed\n");
+					std::exit(1);
+				}
+				s->latencies.push_back((now() - s->signaledAt) / 1000.0);
+				ResetEvent(s->event.handle());
+				if ((int)s->latencies.size() < rounds)
+				{
+					arm(*s);
+					s->armed = true;
+				}
+				else
+					finished++;
+			});
+		};
+		for (auto& slot : slots)
+		{
+			arm(*slot);
+			slot->armed = true;
+		}
+
+		const bench::clock::time_point start = bench::clock::now();
+		std::mt19937 rng(56);
+		vector<size_t> order(handles);
+		for (size_t i = 0; i < handles; i++)
+			order[i] = i;
+		while (finished < handles)
+		{
+			std::shuffle(order.begin(), order.end(), rng);
+			for (size_t i : order)
+			{
+				Slot& slot = *slots[i];
+				if (slot.armed.exchange(false))
+				{
+					slot.signaledAt = now();
+					SetEvent(slot.event.handle());
+				}
+			}
+			std::this_thread::yield();
+		}
+		const double ms = bench::millis(bench::clock::now() - start);
+
+		vector<double> all, means;
+		for (auto& slot : slots)
+		{
+			double sum = 0;
+			for (double l : slot->latencies)
+				sum += l;
+			means.push_back(sum / slot->latencies.size());
+			all.insert(all.end(), slot->latencies.begin(), slot->latencies.end());
+		}
+		std::sort(all.begin(), all.end());
+		std::printf("%8zu %8zu %12.0f %10.1f %10.1f %10.1f %8.3f\n", handles, reactor.waiterCount(),
+			all.size() / ms * 1000, all[all.size() / 2], all[all.size() * 99 / 100], all.back(), jain(means));
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const int rounds = (int)bench::arg(argc, argv, 1, 200);
+
+	std::printf("%8s %8s %12s %10s %10s %10s %8s\n", "handles", "waiters", "calls/s", "p50 us", "p99 us", "max us", "jain");
+	for (size_t handles : { 16, 63, 64, 256, 1024 })
+	{
+		// a reactor per row, so the waiter count is what that many handles need
+		WaitReactor reactor;
+		run(reactor, handles, rounds);
+	}
+	return 0;
+}
@@ -0,0 +1,53 @@
+// speedup of sharded RegionMap scans over a sequential walk, against a fake target with many
+// small regions whose queries cost about as much as VirtualQueryEx
+//   scan_bench [regions] [ns per query]
+#include "bench.hpp"
+#include "test/fakespace.hpp"
+#include <atomic>
+#include <random>
+#include <thread>
+
+int main(int argc, char* argv[])
+{
+	const long regions = bench::arg(argc, argv, 1, 50000);
+	const long queryNs = bench::arg(argc, argv, 2, 1000);
+
+	// allocations of one to four pages with gaps between them, like a fragmented jit heap
+	std::mt19937 rng(52);
+	FakeSpace space((uintptr_t)regions * 8 * FakeSpace::page);
+	for (uintptr_t base = 0; base < space.end(); )
+	{
+		base += (1 + rng() % 4) * FakeSpace::page;
+		uintptr_t size = (1 + rng() % 4) * FakeSpace::page;
+		if (base + size > space.end())
+			break;
+		space.allocate(base, size);
+		base += size;
+	}
+
+	std::atomic<size_t> queries = 0;
+	RegionMap::Query query = [&](uintptr_t address)
+	{
+		queries.fetch_add(1, std::memory_order_relaxed);
+		bench::spin(queryNs);
+		return space.query(address);
+	};
+
+	std::printf("%u hardware threads, %ld ns per query\n", std::thread::hardware_concurrency(), queryNs);
+	std::printf("%8s %10s %10s %8s\n", "shards", "queries", "ms", "speedup");
+	double sequential = 0;
+	for (unsigned shards : { 1u, 2u, 4u, 8u, 16u, 32u, 64u })
+	{
+		size_t regionCount = 0;
+		queries = 0;
+		double ms = bench::best(3, [&]
+		{
+			regionCount = RegionMap::scan(query, 0, space.end(), shards).regions().size();
+		});
+		if (shards == 1)
+			sequential = ms;
+		std::printf("%8u %10zu %10.2f %8.2f\n", shards, queries.load() / 3, ms, sequential / ms);
+		bench::keep(regionCount);
+	}
+	return 0;
+}
@@ -0,0 +1,73 @@
+// scaling of WorkPool from one thread to one per core, with cpu-bound work items like parsing
+// and relocating payloads: many independent ones submitted from outside, and parallelFor chunks
+//   workpool_bench [items] [us of work per item]
+#include "bench.hpp"
+#include "injectory/workpool.hpp"
+#include <cstdint>
+#include <thread>
+
+namespace
+{
+	// about us microseconds of integer work, like walking relocations
+	uint64_t work(uint64_t seed, long us)
+	{
+		uint64_t x = seed | 1;
+		for (long i = 0; i < us * 150; i++)
+		{
+			x ^= x << 13;
+			x ^= x >> 7;
+			x ^= x << 17;
+		}
+		return x;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const long items = bench::arg(argc, argv, 1, 4000);
+	const long us = bench::arg(argc, argv, 2, 50);
+	const unsigned cores = (std::max)(std::thread::hardware_concurrency(), 1u);
+
+	std::printf("%ld items of about %ld us, %u hardware threads\n", items, us, cores);
+	std::printf("%8s %12s %8s %12s %8s %10s\n", "threads", "submit ms", "speedup", "parallelFor", "speedup", "stolen");
+	double submitOne = 0, forOne = 0;
+	for (unsigned threads = 1; threads <= cores; threads = threads < cores && threads * 2 > cores ? cores : threads * 2)
+	{
+		WorkPool pool(threads);
+		uint64_t sum = 0;
+
+		// one future per item through the bounded global queue
+		const double submitMs = bench::best(3, [&]
+		{
+			std::vector<std::future<uint64_t>> results;
+			results.reserve(items);
+			for (long i = 0; i < items; i++)
+				results.push_back(pool.submit([i, us] { return work(i, us); }));
+			for (auto& r : results)
+				sum += r.get();
+		});
+
+		// chunks of 16 items, the way relocation blocks are split up
+		std::vector<uint64_t> out(items);
+		const double forMs = bench::best(3, [&]
+		{
+			pool.parallelFor(items, 16, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+					out[i] = work(i, us);
+			});
+		});
+
+		if (threads == 1)
+		{
+			submitOne = submitMs;
+			forOne = forMs;
+		}
+		std::printf("%8u %12.2f %8.2f %12.2f %8.2f %10zu\n", threads, submitMs, submitOne / submitMs, forMs, forOne / forMs, pool.stats().stolen);
+		bench::keep(sum);
+		bench::keep(out[items / 2]);
+		if (threads == cores)
+			break;
+	}
+	return 0;
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include "injectory/common.hpp"
 #include "injectory/module.hpp"
+#include "injectory/metrics.hpp"
 class Process;
 
 inline SYSTEM_INFO getSystemInfo()
@@ -26,6 +27,7 @@ inline SYSTEM_INFO getNativeSystemInfo()
 
 inline void* VirtualAllocEx_Throwing(const Process& proc, void* address, SIZE_T size, DWORD allocationType, DWORD protect)
 {
+	Metrics::add(Metrics::RemoteAllocate);
 	void* area = VirtualAllocEx(proc.handle(), address, size, allocationType, protect);
 	if (!area)
 	{
@@ -37,6 +39,7 @@ inline void* VirtualAllocEx_Throwing(const Process& proc, void* address, SIZE_T
 
 inline void ReadProcessMemory_Throwing(const Process& process, void* address, void* out, SIZE_T size)
 {
+	Metrics::add(Metrics::RemoteRead);
 	SIZE_T numBytesRead = (SIZE_T)-1;
 	if (!ReadProcessMemory(process.handle(), address, out, size, &numBytesRead))
 	{
@@ -49,6 +52,7 @@ inline void ReadProcessMemory_Throwing(const Process& process, void* address, vo
 
 inline void WriteProcessMemory_Throwing(const Process& process, void* dst, const void* src, SIZE_T size)
 {
+	Metrics::add(Metrics::RemoteWrite);
 	SIZE_T numBytesWritten = 0;
 	if (!WriteProcessMemory(process.handle(), dst, src, size, &numBytesWritten))
 	{
@@ -57,6 +61,7 @@ inline void WriteProcessMemory_Throwing(const Process& process, void* dst, const
 	}
 	if (numBytesWritten != size)
 		BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("WriteProcessMemory") << e_text("only wrote " + to_string(numBytesWritten) + "/" + to_string(size) + " bytes"));
+	Metrics::add(Metrics::BytesWritten, size);
 }
 
 inline HANDLE GetStdHandle_Throwing(DWORD nStdHandle)
@@ -70,3 +70,19 @@ namespace std
 using std::to_string;
 using std::to_wstring;
 
+// s as a quoted JSON string
+inline string jsonString(const string& s)
+{
+	string out = "\"";
+	for (char c : s)
+	{
+		if (c == '"' || c == '\\')
+			out += string("\\") + c;
+		else if ((unsigned char)c < 0x20)
+			out += (format("\\u%04x") % (int)c).str();
+		else
+			out += c;
+	}
+	return out + "\"";
+}
+
@@ -1,5 +1,7 @@
 #include "injectory/process.hpp"
 #include "injectory/memoryarea.hpp"
+#include "injectory/module.hpp"
+#include <boost/algorithm/string.hpp>
 
 typedef BOOL(__stdcall *DLLMAIN)(HMODULE hModule, DWORD ul_reason_for_call, LPVOID lpReserved);
 
@@ -19,16 +21,147 @@ void DllMainWrapper_end(void)
 {
 }
 
+SIZE_T Process::dllMainCallSize()
+{
+	return sizeof(DLLMAINCALL) + ((SIZE_T)DllMainWrapper_end - (SIZE_T)DllMainWrapper);
+}
+
 void Process::remoteDllMainCall(void* lpModuleEntry, HMODULE hModule, DWORD ul_reason_for_call, void* lpReserved)
 {
 	DLLMAINCALL dllMainCall = { (DLLMAIN)lpModuleEntry, hModule, ul_reason_for_call, lpReserved };
 	SIZE_T DllMainWrapperSize = (SIZE_T)DllMainWrapper_end - (SIZE_T)DllMainWrapper; 
 
-	MemoryAreaT<DLLMAINCALL> param = alloc<DLLMAINCALL>();
-	MemoryArea dllCallWrapper = alloc(DllMainWrapperSize);
+	MemoryAreaT<DLLMAINCALL> param = alloc<DLLMAINCALL>("DllMain call parameters");
+	MemoryArea dllCallWrapper = alloc(DllMainWrapperSize, "DllMain call wrapper");
 
 	param = dllMainCall;
 	dllCallWrapper.write(DllMainWrapper);
 
 	runInHiddenThread((PTHREAD_START_ROUTINE)dllCallWrapper.address(), param.address());
 }
+
+
+
+typedef BOOL(__stdcall *FREELIBRARY)(HMODULE hModule);
+
+const DWORD FREELIBRARYBATCH_MAX = 64;
+
+struct FREELIBRARYBATCH
+{
+	FREELIBRARY fpFreeLibrary;
+	DWORD count;
+	HMODULE modules[FREELIBRARYBATCH_MAX];
+	BOOL results[FREELIBRARYBATCH_MAX];
+};
+
+DWORD __stdcall FreeLibraryBatch(struct FREELIBRARYBATCH *parameter)
+{
+	for (DWORD i = 0; i < parameter->count; i++)
+		parameter->results[i] = parameter->fpFreeLibrary(parameter->modules[i]);
+	return parameter->count;
+}
+void FreeLibraryBatch_end(void)
+{
+}
+
+const size_t Process::ejectBatchMax = FREELIBRARYBATCH_MAX;
+
+SIZE_T Process::ejectCodeSize()
+{
+	return (SIZE_T)FreeLibraryBatch_end - (SIZE_T)FreeLibraryBatch;
+}
+
+SIZE_T Process::ejectBatchSize()
+{
+	return sizeof(FREELIBRARYBATCH);
+}
+
+namespace
+{
+	// importers first, so no module is freed while another one in the batch still references it
+	vector<size_t> ejectOrder(const vector<Module>& modules)
+	{
+		vector<string> names;
+		vector<vector<string>> imports;
+		for (const Module& module : modules)
+		{
+			names.push_back(module.path().filename().string());
+			try { imports.push_back(module.imports()); }
+			catch (...) { imports.push_back({}); }
+		}
+
+		auto importedBy = [&](size_t i, size_t j)
+		{
+			for (const string& name : imports[j])
+			{
+				if (boost::iequals(name, names[i]))
+					return true;
+			}
+			return false;
+		};
+
+		vector<size_t> order;
+		vector<bool> done(modules.size(), false);
+		while (order.size() < modules.size())
+		{
+			size_t before = order.size();
+			for (size_t i = 0; i < modules.size(); i++)
+			{
+				if (done[i])
+					continue;
+				bool stillImported = false;
+				for (size_t j = 0; j < modules.size() && !stillImported; j++)
+					stillImported = j != i && !done[j] && importedBy(i, j);
+				if (!stillImported)
+				{
+					order.push_back(i);
+					done[i] = true;
+				}
+			}
+
+			// a cycle, free the rest in the given order
+			if (order.size() == before)
+			{
+				for (size_t i = 0; i < modules.size(); i++)
+				{
+					if (!done[i])
+					{
+						order.push_back(i);
+						done[i] = true;
+					}
+				}
+			}
+		}
+		return order;
+	}
+}
+
+vector<bool> Process::eject(const vector<Module>& modules)
+{
+	static const FREELIBRARY freeLibrary = (FREELIBRARY)Module::kernel32().getProcAddress("FreeLibrary");
+	SIZE_T FreeLibraryBatchSize = (SIZE_T)FreeLibraryBatch_end - (SIZE_T)FreeLibraryBatch;
+
+	vector<size_t> order = ejectOrder(modules);
+	vector<bool> freed(modules.size(), false);
+	if (modules.empty())
+		return freed;
+
+	MemoryArea batchCode = alloc(FreeLibraryBatchSize, "FreeLibrary batch code");
+	batchCode.write(FreeLibraryBatch);
+	MemoryAreaT<FREELIBRARYBATCH> param = alloc<FREELIBRARYBATCH>("FreeLibrary batch parameters", true, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+	for (size_t first = 0; first < order.size(); first += FREELIBRARYBATCH_MAX)
+	{
+		FREELIBRARYBATCH batch = { freeLibrary, 0 };
+		for (size_t i = first; i < order.size() && batch.count < FREELIBRARYBATCH_MAX; i++)
+			batch.modules[batch.count++] = modules[order[i]].handle();
+
+		param = batch;
+		runInHiddenThread((PTHREAD_START_ROUTINE)batchCode.address(), param.address());
+		batch = param;
+
+		for (DWORD i = 0; i < batch.count; i++)
+			freed[order[first + i]] = batch.results[i] != FALSE;
+	}
+	return freed;
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include "injectory/common.hpp"
 #include "injectory/exception.hpp"
+#include <algorithm>
 
 class Environment
 {
@@ -77,6 +78,19 @@ public:
 
 
 public:
+	// the double null terminated block CreateProcess takes, sorted by name like the system builds it
+	wstring block() const
+	{
+		vector<std::pair<wstring, wstring>> sorted(env.begin(), env.end());
+		std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return _wcsicmp(a.first.c_str(), b.first.c_str()) < 0; });
+
+		wstring block;
+		for (const auto&[k, v] : sorted)
+			block += k + L'=' + v + L'\0';
+		block += L'\0';
+		return block;
+	}
+
 	size_type count(const wstring& key) const
 	{
 		return env.count(key);
@@ -150,7 +150,47 @@ string diagnostic_information(const boost::exception& be)
 	return "error getting diagnostic_information from exception";
 }
 
-void print_exception(std::exception_ptr ep, const string& prefix, int level)
+string exception_class(std::exception_ptr ep)
+{
+	try
+	{
+		std::rethrow_exception(ep);
+	}
+	catch (const ex_target_bit_mismatch&)		{ return "target_bit_mismatch"; }
+	catch (const ex_hide&)						{ return "hide"; }
+	catch (const ex_set_se_debug_privilege&)	{ return "set_se_debug_privilege"; }
+	catch (const ex_fix_iat&)					{ return "fix_iat"; }
+	catch (const ex_map_remote&)				{ return "map_remote"; }
+	catch (const ex_injection&)					{ return "injection"; }
+	catch (const ex_suspend_resume_thread&)		{ return "suspend_resume_thread"; }
+	catch (const ex_wait_for_input_idle&)		{ return "wait_for_input_idle"; }
+	catch (const ex_wait_for_single_object&)	{ return "wait_for_single_object"; }
+	catch (const ex_wait_for_multiple_objects&)	{ return "wait_for_multiple_objects"; }
+	catch (const ex_get_module_handle&)			{ return "get_module_handle"; }
+	catch (const ex_file_not_found&)			{ return "file_not_found"; }
+	catch (const ex_job&)						{ return "job"; }
+	catch (const ex_trigger&)					{ return "trigger"; }
+	catch (const ex& e)
+	{
+		// a wrapper like "failed to map PE file", the class is that of what it wraps
+		if (const boost::exception_ptr* nested = boost::get_error_info<boost::errinfo_nested_exception>(e))
+		{
+			try
+			{
+				boost::rethrow_exception(*nested);
+			}
+			catch (...)
+			{
+				return exception_class(std::current_exception());
+			}
+		}
+		return "other";
+	}
+	catch (const std::exception&)				{ return "std"; }
+	catch (...)									{ return "unknown"; }
+}
+
+string exception_text(std::exception_ptr ep, const string& prefix, int level)
 {
 	std::ostringstream ss;
 
@@ -194,7 +234,7 @@ void print_exception(std::exception_ptr ep, const string& prefix, int level)
 	{
 		ss << "unkown exception" << endl;
 	}
-	cerr << std::regex_replace(ss.str(), std::regex("^"), string(level, ' '));
+	string text = std::regex_replace(ss.str(), std::regex("^"), string(level, ' '));
 
 
 
@@ -218,8 +258,14 @@ void print_exception(std::exception_ptr ep, const string& prefix, int level)
 		}
 		catch (...)
 		{
-			print_exception(std::current_exception(), "caused by", level + 1);
+			text += exception_text(std::current_exception(), "caused by", level + 1);
 		}
 	}
 	catch (...) {}
+	return text;
+}
+
+void print_exception(std::exception_ptr ep, const string& prefix, int level)
+{
+	cerr << exception_text(ep, prefix, level);
 }
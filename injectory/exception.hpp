@@ -38,6 +38,7 @@ struct ex_wait_for_multiple_objects	: virtual exception_base { };
 struct ex_get_module_handle			: virtual exception_base { };
 struct ex_file_not_found			: virtual exception_base { };
 struct ex_job						: virtual exception_base { };
+struct ex_trigger					: virtual exception_base { };
 
 typedef boost::error_info<struct errinfo_text_, string> e_text;
 typedef boost::error_info<struct errinfo_file_, fs::path> e_file;
@@ -60,4 +61,8 @@ namespace boost
 	string to_string(const e_process& x);
 }
 
+// the exception class without the ex_ prefix, for counting failures by class
+std::string exception_class(std::exception_ptr e);
+// the text print_exception writes, including nested exceptions
+std::string exception_text(std::exception_ptr e, const std::string& prefix = "", int level = 0);
 void print_exception(std::exception_ptr e, const std::string& prefix = "", int level = 0);
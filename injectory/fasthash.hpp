@@ -0,0 +1,272 @@
+#pragma once
+#include "injectory/workpool.hpp"
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// FASTHASH_SCALAR leaves SIMD out, e.g. to compare against it
+#if defined(FASTHASH_SCALAR)
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define FASTHASH_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FASTHASH_SSE2
+#endif
+
+// a fast non-cryptographic 64 bit hash for telling pages and images apart and for cache keys,
+// built like the long input loop of XXH3. eight 64 bit lanes each take a word of every 64 byte
+// stripe xored with a key, multiply its halves and add the word to the neighbouring lane, which
+// maps directly onto SSE2/AVX2 32x32->64 multiplies. results are the same with and without SIMD,
+// but not the same as XXH3 itself
+class FastHash
+{
+public:
+	static constexpr size_t stripe = 64;
+	static constexpr size_t stripesPerBlock = 16;
+	static constexpr size_t block = stripe * stripesPerBlock;
+
+private:
+	static constexpr uint64_t prime32_1 = 0x9E3779B1ull;
+	static constexpr uint64_t prime32_2 = 0x85EBCA77ull;
+	static constexpr uint64_t prime32_3 = 0xC2B2AE3Dull;
+	static constexpr uint64_t prime64_1 = 0x9E3779B185EBCA87ull;
+	static constexpr uint64_t prime64_2 = 0xC2B2AE3D27D4EB4Full;
+	static constexpr uint64_t prime64_3 = 0x165667B19E3779F9ull;
+	static constexpr uint64_t prime64_4 = 0x85EBCA77C2B2AE63ull;
+	static constexpr uint64_t prime64_5 = 0x27D4EB2F165667C5ull;
+
+	// 8 keys per stripe, shifted by one word for every stripe of a block, plus one for the scramble
+	static constexpr size_t keyCount = 8 + stripesPerBlock;
+
+	struct Keys
+	{
+		uint64_t k[keyCount];
+	};
+
+	static constexpr Keys makeKeys()
+	{
+		Keys keys = {};
+		uint64_t x = prime64_3;
+		for (size_t i = 0; i < keyCount; i++)
+		{
+			// splitmix64
+			x += 0x9E3779B97F4A7C15ull;
+			uint64_t z = x;
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			keys.k[i] = z ^ (z >> 31);
+		}
+		return keys;
+	}
+
+	static const uint64_t* keys()
+	{
+		static constexpr Keys k = makeKeys();
+		return k.k;
+	}
+
+	static uint64_t read64(const uint8_t* p)
+	{
+		uint64_t v;
+		std::memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	static void accumulateScalar(uint64_t* acc, const uint8_t* p, const uint64_t* key)
+	{
+		for (size_t i = 0; i < 8; i++)
+		{
+			const uint64_t data = read64(p + 8 * i);
+			const uint64_t dataKey = data ^ key[i];
+			acc[i ^ 1] += data;
+			acc[i] += (dataKey & 0xFFFFFFFF) * (dataKey >> 32);
+		}
+	}
+
+	static void scrambleScalar(uint64_t* acc, uint64_t key)
+	{
+		for (size_t i = 0; i < 8; i++)
+		{
+			uint64_t a = acc[i];
+			a ^= a >> 47;
+			a ^= key;
+			acc[i] = a * prime32_1;
+		}
+	}
+
+#if defined(FASTHASH_AVX2)
+	static void accumulate(uint64_t* acc, const uint8_t* p, const uint64_t* key)
+	{
+		for (size_t i = 0; i < 2; i++)
+		{
+			__m256i a = _mm256_loadu_si256((const __m256i*)acc + i);
+			const __m256i data = _mm256_loadu_si256((const __m256i*)p + i);
+			const __m256i dataKey = _mm256_xor_si256(data, _mm256_loadu_si256((const __m256i*)(key + 4 * i)));
+			const __m256i product = _mm256_mul_epu32(dataKey, _mm256_srli_epi64(dataKey, 32));
+			const __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+			a = _mm256_add_epi64(a, _mm256_add_epi64(product, swapped));
+			_mm256_storeu_si256((__m256i*)acc + i, a);
+		}
+	}
+
+	static void scramble(uint64_t* acc, uint64_t key)
+	{
+		const __m256i k = _mm256_set1_epi64x((long long)key);
+		const __m256i prime = _mm256_set1_epi32((int)prime32_1);
+		for (size_t i = 0; i < 2; i++)
+		{
+			__m256i a = _mm256_loadu_si256((const __m256i*)acc + i);
+			a = _mm256_xor_si256(_mm256_xor_si256(a, _mm256_srli_epi64(a, 47)), k);
+			const __m256i lo = _mm256_mul_epu32(a, prime);
+			const __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), prime);
+			_mm256_storeu_si256((__m256i*)acc + i, _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32)));
+		}
+	}
+#elif defined(FASTHASH_SSE2)
+	static void accumulate(uint64_t* acc, const uint8_t* p, const uint64_t* key)
+	{
+		for (size_t i = 0; i < 4; i++)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i*)acc + i);
+			const __m128i data = _mm_loadu_si128((const __m128i*)p + i);
+			const __m128i dataKey = _mm_xor_si128(data, _mm_loadu_si128((const __m128i*)(key + 2 * i)));
+			const __m128i product = _mm_mul_epu32(dataKey, _mm_srli_epi64(dataKey, 32));
+			const __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+			a = _mm_add_epi64(a, _mm_add_epi64(product, swapped));
+			_mm_storeu_si128((__m128i*)acc + i, a);
+		}
+	}
+
+	static void scramble(uint64_t* acc, uint64_t key)
+	{
+		const __m128i k = _mm_set_epi32((int)(key >> 32), (int)key, (int)(key >> 32), (int)key);
+		const __m128i prime = _mm_set1_epi32((int)prime32_1);
+		for (size_t i = 0; i < 4; i++)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i*)acc + i);
+			a = _mm_xor_si128(_mm_xor_si128(a, _mm_srli_epi64(a, 47)), k);
+			const __m128i lo = _mm_mul_epu32(a, prime);
+			const __m128i hi = _mm_mul_epu32(_mm_srli_epi64(a, 32), prime);
+			_mm_storeu_si128((__m128i*)acc + i, _mm_add_epi64(lo, _mm_slli_epi64(hi, 32)));
+		}
+	}
+#else
+	static void accumulate(uint64_t* acc, const uint8_t* p, const uint64_t* key)
+	{
+		accumulateScalar(acc, p, key);
+	}
+
+	static void scramble(uint64_t* acc, uint64_t key)
+	{
+		scrambleScalar(acc, key);
+	}
+#endif
+
+	// the high and low halves of the 128 bit product xored
+	static uint64_t mulFold(uint64_t a, uint64_t b)
+	{
+		const uint64_t aLo = a & 0xFFFFFFFF, aHi = a >> 32;
+		const uint64_t bLo = b & 0xFFFFFFFF, bHi = b >> 32;
+		const uint64_t ll = aLo * bLo, lh = aLo * bHi, hl = aHi * bLo, hh = aHi * bHi;
+		const uint64_t cross = (ll >> 32) + (lh & 0xFFFFFFFF) + hl;
+		const uint64_t hi = hh + (lh >> 32) + (cross >> 32);
+		const uint64_t lo = (cross << 32) | (ll & 0xFFFFFFFF);
+		return hi ^ lo;
+	}
+
+	static uint64_t avalanche(uint64_t h)
+	{
+		h ^= h >> 37;
+		h *= 0x165667919E3779F9ull;
+		return h ^ (h >> 32);
+	}
+
+public:
+	static uint64_t hash(const void* data, size_t size, uint64_t seed = 0)
+	{
+		const uint8_t* p = (const uint8_t*)data;
+		const uint64_t* k = keys();
+		uint64_t acc[8] = { prime32_3, prime64_1, prime64_2, prime64_3, prime64_4, prime32_2, prime64_5, prime32_1 };
+		acc[0] ^= seed;
+		acc[1] += seed;
+
+		// short input, one zero padded stripe
+		if (size < stripe)
+		{
+			uint8_t last[stripe] = {};
+			if (size)
+				std::memcpy(last, p, size);
+			accumulate(acc, last, k);
+		}
+		else
+		{
+			const size_t stripes = (size - 1) / stripe; // the last stripe is always done separately
+			for (size_t s = 0; s < stripes; s++)
+			{
+				accumulate(acc, p + s * stripe, k + s % stripesPerBlock);
+				if (s % stripesPerBlock == stripesPerBlock - 1)
+					scramble(acc, k[keyCount - 1]);
+			}
+			// overlaps the one before when size isn't a multiple of the stripe
+			accumulate(acc, p + size - stripe, k + 7);
+		}
+
+		uint64_t h = (uint64_t)size * prime64_1;
+		for (size_t i = 0; i < 8; i += 2)
+			h += mulFold(acc[i] ^ k[i + 1], acc[i + 1] ^ k[i + 2]);
+		return avalanche(h);
+	}
+
+	// one hash per chunkSize bytes, e.g. per page, the last chunk may be shorter.
+	// large inputs are split over the pool
+	static std::vector<uint64_t> chunks(const void* data, size_t size, size_t chunkSize, WorkPool* pool = nullptr)
+	{
+		const uint8_t* p = (const uint8_t*)data;
+		const size_t count = chunkSize ? (size + chunkSize - 1) / chunkSize : 0;
+		std::vector<uint64_t> hashes(count);
+		auto run = [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				hashes[i] = hash(p + i * chunkSize, (std::min)(chunkSize, size - i * chunkSize));
+		};
+
+		// below a few hundred kB the handoff costs more than it saves
+		if (pool && pool->size() > 1 && size >= 256 * 1024)
+			pool->parallelFor(count, (std::max)((size_t)1, (64 * 1024) / chunkSize), run);
+		else
+			run(0, count);
+		return hashes;
+	}
+
+	struct Range
+	{
+		size_t offset;
+		size_t size;
+	};
+
+	// one hash per range, e.g. per section
+	static std::vector<uint64_t> ranges(const void* data, const std::vector<Range>& ranges, WorkPool* pool = nullptr)
+	{
+		const uint8_t* p = (const uint8_t*)data;
+		std::vector<uint64_t> hashes(ranges.size());
+		auto run = [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				hashes[i] = hash(p + ranges[i].offset, ranges[i].size);
+		};
+		if (pool && pool->size() > 1 && ranges.size() > 1)
+			pool->parallelFor(ranges.size(), 1, run);
+		else
+			run(0, ranges.size());
+		return hashes;
+	}
+
+	// a hash of the whole input computed from its chunk hashes, so it can be built in parallel
+	static uint64_t digest(const void* data, size_t size, WorkPool* pool = nullptr)
+	{
+		std::vector<uint64_t> hashes = chunks(data, size, block * 64, pool);
+		return hash(hashes.data(), hashes.size() * sizeof(uint64_t), size);
+	}
+};
@@ -1,151 +1,131 @@
 #pragma once
 #include "injectory/process.hpp"
 #include "injectory/exception.hpp"
+#include <iterator>
+#include <string_view>
 
-class Flag;
-
-namespace Flags
-{
-	unordered_map<string, Flag*> all;
-}
-
-
-
-class Flag
-{
-public:
-	const string name;
-	const string group;
-
-	Flag(string name, string group)
-		: name(name)
-		, group(group)
-	{
-		Flags::all[this->name] = this;
-	}
-
-	virtual void enable() const = 0;
-	virtual void disable() const = 0;
-};
-
-
-
-class LambdaFlag : public Flag
+struct Flag
 {
-public:
-	const function<void()> enableFunction;
-	const function<void()> disableFunction;
-
-	LambdaFlag(string name, string group, function<void()> enableFunction, function<void()> disableFunction)
-		: Flag(name, group)
-		, enableFunction(enableFunction)
-		, disableFunction(disableFunction)
-	{}
-
-	LambdaFlag(string name, string group, function<void(bool)> setFunction)
-		: LambdaFlag(name, group, std::bind(setFunction, true), std::bind(setFunction, false))
-	{}
+	enum Kind { Privilege, ErrorMode };
 
-	void enable() const override
-	{
-		enableFunction();
-	}
+	std::string_view name;
+	Kind kind;
+	UINT mode = 0; // SEM_* bits of error mode flags
 
-	void disable() const override
+	constexpr std::string_view group() const
 	{
-		disableFunction();
+		return kind == Privilege ? "privilege" : "error mode";
 	}
 };
 
 
 
-class PrivilegeFlag : public Flag
+namespace Flags
 {
-public:
-	PrivilegeFlag(string name)
-		: Flag(name, "privilege")
-	{}
-
-	void enable() const override
+	// sorted by name and searched by bisection, so there is nothing to build at startup
+	constexpr Flag all[] =
 	{
-		Process::current.enablePrivilege(to_wstring(name), true);
-	}
-
-	void disable() const override
+		{ "SEM_FAILCRITICALERRORS",				Flag::ErrorMode,	SEM_FAILCRITICALERRORS },
+		{ "SEM_NOALIGNMENTFAULTEXCEPT",			Flag::ErrorMode,	SEM_NOALIGNMENTFAULTEXCEPT },
+		{ "SEM_NOGPFAULTERRORBOX",				Flag::ErrorMode,	SEM_NOGPFAULTERRORBOX },
+		{ "SEM_NOOPENFILEERRORBOX",				Flag::ErrorMode,	SEM_NOOPENFILEERRORBOX },
+		{ "SeAssignPrimaryTokenPrivilege",		Flag::Privilege },
+		{ "SeAuditPrivilege",					Flag::Privilege },
+		{ "SeBackupPrivilege",					Flag::Privilege },
+		{ "SeChangeNotifyPrivilege",			Flag::Privilege },
+		{ "SeCreateGlobalPrivilege",			Flag::Privilege },
+		{ "SeCreatePagefilePrivilege",			Flag::Privilege },
+		{ "SeCreatePermanentPrivilege",			Flag::Privilege },
+		{ "SeCreateSymbolicLinkPrivilege",		Flag::Privilege },
+		{ "SeCreateTokenPrivilege",				Flag::Privilege },
+		{ "SeDebugPrivilege",					Flag::Privilege },
+		{ "SeEnableDelegationPrivilege",		Flag::Privilege },
+		{ "SeImpersonatePrivilege",				Flag::Privilege },
+		{ "SeIncreaseBasePriorityPrivilege",	Flag::Privilege },
+		{ "SeIncreaseQuotaPrivilege",			Flag::Privilege },
+		{ "SeIncreaseWorkingSetPrivilege",		Flag::Privilege },
+		{ "SeLoadDriverPrivilege",				Flag::Privilege },
+		{ "SeLockMemoryPrivilege",				Flag::Privilege },
+		{ "SeMachineAccountPrivilege",			Flag::Privilege },
+		{ "SeManageVolumePrivilege",			Flag::Privilege },
+		{ "SeProfileSingleProcessPrivilege",	Flag::Privilege },
+		{ "SeRelabelPrivilege",					Flag::Privilege },
+		{ "SeRemoteShutdownPrivilege",			Flag::Privilege },
+		{ "SeRestorePrivilege",					Flag::Privilege },
+		{ "SeSecurityPrivilege",				Flag::Privilege },
+		{ "SeShutdownPrivilege",				Flag::Privilege },
+		{ "SeSyncAgentPrivilege",				Flag::Privilege },
+		{ "SeSystemEnvironmentPrivilege",		Flag::Privilege },
+		{ "SeSystemProfilePrivilege",			Flag::Privilege },
+		{ "SeSystemtimePrivilege",				Flag::Privilege },
+		{ "SeTakeOwnershipPrivilege",			Flag::Privilege },
+		{ "SeTcbPrivilege",						Flag::Privilege },
+		{ "SeTimeZonePrivilege",				Flag::Privilege },
+		{ "SeTrustedCredManAccessPrivilege",	Flag::Privilege },
+		{ "SeUndockPrivilege",					Flag::Privilege },
+		{ "SeUnsolicitedInputPrivilege",		Flag::Privilege },
+	};
+
+	constexpr bool isSorted()
 	{
-		Process::current.enablePrivilege(to_wstring(name), false);
+		for (size_t i = 1; i < std::size(all); i++)
+		{
+			if (!(all[i - 1].name < all[i].name))
+				return false;
+		}
+		return true;
 	}
-};
-
-
-
-class ErrorModeFlag : public Flag
-{
-public:
-	const UINT mode;
-
-	ErrorModeFlag(string name, UINT mode)
-		: Flag(name, "error mode")
-		, mode(mode)
-	{}
+	static_assert(isSorted(), "Flags::all must be sorted by name");
 
-	void enable() const override
+	constexpr const Flag* find(std::string_view name)
 	{
-		UINT currentMode = SetErrorMode(mode);
-		SetErrorMode(currentMode | mode);
+		size_t lo = 0, hi = std::size(all);
+		while (lo < hi)
+		{
+			size_t mid = lo + (hi - lo) / 2;
+			if (all[mid].name < name)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo < std::size(all) && all[lo].name == name ? &all[lo] : nullptr;
 	}
+	static_assert(find("SeDebugPrivilege") && !find("SeDebug"), "Flags::find is broken");
 
-	void disable() const override
+	// sets and unsets the flags, with all privileges adjusted in a single call.
+	// nothing is changed if any of the names is unknown
+	inline void apply(const vector<string>& set, const vector<string>& unset)
 	{
-		UINT currentMode = SetErrorMode(0);
-		SetErrorMode(currentMode & ~mode);
+		vector<std::pair<const Flag*, bool>> flags;
+		for (const auto&[names, enable] : { std::make_pair(&set, true), std::make_pair(&unset, false) })
+		{
+			for (const string& name : *names)
+			{
+				const Flag* flag = find(name);
+				if (!flag)
+					BOOST_THROW_EXCEPTION(ex_injection() << e_text("unknown flag '" + name + "'"));
+				flags.push_back({ flag, enable });
+			}
+		}
+
+		vector<std::pair<wstring, bool>> privileges;
+		for (const auto&[flag, enable] : flags)
+		{
+			if (flag->kind == Flag::Privilege)
+				privileges.push_back({ to_wstring(string(flag->name)), enable });
+			else if (enable)
+			{
+				UINT currentMode = SetErrorMode(flag->mode);
+				SetErrorMode(currentMode | flag->mode);
+			}
+			else
+			{
+				UINT currentMode = SetErrorMode(0);
+				SetErrorMode(currentMode & ~flag->mode);
+			}
+		}
+
+		if (!privileges.empty())
+			Process::current.setPrivileges(privileges);
 	}
-};
-
-
-
-
-
-namespace Flags
-{
-	const PrivilegeFlag SeCreateTokenPrivilege			("SeCreateTokenPrivilege");
-	const PrivilegeFlag SeAssignPrimaryTokenPrivilege	("SeAssignPrimaryTokenPrivilege");
-	const PrivilegeFlag SeLockMemoryPrivilege			("SeLockMemoryPrivilege");
-	const PrivilegeFlag SeIncreaseQuotaPrivilege		("SeIncreaseQuotaPrivilege");
-	const PrivilegeFlag SeUnsolicitedInputPrivilege		("SeUnsolicitedInputPrivilege");
-	const PrivilegeFlag SeMachineAccountPrivilege		("SeMachineAccountPrivilege");
-	const PrivilegeFlag SeTcbPrivilege					("SeTcbPrivilege");
-	const PrivilegeFlag SeSecurityPrivilege				("SeSecurityPrivilege");
-	const PrivilegeFlag SeTakeOwnershipPrivilege		("SeTakeOwnershipPrivilege");
-	const PrivilegeFlag SeLoadDriverPrivilege			("SeLoadDriverPrivilege");
-	const PrivilegeFlag SeSystemProfilePrivilege		("SeSystemProfilePrivilege");
-	const PrivilegeFlag SeSystemtimePrivilege			("SeSystemtimePrivilege");
-	const PrivilegeFlag SeProfileSingleProcessPrivilege	("SeProfileSingleProcessPrivilege");
-	const PrivilegeFlag SeIncreaseBasePriorityPrivilege	("SeIncreaseBasePriorityPrivilege");
-	const PrivilegeFlag SeCreatePagefilePrivilege		("SeCreatePagefilePrivilege");
-	const PrivilegeFlag SeCreatePermanentPrivilege		("SeCreatePermanentPrivilege");
-	const PrivilegeFlag SeBackupPrivilege				("SeBackupPrivilege");
-	const PrivilegeFlag SeRestorePrivilege				("SeRestorePrivilege");
-	const PrivilegeFlag SeShutdownPrivilege				("SeShutdownPrivilege");
-	const PrivilegeFlag SeDebugPrivilege				("SeDebugPrivilege");
-	const PrivilegeFlag SeAuditPrivilege				("SeAuditPrivilege");
-	const PrivilegeFlag SeSystemEnvironmentPrivilege	("SeSystemEnvironmentPrivilege");
-	const PrivilegeFlag SeChangeNotifyPrivilege			("SeChangeNotifyPrivilege");
-	const PrivilegeFlag SeRemoteShutdownPrivilege		("SeRemoteShutdownPrivilege");
-	const PrivilegeFlag SeUndockPrivilege				("SeUndockPrivilege");
-	const PrivilegeFlag SeSyncAgentPrivilege			("SeSyncAgentPrivilege");
-	const PrivilegeFlag SeEnableDelegationPrivilege		("SeEnableDelegationPrivilege");
-	const PrivilegeFlag SeManageVolumePrivilege			("SeManageVolumePrivilege");
-	const PrivilegeFlag SeImpersonatePrivilege			("SeImpersonatePrivilege");
-	const PrivilegeFlag SeCreateGlobalPrivilege			("SeCreateGlobalPrivilege");
-	const PrivilegeFlag SeTrustedCredManAccessPrivilege	("SeTrustedCredManAccessPrivilege");
-	const PrivilegeFlag SeRelabelPrivilege				("SeRelabelPrivilege");
-	const PrivilegeFlag SeIncreaseWorkingSetPrivilege	("SeIncreaseWorkingSetPrivilege");
-	const PrivilegeFlag SeTimeZonePrivilege				("SeTimeZonePrivilege");
-	const PrivilegeFlag SeCreateSymbolicLinkPrivilege	("SeCreateSymbolicLinkPrivilege");
-
-	const ErrorModeFlag SEM_FAILCRITICALERRORS_		("SEM_FAILCRITICALERRORS",		SEM_FAILCRITICALERRORS);
-	const ErrorModeFlag SEM_NOALIGNMENTFAULTEXCEPT_	("SEM_NOALIGNMENTFAULTEXCEPT",	SEM_NOALIGNMENTFAULTEXCEPT);
-	const ErrorModeFlag SEM_NOGPFAULTERRORBOX_		("SEM_NOGPFAULTERRORBOX",		SEM_NOGPFAULTERRORBOX);
-	const ErrorModeFlag SEM_NOOPENFILEERRORBOX_		("SEM_NOOPENFILEERRORBOX",		SEM_NOOPENFILEERRORBOX);
 }
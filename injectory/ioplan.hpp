@@ -0,0 +1,122 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// one piece of a vectored remote read or write
+struct IoSpan
+{
+	uintptr_t remote;
+	void* local;
+	size_t size;
+};
+
+// plans a list of spans as few remote transfers as possible. reads are widened to whole
+// pages and merged across gaps up to maxGap, since reading a little more is cheaper than
+// another call. writes are only merged where spans touch or overlap, bytes in a gap
+// would be overwritten with whatever is in the buffer
+class IoPlan
+{
+public:
+	static constexpr uintptr_t pageSize = 0x1000;
+
+	struct Transfer
+	{
+		uintptr_t begin;
+		uintptr_t end;
+		std::vector<size_t> spans; // indices in the order they were passed
+
+		size_t size() const
+		{
+			return end - begin;
+		}
+	};
+
+private:
+	std::vector<IoSpan> spans_;
+	std::vector<Transfer> transfers_;
+
+public:
+	static IoPlan reads(const std::vector<IoSpan>& spans, uintptr_t maxGap = pageSize)
+	{
+		return IoPlan(spans, maxGap, true);
+	}
+
+	static IoPlan writes(const std::vector<IoSpan>& spans)
+	{
+		return IoPlan(spans, 0, false);
+	}
+
+	const std::vector<IoSpan>& spans() const
+	{
+		return spans_;
+	}
+
+	const std::vector<Transfer>& transfers() const
+	{
+		return transfers_;
+	}
+
+	// bytes moved by all transfers, at least the sum of the span sizes for reads
+	size_t bytes() const
+	{
+		size_t n = 0;
+		for (const Transfer& t : transfers_)
+			n += t.size();
+		return n;
+	}
+
+	// copies what was read for transfer i into the spans it covers
+	void scatter(size_t i, const uint8_t* buffer) const
+	{
+		const Transfer& t = transfers_[i];
+		for (size_t s : t.spans)
+			std::memcpy(spans_[s].local, buffer + (spans_[s].remote - t.begin), spans_[s].size);
+	}
+
+	// fills buffer with what transfer i writes, later spans win where they overlap
+	void gather(size_t i, uint8_t* buffer) const
+	{
+		const Transfer& t = transfers_[i];
+		for (size_t s : t.spans)
+			std::memcpy(buffer + (spans_[s].remote - t.begin), spans_[s].local, spans_[s].size);
+	}
+
+private:
+	IoPlan(const std::vector<IoSpan>& spans, uintptr_t maxGap, bool pageAlign)
+		: spans_(spans)
+	{
+		std::vector<size_t> order;
+		for (size_t i = 0; i < spans_.size(); i++)
+		{
+			if (spans_[i].size > 0)
+				order.push_back(i);
+		}
+		std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) { return spans_[a].remote < spans_[b].remote; });
+
+		for (size_t i : order)
+		{
+			uintptr_t begin = spans_[i].remote;
+			uintptr_t end = begin + spans_[i].size;
+			if (pageAlign)
+			{
+				begin &= ~(pageSize - 1);
+				end = (end + pageSize - 1) & ~(pageSize - 1);
+			}
+
+			if (!transfers_.empty() && begin <= transfers_.back().end + maxGap)
+			{
+				Transfer& last = transfers_.back();
+				last.end = (std::max)(last.end, end);
+				last.spans.push_back(i);
+			}
+			else
+				transfers_.push_back({ begin, end, { i } });
+		}
+
+		// keep the caller's order within a transfer so later writes win
+		for (Transfer& t : transfers_)
+			std::sort(t.spans.begin(), t.spans.end());
+	}
+};
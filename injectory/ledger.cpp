@@ -0,0 +1,85 @@
+#include "injectory/ledger.hpp"
+
+Ledger& Ledger::instance()
+{
+	static Ledger ledger;
+	return ledger;
+}
+
+Ledger::Id Ledger::record(pid_t pid, void* address, SIZE_T size, DWORD protect, const string& purpose, bool freeOnDestruction)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	vector<Entry>& list = entries_[pid];
+	list.push_back({ (uintptr_t)address, size, protect, purpose, freeOnDestruction, clock::now(), nullopt });
+	return { pid, list.size() - 1 };
+}
+
+void Ledger::released(const Id& id)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	entries_[id.first].at(id.second).freed = clock::now();
+}
+
+vector<pid_t> Ledger::pids() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	vector<pid_t> pids;
+	for (const auto&[pid, _] : entries_)
+		pids.push_back(pid);
+	return pids;
+}
+
+vector<Ledger::Entry> Ledger::entries(pid_t pid) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = entries_.find(pid);
+	return it == entries_.end() ? vector<Entry>() : it->second;
+}
+
+Ledger::Summary Ledger::summary(pid_t pid) const
+{
+	Summary s;
+	for (const Entry& e : entries(pid))
+	{
+		s.allocations++;
+		s.allocated += e.committed();
+		if (!e.freed)
+		{
+			s.live++;
+			s.leftBehind += e.committed();
+		}
+	}
+	return s;
+}
+
+string Ledger::json() const
+{
+	auto millis = [this](clock::time_point t)
+	{
+		return (format("%.3f") % std::chrono::duration<double, std::milli>(t - started).count()).str();
+	};
+
+	string out = "{\"processes\":[";
+	bool firstProcess = true;
+	for (pid_t pid : pids())
+	{
+		Summary s = summary(pid);
+		out += (firstProcess ? "" : ",");
+		out += (format("{\"pid\":%d,\"allocations\":%d,\"live\":%d,\"allocated\":%d,\"leftBehind\":%d,\"entries\":[")
+			% pid % s.allocations % s.live % s.allocated % s.leftBehind).str();
+		firstProcess = false;
+
+		bool firstEntry = true;
+		for (const Entry& e : entries(pid))
+		{
+			out += (firstEntry ? "" : ",");
+			out += (format("{\"address\":\"0x%x\",\"size\":%d,\"committed\":%d,\"protect\":\"0x%x\",\"purpose\":%s,\"freeOnDestruction\":%s,\"allocated\":%s,\"freed\":%s}")
+				% e.address % e.size % e.committed() % e.protect % jsonString(e.purpose)
+				% (e.freeOnDestruction ? "true" : "false") % millis(e.allocated)
+				% (e.freed ? millis(*e.freed) : string("null"))).str();
+			firstEntry = false;
+		}
+		out += "]}";
+	}
+	return out + "]}";
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "injectory/common.hpp"
+#include <chrono>
+#include <mutex>
+
+// every remote allocation injectory makes, per target process, so that what is left
+// committed in a target after a run can be reported and checked
+class Ledger
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+	struct Entry
+	{
+		uintptr_t address;
+		SIZE_T size;
+		DWORD protect;
+		string purpose;
+		bool freeOnDestruction;
+		clock::time_point allocated;
+		optional<clock::time_point> freed;
+
+		// whole pages, that is what the allocation takes in the target
+		SIZE_T committed() const
+		{
+			const SIZE_T pageSize = 0x1000;
+			return (size + pageSize - 1) & ~(pageSize - 1);
+		}
+	};
+
+	struct Summary
+	{
+		size_t allocations = 0;
+		size_t live = 0;
+		SIZE_T allocated = 0;	// committed bytes of all allocations
+		SIZE_T leftBehind = 0;	// committed bytes not freed
+	};
+
+	using Id = std::pair<pid_t, size_t>;
+
+private:
+	mutable std::mutex mutex;
+	map<pid_t, vector<Entry>> entries_;
+	const clock::time_point started = clock::now();
+
+public:
+	Id record(pid_t pid, void* address, SIZE_T size, DWORD protect, const string& purpose, bool freeOnDestruction);
+	void released(const Id& id);
+
+	vector<pid_t> pids() const;
+	vector<Entry> entries(pid_t pid) const;
+	Summary summary(pid_t pid) const;
+
+	// all processes and their allocations, times in ms since injectory started
+	string json() const;
+
+	static Ledger& instance();
+};
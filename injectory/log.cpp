@@ -0,0 +1,266 @@
+#include "injectory/log.hpp"
+#include <algorithm>
+#include <chrono>
+#include <codecvt>
+#include <cstdio>
+#include <iostream>
+#include <locale>
+
+Log& Log::instance()
+{
+	static Log log;
+	return log;
+}
+
+Log::Log()
+	: thread(&Log::sink, this)
+{}
+
+Log::~Log()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_one();
+	thread.join();
+}
+
+Log::Ring& Log::ring()
+{
+	// the sink shares the ring, so what a thread logged just before it exited is still written
+	struct Owner
+	{
+		std::shared_ptr<Ring> ring;
+		~Owner()
+		{
+			if (ring)
+				ring->closed = true;
+		}
+	};
+	thread_local Owner owner;
+
+	if (!owner.ring)
+	{
+		owner.ring = std::make_shared<Ring>(1024);
+		std::lock_guard<std::mutex> lock(mutex);
+		rings.push_back(owner.ring);
+	}
+	return *owner.ring;
+}
+
+void Log::push(Level level, bool error, std::string&& message, std::initializer_list<Field> fields)
+{
+	Record record;
+	record.level = level;
+	record.error = error;
+	record.seq = seq.fetch_add(1, std::memory_order_relaxed);
+	record.message = std::move(message);
+	record.fields.assign(fields.begin(), fields.end());
+
+	Ring& r = ring();
+	while (!r.push(record))
+	{
+		// full, the sink drains rings even while output is held, so this only waits for the console
+		wake.notify_one();
+		std::this_thread::yield();
+	}
+	if (idle.exchange(false))
+		wake.notify_one();
+}
+
+std::string Log::text(const Record& record)
+{
+	std::string s = record.message;
+	char buf[64];
+	for (const Field& field : record.fields)
+	{
+		if (!s.empty())
+			s += ' ';
+		s += field.key;
+		s += '=';
+		std::visit([&](const auto& v)
+		{
+			using T = std::decay_t<decltype(v)>;
+			if constexpr (std::is_same_v<T, bool>)
+				s += v ? "true" : "false";
+			else if constexpr (std::is_same_v<T, long long>)
+				s += std::to_string(v);
+			else if constexpr (std::is_same_v<T, unsigned long long>)
+				s += std::to_string(v);
+			else if constexpr (std::is_same_v<T, double>)
+			{
+				std::snprintf(buf, sizeof(buf), "%.2f", v);
+				s += buf;
+			}
+			else if constexpr (std::is_same_v<T, const void*>)
+			{
+				std::snprintf(buf, sizeof(buf), "0x%0*llx", (int)(2 * sizeof(void*)), (unsigned long long)(uintptr_t)v);
+				s += buf;
+			}
+			else
+			{
+				std::string str;
+				if constexpr (std::is_same_v<T, std::wstring>)
+				{
+					// not the converter of to_string, that one belongs to the other threads
+					static std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+					str = converter.to_bytes(v);
+				}
+				else
+					str = v;
+
+				// quoted only when it wouldn't read back as one value
+				if (str.empty() || str.find_first_of(" \t\"=") != std::string::npos)
+				{
+					s += '"';
+					for (char c : str)
+					{
+						if (c == '"' || c == '\\')
+							s += '\\';
+						s += c;
+					}
+					s += '"';
+				}
+				else
+					s += str;
+			}
+		}, field.value);
+	}
+	return s;
+}
+
+void Log::sink()
+{
+	std::vector<Record> backlog;
+	std::vector<std::shared_ptr<Ring>> all;
+	size_t waiting = 0;	// lines in the backlog that were held back
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;)
+	{
+		const uint64_t flushing = flushRequested;
+		const bool stop = stopping;
+		const bool force = stop || flushing > flushed;
+		all = rings;
+		lock.unlock();
+
+		bool drained = true;
+		for (const std::shared_ptr<Ring>& r : all)
+		{
+			Record record;
+			while (r->pop(record))
+				backlog.push_back(std::move(record));
+			drained = drained && r->empty();
+		}
+
+		{
+			std::lock_guard<std::mutex> hold(console);
+			if (!backlog.empty() && !suspended_.empty() && !force)
+				waiting = backlog.size();
+			else if (!backlog.empty())
+			{
+				// the rings are per thread, the sequence number puts the lines of all threads back in order
+				std::stable_sort(backlog.begin(), backlog.end(), [](const Record& a, const Record& b) { return a.seq < b.seq; });
+				std::string out, err;
+				for (const Record& record : backlog)
+				{
+					std::string& to = record.error ? err : out;
+					to += text(record);
+					if (to.empty() || to.back() != '\n')
+						to += '\n';
+				}
+				if (!out.empty())
+				{
+					std::cout.write(out.data(), out.size());
+					std::cout.flush();
+				}
+				if (!err.empty())
+				{
+					std::cerr.write(err.data(), err.size());
+					std::cerr.flush();
+				}
+				written.fetch_add(backlog.size(), std::memory_order_relaxed);
+				held.fetch_add(waiting, std::memory_order_relaxed);
+				waiting = 0;
+				batches.fetch_add(1, std::memory_order_relaxed);
+				backlog.clear();
+			}
+		}
+
+		lock.lock();
+		// rings of exited threads are dropped once they are empty
+		rings.erase(std::remove_if(rings.begin(), rings.end(), [](const std::shared_ptr<Ring>& r)
+		{
+			return r->closed && r->empty();
+		}), rings.end());
+
+		if (flushing > flushed && drained)
+		{
+			flushed = flushing;
+			flushedCv.notify_all();
+		}
+		if (stop && drained && backlog.empty())
+			return;
+		if (!drained || flushRequested > flushed || stopping)
+			continue;
+
+		// producers only notify when the sink said it is going to sleep, the timeout covers the race
+		idle = true;
+		wake.wait_for(lock, std::chrono::milliseconds(50));
+		idle = false;
+	}
+}
+
+void Log::suspended(uint64_t pid)
+{
+	Log& log = instance();
+	std::lock_guard<std::mutex> lock(log.console);
+	log.suspended_[pid]++;
+}
+
+void Log::resumed(uint64_t pid)
+{
+	Log& log = instance();
+	{
+		std::lock_guard<std::mutex> lock(log.console);
+		auto it = log.suspended_.find(pid);
+		if (it == log.suspended_.end())
+			return;
+		if (--it->second > 0)
+			return;
+		log.suspended_.erase(it);
+	}
+	log.wake.notify_one();
+}
+
+void Log::forget(uint64_t pid)
+{
+	Log& log = instance();
+	{
+		std::lock_guard<std::mutex> lock(log.console);
+		if (log.suspended_.erase(pid) == 0)
+			return;
+	}
+	log.wake.notify_one();
+}
+
+void Log::flush()
+{
+	Log& log = instance();
+	std::unique_lock<std::mutex> lock(log.mutex);
+	const uint64_t ticket = ++log.flushRequested;
+	log.wake.notify_one();
+	log.flushedCv.wait(lock, [&] { return log.flushed >= ticket; });
+}
+
+Log::Stats Log::stats()
+{
+	Log& log = instance();
+	return
+	{
+		log.written.load(std::memory_order_relaxed),
+		log.dropped.load(std::memory_order_relaxed),
+		log.held.load(std::memory_order_relaxed),
+		log.batches.load(std::memory_order_relaxed),
+	};
+}
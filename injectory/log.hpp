@@ -0,0 +1,258 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// console output of all threads. a line is a message and fields that are pushed as raw values to a
+// ring of the calling thread without locking, a sink thread turns them into text and writes them in
+// batches. lines of a filtered out level are dropped before anything is copied. while a target is
+// suspended nothing is written, lines pile up and go out once the last suspended target is resumed
+class Log
+{
+public:
+	enum Level
+	{
+		Always,	// results like --print-pid, printed at any verbosity
+		Info,	// -v
+		Debug,	// -v2
+		Trace,	// -v3
+	};
+
+	using Value = std::variant<bool, long long, unsigned long long, double, const void*, std::string, std::wstring>;
+
+	// key=value, the value is only turned into text on the sink thread
+	struct Field
+	{
+		const char* key;
+		Value value;
+
+		template <typename T>
+		Field(const char* key, const T& v)
+			: key(key)
+			, value(convert(v))
+		{}
+
+	private:
+		template <typename T>
+		static Value convert(const T& v)
+		{
+			if constexpr (std::is_same_v<T, bool>)
+				return v;
+			else if constexpr (std::is_enum_v<T>)
+				return (long long)v;
+			else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+				return (long long)v;
+			else if constexpr (std::is_integral_v<T>)
+				return (unsigned long long)v;
+			else if constexpr (std::is_floating_point_v<T>)
+				return (double)v;
+			else if constexpr (std::is_convertible_v<T, std::string>)
+				return std::string(v);
+			else if constexpr (std::is_convertible_v<T, std::wstring>)
+				return std::wstring(v);
+			else
+				return (const void*)v;
+		}
+	};
+
+	struct Stats
+	{
+		size_t written;
+		size_t dropped;		// filtered out before formatting
+		size_t held;		// written late because a target was suspended
+		size_t batches;
+	};
+
+private:
+	struct Record
+	{
+		Level level = Always;
+		bool error = false;		// to stderr
+		uint64_t seq = 0;
+		std::string message;
+		std::vector<Field> fields;
+	};
+
+	// single producer, the owning thread, single consumer, the sink
+	class Ring
+	{
+	private:
+		std::vector<Record> slots;
+		std::atomic<size_t> head = 0;
+		std::atomic<size_t> tail = 0;
+
+	public:
+		std::atomic<bool> closed = false;	// the owning thread exited
+
+		explicit Ring(size_t capacity)
+			: slots(capacity)
+		{}
+
+		bool push(Record& record)
+		{
+			const size_t t = tail.load(std::memory_order_relaxed);
+			if (t - head.load(std::memory_order_acquire) == slots.size())
+				return false;
+			slots[t % slots.size()] = std::move(record);
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool pop(Record& record)
+		{
+			const size_t h = head.load(std::memory_order_relaxed);
+			if (h == tail.load(std::memory_order_acquire))
+				return false;
+			record = std::move(slots[h % slots.size()]);
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool empty() const
+		{
+			return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+		}
+	};
+
+	static inline std::atomic<int> threshold = Always;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable flushedCv;
+	std::vector<std::shared_ptr<Ring>> rings;
+	uint64_t flushRequested = 0;
+	uint64_t flushed = 0;
+	bool stopping = false;
+	std::atomic<bool> idle = false;
+	std::atomic<uint64_t> seq = 0;
+
+	// taken by the sink for a batch and to suspend a target, so no batch is half way out while one stops
+	std::mutex console;
+	std::map<uint64_t, int> suspended_;	// pid -> nested suspensions
+
+	std::atomic<size_t> written = 0;
+	std::atomic<size_t> dropped = 0;
+	std::atomic<size_t> held = 0;
+	std::atomic<size_t> batches = 0;
+
+	std::thread thread;
+
+	Log();
+	~Log();
+
+	Ring& ring();
+	void push(Level level, bool error, std::string&& message, std::initializer_list<Field> fields);
+	void sink();
+	static std::string text(const Record& record);
+
+public:
+	static bool enabled(Level level)
+	{
+		return level <= threshold.load(std::memory_order_relaxed);
+	}
+
+	// the verbosity, 0 for Always only
+	static void setLevel(int level)
+	{
+		threshold.store(level, std::memory_order_relaxed);
+	}
+
+	static void write(Level level, std::string message, std::initializer_list<Field> fields = {})
+	{
+		if (enabled(level))
+			instance().push(level, false, std::move(message), fields);
+		else
+			instance().dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// what a lazy write hands its callable, to be called with the message and fields
+	class Line
+	{
+	private:
+		friend class Log;
+		Level level;
+
+		explicit Line(Level level)
+			: level(level)
+		{}
+
+	public:
+		void operator()(std::string message, std::initializer_list<Field> fields = {}) const
+		{
+			instance().push(level, false, std::move(message), fields);
+		}
+	};
+
+	// make is only called if the level is logged, so nothing of the message or its fields is
+	// built otherwise, e.g. Log::info([&](auto log) { log("mapped", { { "dll", path.filename().wstring() } }); });
+	template <typename Make, typename = std::enable_if_t<std::is_invocable_v<Make, const Line&>>>
+	static void write(Level level, Make&& make)
+	{
+		if (enabled(level))
+			make(Line(level));
+		else
+			instance().dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	static void out(std::string message, std::initializer_list<Field> fields = {})
+	{
+		write(Always, std::move(message), fields);
+	}
+	static void info(std::string message, std::initializer_list<Field> fields = {})
+	{
+		write(Info, std::move(message), fields);
+	}
+	template <typename Make, typename = std::enable_if_t<std::is_invocable_v<Make, const Line&>>>
+	static void info(Make&& make)
+	{
+		write(Info, std::forward<Make>(make));
+	}
+	static void debug(std::string message, std::initializer_list<Field> fields = {})
+	{
+		write(Debug, std::move(message), fields);
+	}
+	template <typename Make, typename = std::enable_if_t<std::is_invocable_v<Make, const Line&>>>
+	static void debug(Make&& make)
+	{
+		write(Debug, std::forward<Make>(make));
+	}
+	static void trace(std::string message, std::initializer_list<Field> fields = {})
+	{
+		write(Trace, std::move(message), fields);
+	}
+	template <typename Make, typename = std::enable_if_t<std::is_invocable_v<Make, const Line&>>>
+	static void trace(Make&& make)
+	{
+		write(Trace, std::forward<Make>(make));
+	}
+
+	// to stderr, in order with everything else
+	static void error(std::string message)
+	{
+		instance().push(Always, true, std::move(message), {});
+	}
+
+	// Process::suspend and resume, nested like the suspend counts of the threads
+	static void suspended(uint64_t pid);
+	static void resumed(uint64_t pid);
+	// a target that is abandoned, e.g. after a failed step, holds nothing back anymore
+	static void forget(uint64_t pid);
+
+	// waits until every line logged so far is written, suspended targets or not.
+	// for when the run is over, before writing to the console directly
+	static void flush();
+
+	static Stats stats();
+
+	static Log& instance();
+};
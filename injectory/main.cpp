@@ -6,11 +6,28 @@
 #include "injectory/job.hpp"
 #include "injectory/flags.hpp"
 #include "injectory/environment.hpp"
+#include "injectory/trigger.hpp"
+#include "injectory/pipeline.hpp"
+#include "injectory/peimage.hpp"
+#include "injectory/workpool.hpp"
+#include "injectory/waitgroup.hpp"
+#include "injectory/ledger.hpp"
+#include "injectory/plan.hpp"
+#include "injectory/reload.hpp"
+#include "injectory/log.hpp"
+#include "injectory/metrics.hpp"
+#include "injectory/selector.hpp"
 
 #include <boost/algorithm/string.hpp>
 namespace algo = boost::algorithm;
 #include <boost/program_options.hpp>
 namespace po = boost::program_options;
+#include <boost/filesystem/fstream.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #define VERSION "6.1.0"
 
@@ -29,16 +46,933 @@ namespace boost { namespace program_options
 	}
 }}
 
+// every payload checked on the pool while the target is still being found or launched, and the
+// --map payloads parsed and laid out there, once per file no matter how many targets they go into.
+// preflight() waits for the checks, so a bad payload fails the run before any target is suspended
+class Payloads
+{
+private:
+	struct Prepared
+	{
+		std::shared_future<shared_ptr<const PeImage>> image;
+		mutable std::atomic<bool> used = false;
+	};
+
+	// what the check of one payload found, errors are thrown from the future instead
+	struct Checked
+	{
+		optional<Library> library;
+		string warning;
+	};
+
+	WorkPool& pool;
+	std::map<wstring, Prepared> images;
+	vector<std::pair<wstring, std::shared_future<Checked>>> checks; // in the order they were submitted
+	std::map<wstring, std::shared_future<Checked>> checked;
+
+	// the loader of a launched target looks in its directory, that of any other target is not known
+	// until it is found, so dependencies missing elsewhere may still be there and are only a warning
+	static string dependencies(const PeImage& image, const vector<fs::path>& dirs, bool allDirsKnown)
+	{
+		vector<string> missing = image.missingDependencies(dirs);
+		if (missing.empty())
+			return "";
+		string text = "dependencies not found: " + algo::join(missing, ", ");
+		if (allDirsKnown)
+			BOOST_THROW_EXCEPTION(ex_file_not_found() << e_text(text) << e_library(image.path()));
+		return text + ", unless the target has them in its directory";
+	}
+
+	void check(const wstring& path, function<Checked()> work)
+	{
+		if (checked.count(path))
+			return;
+		checked[path] = pool.submit(std::move(work)).share();
+		checks.push_back({ path, checked[path] });
+	}
+
+public:
+	Payloads(const po::variables_map& vars, WorkPool& pool)
+		: pool(pool)
+	{
+		optional<fs::path> launchDir;
+		if (vars.count("launch"))
+			launchDir = fs::absolute(vars["launch"].as<wstring>()).parent_path();
+		auto searchDirs = [launchDir](const fs::path& payload)
+		{
+			vector<fs::path> dirs = { fs::absolute(payload).parent_path() };
+			if (launchDir)
+				dirs.push_back(*launchDir);
+			return dirs;
+		};
+		const bool allDirsKnown = launchDir.has_value();
+
+		// the image that is mapped later is the one the check parsed
+		for (const char* option : { "map", "mapw", "reload" })
+		{
+			for (const wstring& path : vars[option].as<vector<wstring>>())
+			{
+				if (images.count(path))
+					continue;
+				auto parsed = std::make_shared<std::promise<shared_ptr<const PeImage>>>();
+				images[path].image = parsed->get_future().share();
+				check(path, [=]
+				{
+					shared_ptr<const PeImage> image;
+					try
+					{
+						image = std::make_shared<const PeImage>(PeImage::load(path));
+					}
+					catch (...)
+					{
+						parsed->set_exception(std::current_exception());
+						throw;
+					}
+					parsed->set_value(image);
+					return Checked{ Library(path), dependencies(*image, searchDirs(path), allDirsKnown) };
+				});
+			}
+		}
+
+		// LoadLibrary does the mapping of these in the target, the image is only read for the checks
+		// and may import by ordinal, which only the mapper can't do
+		for (const char* option : { "inject", "injectw" })
+		{
+			for (const wstring& path : vars[option].as<vector<wstring>>())
+			{
+				check(path, [=]
+				{
+					Library lib(path);
+					PeImage image = PeImage::load(path, true);
+					return Checked{ lib, dependencies(image, searchDirs(path), allDirsKnown) };
+				});
+			}
+		}
+		for (const char* option : { "eject", "ejectw" })
+		{
+			for (const wstring& path : vars[option].as<vector<wstring>>())
+				check(path, [path] { return Checked{ Library(path), "" }; });
+		}
+	}
+
+	// waits for every check, reports all that failed and fails the run if any did
+	void preflight() const
+	{
+		size_t failed = 0;
+		for (const auto&[path, result] : checks)
+		{
+			try
+			{
+				const Checked& checked = result.get();
+				if (!checked.warning.empty())
+					Log::error("injectory: warning: " + to_string(path) + ": " + checked.warning);
+			}
+			catch (...)
+			{
+				failed++;
+				Log::error(exception_text(std::current_exception(), "injectory: " + to_string(path)));
+			}
+		}
+		if (failed > 0)
+			BOOST_THROW_EXCEPTION(ex_injection() << e_text((format("%d of %d payloads failed the checks, no target was touched") % failed % checks.size()).str()));
+	}
+
+	const Library& library(const wstring& path) const
+	{
+		return *checked.at(path).get().library;
+	}
+
+	vector<Library> libraries(const vector<wstring>& paths) const
+	{
+		vector<Library> libs;
+		for (const wstring& path : paths)
+			libs.push_back(library(path));
+		return libs;
+	}
+
+	const PeImage& image(const wstring& path) const
+	{
+		const Prepared& prepared = images.at(path);
+		Metrics::add(prepared.used.exchange(true) ? Metrics::PayloadHit : Metrics::PayloadMiss);
+		return *prepared.image.get();
+	}
+
+	Module map(Process& proc, const wstring& path, ImportStats* imports = nullptr) const
+	{
+		return proc.mapRemoteModule(image(path), &pool, imports);
+	}
+
+	Reload reload(Process& proc, const wstring& path, MappedImages& images) const
+	{
+		return proc.reloadRemoteModule(image(path), images, &pool);
+	}
+
+	size_t threads() const
+	{
+		return pool.size();
+	}
+};
+
+// state of one target while its steps run on the pipeline
+struct Target
+{
+	using clock = Pipeline::clock;
+
+	Process proc;
+	Job job;
+	int verbose = 0;
+	bool anyInjections = false;
+
+	// new modules and allocations can only show up in free ranges,
+	// so those and the ejected modules are all that needs to be re-queried afterwards
+	RegionMap regions;
+	vector<RegionMap::Range> changed;
+
+	vector<Module> injectedModules;
+	RemoteCall call;
+	Triggers triggers;
+	clock::time_point waitStart;
+	int rounds = 0;
+	WinHandle timer;	// for the polling steps, set again for every round
+	optional<SIZE_T> maxLeftBehind;
+	bool suspended = true;	// handed over suspended, until the step that resumes it
+
+	~Target()
+	{
+		// failed targets were resumed by onFailure, their output isn't held back anymore either way
+		Log::forget(proc.id());
+		Metrics::forget(proc.id());
+	}
+
+	DWORD elapsedMillis() const
+	{
+		return (DWORD)std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - waitStart).count();
+	}
+
+	void ejectAll(const vector<Library>& libs)
+	{
+		if (libs.empty())
+			return;
+
+		vector<Module> modules = proc.getInjected(libs);
+		if (verbose >= 2)
+		{
+			for (Module& module : modules)
+			{
+				uintptr_t base = (uintptr_t)module.handle();
+				changed.push_back({ base, base + module.ntHeader().OptionalHeader.SizeOfImage });
+			}
+		}
+
+		vector<bool> freed = proc.eject(modules);
+		for (size_t i = 0; i < libs.size(); i++)
+		{
+			Log::info([&](auto log) { log("ejected", { { "dll", libs[i].path().filename().wstring() }, { "base", modules[i].handle() }, { "ok", (bool)freed[i] } }); });
+			if (freed[i])
+				Metrics::add(Metrics::Ejected);
+			if (!freed[i])
+				BOOST_THROW_EXCEPTION(ex_injection() << e_text("FreeLibrary failed in remote process") << e_library(libs[i].path()) << e_process(proc));
+		}
+	}
+
+	// what was allocated in the target and how much of it stays committed after the run
+	void checkLedger()
+	{
+		Ledger::Summary summary = Ledger::instance().summary(proc.id());
+		if (summary.allocations > 0)
+		{
+			Log::info([&](auto log)
+			{
+				log("remote memory", { { "allocations", summary.allocations }, { "committed", summary.allocated },
+					{ "leftBehind", summary.leftBehind }, { "live", summary.live } });
+			});
+			if (Log::enabled(Log::Debug))
+			{
+				for (const Ledger::Entry& e : Ledger::instance().entries(proc.id()))
+				{
+					if (!e.freed)
+						Log::debug("left behind", { { "address", (void*)e.address }, { "committed", e.committed() }, { "protect", e.protect }, { "purpose", e.purpose } });
+				}
+			}
+		}
+
+		if (maxLeftBehind && summary.leftBehind > *maxLeftBehind)
+			BOOST_THROW_EXCEPTION(ex_injection() << e_text((format("%.1f kB left committed in target, more than --max-left-behind allows") % (summary.leftBehind / 1024.0)).str()) << e_process(proc));
+	}
+
+	void printSummary()
+	{
+		RemoteThreadTimes::Totals threads = RemoteThreadTimes::instance().totals(proc.id());
+		if (Log::enabled(Log::Info) && threads.threads > 0)
+		{
+			Log::info("remote threads", { { "count", threads.threads }, { "policy", Process::remoteThreadPolicy.describe() },
+				{ "wallMs", threads.wallMillis }, { "longestMs", threads.maxWallMillis }, { "cpuMs", threads.cpuMillis } });
+		}
+
+		if (Log::enabled(Log::Info))
+		{
+			// the headers are read from the target, only for the lines that are written
+			for (Module& module : injectedModules)
+			{
+				IMAGE_NT_HEADERS nt_header = module.ntHeader();
+				Log::info("injected", {
+					{ "dll", module.path().filename().wstring() },
+					{ "base", module.handle() },
+					{ "entry", (void*)((DWORD_PTR)module.handle() + nt_header.OptionalHeader.AddressOfEntryPoint) },
+					{ "size", nt_header.OptionalHeader.SizeOfImage },
+					{ "checksum", nt_header.OptionalHeader.CheckSum } });
+			}
+		}
+
+		if (verbose >= 2 && anyInjections)
+		{
+			RegionMap::Diff diff = proc.refresh(regions, changed);
+			Log::debug("address space", { { "added", diff.added.size() }, { "removed", diff.removed.size() }, { "queries", diff.queries } });
+			for (uintptr_t base : diff.addedModules)
+			{
+				// straight from the mapping, a lookup through the modules would scan the address space again
+				WCHAR file[MAX_PATH + 1] = { 0 };
+				GetMappedFileNameW(proc.handle(), (void*)base, file, MAX_PATH);
+				Log::debug("module added", { { "base", (void*)base }, { "file", wstring(file) } });
+			}
+			for (uintptr_t base : diff.removedModules)
+				Log::debug("module removed", { { "base", (void*)base } });
+		}
+	}
+};
+
+// the --when-* conditions
+Triggers triggers(const po::variables_map& vars)
+{
+	Triggers triggers;
+	for (const fs::path& lib : vars["when-module"].as<vector<wstring>>())
+		triggers.add(ModuleTrigger(lib));
+	if (vars.count("when-threads"))
+		triggers.add(ThreadCountTrigger(vars["when-threads"].as<unsigned>()));
+	for (const wstring& spec : vars["when-export"].as<vector<wstring>>())
+		triggers.add(ExportTrigger::parse(spec));
+	return triggers;
+}
+
+// everything done to a target after it has been opened and suspended, as steps that hand
+// the waits for remote threads, triggers and input idle to the pipeline instead of blocking
+shared_ptr<Pipeline::Task> targetTask(const Process& proc, const po::variables_map& vars, const Job& job, const Payloads& payloads)
+{
+	using Await = Pipeline::Await;
+
+	auto& inject = vars["inject"].as<vector<wstring>>();
+	auto& map = vars["map"].as<vector<wstring>>();
+	auto& eject = vars["eject"].as<vector<wstring>>();
+	auto& injectw = vars["injectw"].as<vector<wstring>>();
+	auto& mapw = vars["mapw"].as<vector<wstring>>();
+	auto& ejectw = vars["ejectw"].as<vector<wstring>>();
+	auto& reload = vars["reload"].as<vector<wstring>>();
+
+	auto t = std::make_shared<Target>();
+	t->proc = proc;
+	t->job = job;
+	t->verbose = vars["verbose"].as<int>();
+	if (vars.count("max-left-behind"))
+		t->maxLeftBehind = (SIZE_T)vars["max-left-behind"].as<unsigned>() * 1024;
+	t->anyInjections = !(inject.empty() && map.empty() && eject.empty() && injectw.empty() && mapw.empty() && ejectw.empty() && reload.empty());
+
+	t->triggers = triggers(vars);
+
+	auto task = std::make_shared<Pipeline::Task>();
+
+	// a failed step must not leave the target frozen, in --watch and --select it is a live process
+	// that injectory goes on without
+	task->onFailure([t]
+	{
+		t->call.abandon();
+		if (!t->suspended)
+			return;
+		t->suspended = false;
+		try
+		{
+			t->proc.resume();
+		}
+		catch (...)
+		{
+			Log::error(exception_text(std::current_exception(), (format("injectory: (%d) could not resume after a failed step") % t->proc.id()).str()));
+		}
+	});
+
+	task->thenDo([t]
+	{
+		if (t->anyInjections && (t->proc.is64bit() != is64bit))
+			BOOST_THROW_EXCEPTION(ex_target_bit_mismatch() << e_process(t->proc));
+
+		if (t->job)
+			t->job.assignProcess(t->proc);
+
+		if (t->verbose >= 2 && t->anyInjections)
+		{
+			t->regions = t->proc.regions();
+			t->changed = t->regions.freeRanges();
+		}
+	});
+
+	// LoadLibrary runs in a remote thread, the task is parked until it exits
+	auto injectAll = [&](const vector<wstring>& paths)
+	{
+		for (const wstring& path : paths)
+		{
+			const Library lib = payloads.library(path);
+			task->then([t, lib]
+			{
+				if (t->proc.isInjected(lib))
+					BOOST_THROW_EXCEPTION(ex_injection() << e_text("library already in process") << e_library(lib.path()) << e_process(t->proc));
+				t->call = t->proc.startInject(lib);
+				return Await::on(t->call.thread);
+			});
+			task->thenDo([t, lib]
+			{
+				t->call.result();
+				t->call = RemoteCall();
+				t->injectedModules.push_back(t->proc.getInjected(lib));
+				Metrics::add(Metrics::Injected);
+			});
+		}
+	};
+	auto mapAll = [&](const vector<wstring>& paths)
+	{
+		for (const wstring& lib : paths)
+		{
+			task->thenDo([t, lib, &payloads]
+			{
+				ImportStats imports;
+				t->injectedModules.push_back(payloads.map(t->proc, lib, &imports));
+				Metrics::add(Metrics::Mapped);
+				Log::info([&](auto log) { log("mapped", { { "dll", fs::path(lib).filename().wstring() }, { "bound", imports.bound }, { "resolved", imports.resolved } }); });
+			});
+		}
+	};
+
+	injectAll(inject);
+	mapAll(map);
+	if (!reload.empty())
+	{
+		task->thenDo([t, reload, &payloads]
+		{
+			MappedImages images = MappedImages::of(t->proc);
+			for (const wstring& lib : reload)
+			{
+				Reload r = payloads.reload(t->proc, lib, images);
+				Log::out(r.inPlace ? "reloaded" : "mapped", {
+					{ "dll", fs::path(lib).filename().wstring() }, { "base", r.module.handle() },
+					{ "pages", r.pages }, { "pagesWritten", r.pagesWritten },
+					{ "bound", r.imports.bound }, { "resolved", r.imports.resolved },
+					{ "ms", std::chrono::duration<double, std::milli>(r.latency).count() } });
+				t->injectedModules.push_back(r.module);
+				Metrics::add(Metrics::Reloaded);
+			}
+		});
+	}
+	if (!eject.empty())
+		task->thenDo([t, libs = payloads.libraries(eject)] { t->ejectAll(libs); });
+
+	task->thenDo([t]
+	{
+		t->proc.resume();
+		t->suspended = false;
+		t->waitStart = Target::clock::now();
+	});
+
+	if (!t->triggers.empty())
+	{
+		const DWORD interval = vars["poll-interval"].as<unsigned>();
+		const DWORD timeout = vars.count("trigger-timeout") ? vars["trigger-timeout"].as<unsigned>() : INFINITE;
+		if (Log::enabled(Log::Info))
+			task->thenDo([t] { Log::info("waiting", { { "for", t->triggers.describe() } }); });
+		task->then([t, interval, timeout]
+		{
+			if (t->triggers.check(t->proc, t->elapsedMillis(), timeout))
+				return Await::next();
+			return Await::retryAfter(Pipeline::timer(t->timer, interval));
+		});
+	}
+	else if (!injectw.empty() || !mapw.empty() || !ejectw.empty())
+	{
+		task->then([t]
+		{
+			if (t->proc.isInputIdle())
+				return Await::next();
+			if (t->elapsedMillis() >= 5000)
+				BOOST_THROW_EXCEPTION(ex_wait_for_input_idle() << e_process(t->proc));
+			return Await::retryAfter(Pipeline::timer(t->timer, 10));
+		});
+	}
+
+	injectAll(injectw);
+	mapAll(mapw);
+	if (!ejectw.empty())
+		task->thenDo([t, libs = payloads.libraries(ejectw)] { t->ejectAll(libs); });
+
+	task->thenDo([t] { t->printSummary(); });
+	task->thenDo([t] { t->checkLedger(); });
+
+	if (vars.count("vs-debug-workaround"))
+	{
+		//resume threads that may have been left suspended when debugging with visual studio
+		task->then([t]
+		{
+			if (t->rounds++ > 0)
+				t->proc.resumeAllThreads();
+			if (t->rounds > 20)
+				return Await::next();
+			return Await::retryAfter(Pipeline::timer(t->timer, 100));
+		});
+	}
+
+	if (vars.count("print-pid"))
+		task->thenDo([t] { Log::out(to_string(t->proc.id())); });
+
+	Log::trace([&](auto log) { log("pipeline", { { "steps", task->steps() }, { "bytesPerTarget", task->footprint() + sizeof(Target) } }); });
+
+	return task;
+}
+
+// injects into every new process named --procname or matching --select until --watch-count targets are done
+void watch(const po::variables_map& vars, const Job& job, Pipeline& pipeline, const Payloads& payloads)
+{
+	if (!vars.count("procname") && !vars.count("select"))
+		throw po::error("--watch needs --procname or --select");
+
+	optional<Selector> selector;
+	wstring name;
+	if (vars.count("select"))
+		selector = Selector::parse(vars["select"].as<wstring>());
+	else
+		name = vars["procname"].as<wstring>();
+	const unsigned interval = vars["watch-interval"].as<unsigned>();
+	const size_t count = vars.count("watch-count") ? vars["watch-count"].as<unsigned>() : 0;
+
+	ProcessWatcher watcher([&]
+	{
+		if (selector)
+			return selector->select(ProcessSnapshot::take(*selector));
+		return Process::list([&](const wstring& exeName) { return boost::iequals(exeName, name); });
+	});
+	WatchDispatcher dispatcher([&](const ProcessEntry& entry)
+	{
+		Process target = Process::open(entry.pid);
+		if (target.creationTime() != entry.creationTime)
+			BOOST_THROW_EXCEPTION(ex_injection() << e_text("process exited and its pid was reused") << e_pid(entry.pid));
+		// built first, so nothing can fail between suspending the target and handing it over
+		shared_ptr<Pipeline::Task> task = targetTask(target, vars, job, payloads);
+		target.suspend();
+		return pipeline.run(task);
+	}, vars["watch-parallel"].as<unsigned>());
+
+	auto report = [](const vector<WatchDispatcher::Result>& results)
+	{
+		for (const WatchDispatcher::Result& r : results)
+		{
+			if (r.error)
+			{
+				Metrics::failure(exception_class(r.error));
+				Log::error(exception_text(r.error, (format("injectory: (%d) %s") % r.entry.pid % to_string(r.entry.exeName)).str()));
+			}
+			else
+				Log::out("done", { { "pid", r.entry.pid }, { "exe", r.entry.exeName }, { "msAfterDetection", std::chrono::duration<double, std::milli>(r.latency).count() } });
+		}
+		return results.size();
+	};
+
+	watcher.poll();
+	for (size_t done = 0; count == 0 || done + dispatcher.inFlight() < count; )
+	{
+		vector<ProcessEntry> added = watcher.poll();
+		if (count && added.size() > count - done - dispatcher.inFlight())
+			added.resize(count - done - dispatcher.inFlight());
+		dispatcher.dispatch(added);
+		done += report(dispatcher.reap());
+		Sleep(interval);
+	}
+	report(dispatcher.reap(true));
+}
+
+// waits for the targets as --wait-for-exit or --wait-for-any ask and reports exits as they happen
+void waitForExit(const po::variables_map& vars, const vector<Process>& procs)
+{
+	const bool any = vars.count("wait-for-any") > 0;
+	if (!any && !vars.count("wait-for-exit"))
+		return;
+
+	WaitGroup group;
+	for (const Process& p : procs)
+		group.add(p);
+
+	const bool report = procs.size() > 1 || vars["verbose"].as<int>() > 0;
+	const DWORD timeout = vars.count("wait-timeout") ? vars["wait-timeout"].as<unsigned>() : INFINITE;
+	const auto deadline = WaitGroup::clock::now() + std::chrono::milliseconds(timeout);
+
+	for (;;)
+	{
+		DWORD remaining = INFINITE;
+		if (timeout != INFINITE)
+			remaining = (DWORD)(std::max)((long long)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - WaitGroup::clock::now()).count(), 0LL);
+
+		optional<WaitGroup::Exit> exit = group.waitAny(remaining);
+		if (!exit)
+			break;
+		if (exit->error)
+			std::rethrow_exception(exit->error);
+		if (report)
+			Log::out("exited", { { "pid", exit->proc.id() }, { "code", exit->exitCode }, { "ms", exit->lifetimeMillis() } });
+		if (any)
+			return;
+	}
+
+	if (group.running() > 0)
+		BOOST_THROW_EXCEPTION(ex_injection() << e_text((format("timed out with %d of %d targets still running") % group.running() % group.size()).str()));
+}
+
+// launches count instances, up to --parallel at a time, runs each through the pipeline
+// and reports how long every instance took from CreateProcess until all its steps were done
+bool launchInstances(const po::variables_map& vars, const Job& job, Pipeline& pipeline, const Payloads& payloads,
+	const function<Process()>& launch, unsigned count)
+{
+	using clock = Pipeline::clock;
+	struct Instance
+	{
+		unsigned index;
+		clock::time_point start;
+		std::future<Process> launched;
+		Process proc;
+		std::future<clock::time_point> ready;
+	};
+
+	auto isReady = [](auto& future)
+	{
+		return future.valid() && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	};
+	auto millis = [](clock::duration d)
+	{
+		return std::chrono::duration<double, std::milli>(d).count();
+	};
+
+	const unsigned parallel = vars["parallel"].as<unsigned>();
+	if (parallel == 0)
+		BOOST_THROW_EXCEPTION(ex_injection() << e_text("invalid number of parallel launches 0"));
+
+	vector<Process> procs;
+	vector<double> latencies;
+	vector<Instance> running;
+	const clock::time_point begin = clock::now();
+
+	for (unsigned next = 0; next < count || !running.empty(); )
+	{
+		// CreateProcess runs on its own thread so that launches overlap
+		while (next < count && running.size() < parallel)
+		{
+			Instance instance = { next++, clock::now() };
+			instance.launched = std::async(std::launch::async, launch);
+			running.push_back(std::move(instance));
+		}
+
+		for (auto it = running.begin(); it != running.end(); )
+		{
+			try
+			{
+				if (isReady(it->launched))
+				{
+					it->proc = it->launched.get();
+					procs.push_back(it->proc);
+					it->ready = pipeline.run(targetTask(it->proc, vars, job, payloads));
+				}
+				if (isReady(it->ready))
+				{
+					double latency = millis(it->ready.get() - it->start);
+					latencies.push_back(latency);
+					Log::out("ready", { { "instance", it->index }, { "pid", it->proc.id() }, { "msAfterLaunch", latency } });
+					it = running.erase(it);
+					continue;
+				}
+			}
+			catch (...)
+			{
+				Metrics::failure(exception_class(std::current_exception()));
+				Log::error(exception_text(std::current_exception(), (format("injectory: instance %d") % it->index).str()));
+				it = running.erase(it);
+				continue;
+			}
+			++it;
+		}
+		Sleep(1);
+	}
+
+	if (!latencies.empty())
+	{
+		std::sort(latencies.begin(), latencies.end());
+		Log::out("instances", { { "ready", latencies.size() }, { "launched", count }, { "ms", millis(clock::now() - begin) },
+			{ "minMs", latencies.front() }, { "medianMs", latencies[latencies.size() / 2] }, { "maxMs", latencies.back() } });
+	}
+
+	waitForExit(vars, procs);
+	if (vars.count("kill-on-exit"))
+	{
+		for (Process& p : procs)
+			p.kill();
+	}
+
+	return latencies.size() == count;
+}
+
+// every process --select matches, all suspended and run through the pipeline at once
+bool injectSelected(const po::variables_map& vars, const Job& job, Pipeline& pipeline, const Payloads& payloads)
+{
+	const Selector selector = Selector::parse(vars["select"].as<wstring>());
+	const ProcessSnapshot snapshot = ProcessSnapshot::take(selector);
+	const vector<ProcessEntry> matches = selector.select(snapshot);
+	Log::info([&](auto log) { log("selected", { { "matches", matches.size() }, { "processes", snapshot.processes.size() }, { "windows", snapshot.windows.size() } }); });
+	if (matches.empty())
+		BOOST_THROW_EXCEPTION(ex_injection() << e_text("no process matches '" + to_string(selector.describe()) + "'"));
+
+	struct Selected
+	{
+		ProcessEntry entry;
+		Process proc;
+		std::future<Pipeline::clock::time_point> ready;
+	};
+
+	auto report = [](const ProcessEntry& entry)
+	{
+		Metrics::failure(exception_class(std::current_exception()));
+		Log::error(exception_text(std::current_exception(), (format("injectory: (%d) %s") % entry.pid % to_string(entry.exeName)).str()));
+	};
+
+	vector<Selected> selected;
+	for (const ProcessEntry& entry : matches)
+	{
+		try
+		{
+			Process target = Process::open(entry.pid);
+			if (target.creationTime() != entry.creationTime)
+				BOOST_THROW_EXCEPTION(ex_injection() << e_text("process exited and its pid was reused") << e_pid(entry.pid));
+			shared_ptr<Pipeline::Task> task = targetTask(target, vars, job, payloads);
+			target.suspend();
+			selected.push_back({ entry, target, pipeline.run(task) });
+		}
+		catch (...)
+		{
+			report(entry);
+		}
+	}
+
+	vector<Process> procs;
+	for (Selected& s : selected)
+	{
+		try
+		{
+			s.ready.get();
+			procs.push_back(s.proc);
+			Log::out("done", { { "pid", s.entry.pid }, { "exe", s.entry.exeName } });
+		}
+		catch (...)
+		{
+			report(s.entry);
+		}
+	}
+
+	waitForExit(vars, procs);
+	if (vars.count("kill-on-exit"))
+	{
+		for (Process& p : procs)
+			p.kill();
+	}
+
+	return procs.size() == matches.size();
+}
+
+// --plan, what a run would do to the target worked out with read-only queries of it
+Plan planRun(const po::variables_map& vars, const Payloads& payloads)
+{
+	auto& inject = vars["inject"].as<vector<wstring>>();
+	auto& map = vars["map"].as<vector<wstring>>();
+	auto& eject = vars["eject"].as<vector<wstring>>();
+	auto& injectw = vars["injectw"].as<vector<wstring>>();
+	auto& mapw = vars["mapw"].as<vector<wstring>>();
+	auto& ejectw = vars["ejectw"].as<vector<wstring>>();
+
+	auto target = [&]
+	{
+		if (vars.count("pid"))
+		{
+			Process proc = Process::open(vars["pid"].as<int>(), false, PROCESS_QUERY_INFORMATION | PROCESS_VM_READ | SYNCHRONIZE);
+			return Plan::running(proc);
+		}
+		else if (vars.count("watch") && vars.count("procname"))
+			return Plan::launched(vars["procname"].as<wstring>()); // new processes are caught right after they start
+		else if (vars.count("procname"))
+		{
+			Process proc = Process::findByExeName(vars["procname"].as<wstring>());
+			return Plan::running(proc);
+		}
+		else if (vars.count("select"))
+		{
+			// against the first match, the others get the same steps
+			Selector selector = Selector::parse(vars["select"].as<wstring>());
+			vector<ProcessEntry> matches = selector.select(ProcessSnapshot::take(selector));
+			if (matches.empty())
+				BOOST_THROW_EXCEPTION(ex_injection() << e_text("no process matches '" + to_string(selector.describe()) + "'"));
+			Process proc = Process::open(matches.front().pid, false, PROCESS_QUERY_INFORMATION | PROCESS_VM_READ | SYNCHRONIZE);
+			return Plan::running(proc);
+		}
+		else if (vars.count("wndtitle") || vars.count("wndclass"))
+		{
+			wstring wndtitle;
+			wstring wndclass;
+			if (vars.count("wndtitle")) wndtitle = vars["wndtitle"].as<wstring>();
+			if (vars.count("wndclass")) wndclass = vars["wndclass"].as<wstring>();
+			Process proc = Process::findByWindow(wndclass, wndtitle);
+			return Plan::running(proc);
+		}
+		else if (vars.count("launch"))
+			return Plan::launched(vars["launch"].as<wstring>());
+		else
+			throw po::error("missing target (--pid, --procname, --wndtitle, --wndclass, --select or --launch)");
+	};
+
+	Plan plan = target();
+	if (vars.count("launch"))
+		plan.instances = vars["instances"].as<unsigned>();
+	plan.flags(vars["set-flags"].as<vector<string>>(), vars["unset-flags"].as<vector<string>>());
+
+	auto mapAll = [&](const vector<wstring>& paths, Plan::Phase phase)
+	{
+		for (const wstring& path : paths)
+		{
+			try
+			{
+				plan.map(payloads.image(path), phase, payloads.threads() > 1);
+			}
+			catch (const boost::exception& e)
+			{
+				const string* text = boost::get_error_info<e_text>(e);
+				plan.problem(to_string(path) + ": " + (text ? *text : string("could not be prepared")));
+			}
+		}
+	};
+
+	plan.inject(inject, Plan::Suspended);
+	mapAll(map, Plan::Suspended);
+	mapAll(vars["reload"].as<vector<wstring>>(), Plan::Suspended); // at most a fresh map
+	plan.eject(eject, Plan::Suspended);
+
+	Triggers when = triggers(vars);
+	if (!when.empty())
+	{
+		optional<DWORD> timeout;
+		if (vars.count("trigger-timeout"))
+			timeout = vars["trigger-timeout"].as<unsigned>();
+		plan.waitFor(when.describe(), vars["poll-interval"].as<unsigned>(), timeout);
+	}
+	else if (!injectw.empty() || !mapw.empty() || !ejectw.empty())
+		plan.waitFor("input idle", 10, 5000);
+
+	plan.inject(injectw, Plan::Triggered);
+	mapAll(mapw, Plan::Triggered);
+	plan.eject(ejectw, Plan::Triggered);
+	return plan;
+}
+
+// writes the --ledger-json file however main is left, failed runs are the interesting ones
+struct LedgerWriter
+{
+	optional<fs::path> path;
+
+	~LedgerWriter()
+	{
+		if (!path)
+			return;
+		fs::ofstream out(*path);
+		out << Ledger::instance().json() << endl;
+		if (!out)
+			Log::error("injectory: could not write " + path->string());
+	}
+};
+
+// writes the --metrics-file every --metrics-interval while main runs and once more however it is left
+class MetricsWriter
+{
+private:
+	fs::path path;
+	std::mutex mutex;
+	std::condition_variable stop;
+	bool stopping = false;
+	bool failed = false;
+	std::thread thread;
+
+	void write()
+	{
+		// replaced in one go, so a collector never reads half a file
+		fs::path tmp = path;
+		tmp += ".tmp";
+		{
+			fs::ofstream out(tmp, std::ios::trunc);
+			out << Metrics::text();
+			if (!out)
+				return report();
+		}
+		boost::system::error_code ec;
+		fs::rename(tmp, path, ec);
+		if (ec)
+			report();
+	}
+
+	void report()
+	{
+		if (!failed)
+			Log::error("injectory: could not write " + path.string());
+		failed = true;
+	}
+
+public:
+	void start(const fs::path& path_, unsigned intervalMillis)
+	{
+		path = path_;
+		if (intervalMillis == 0)
+			return;
+		thread = std::thread([this, intervalMillis]
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!stop.wait_for(lock, std::chrono::milliseconds(intervalMillis), [this] { return stopping; }))
+				write();
+		});
+	}
+
+	~MetricsWriter()
+	{
+		if (path.empty())
+			return;
+		if (thread.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			stop.notify_one();
+			thread.join();
+		}
+		write();
+	}
+};
+
 Process proc;
 
 int main(int argc, char *argv[])
 {
 	po::variables_map vars;
+	LedgerWriter ledgerWriter;
+	MetricsWriter metricsWriter;
 	try
 	{
 		po::options_description desc;
 		po::options_description targets("Targets");
 		po::options_description launch_options("--launch specific options");
+		po::options_description watch_options("--watch specific options");
 		po::options_description options("Options");
 
 		targets.add_options()
@@ -46,7 +980,16 @@ int main(int argc, char *argv[])
 			("procname,n",	po::wvalue<wstring>()->value_name("NAME"),		"find process by name")
 			("wndtitle,t",	po::wvalue<wstring>()->value_name("TITLE"),		"find process by window title")
 			("wndclass,c",	po::wvalue<wstring>()->value_name("CLASS"),		"find process by window class, can be combined with --wndtitle")
+			("select",		po::wvalue<wstring>()->value_name("EXPR"),		"find all processes matching EXPR, e.g. \"exe:a*.exe !title:*Setup* age<10m\", see README")
 			("launch,l",	po::wvalue<wstring>()->value_name("EXE"),		"launches the target in a new process")
+			("watch",														"keep injecting into new processes matching --procname or --select")
+		;
+		watch_options.add_options()
+			("watch-interval",po::value<unsigned>()->default_value(10, "")->value_name("MS"),
+																			"interval between process snapshots, default 10")
+			("watch-parallel",po::value<unsigned>()->default_value(8, "")->value_name("N"),
+																			"inject into up to N new processes at once, default 8")
+			("watch-count",	po::value<unsigned>()->value_name("N"),			"exit after N targets")
 		;
 		launch_options.add_options()
 			("args,a",		po::wvalue<wstring>()->value_name("STRING")->default_value(L"", ""),
@@ -55,17 +998,39 @@ int main(int argc, char *argv[])
 			("clear-env",													"start with a cleared environment")
 			("set-env",		po::wvector<wstring>()->value_name("KEY=VALUE..."),"set environment variable")
 			("unset-env",	po::wvector<wstring>()->value_name("KEY..."),	"unset environment variable")
+			("instances",	po::value<unsigned>()->default_value(1, "")->value_name("N"),
+																			"launch N instances and report their launch to ready times")
+			("parallel",	po::value<unsigned>()->default_value(8, "")->value_name("K"),
+																			"launch up to K instances at once, default 8")
 		;
 		options.add_options()
 			("inject,i",	po::wvector<wstring>()->value_name("DLL..."),	"inject libraries before main")
 			("injectw,I",	po::wvector<wstring>()->value_name("DLL..."),	"inject libraries when input idle")
 			("map,m",		po::wvector<wstring>()->value_name("DLL..."),	"map file into target before main")
 			("mapw,M",		po::wvector<wstring>()->value_name("DLL..."),	"map file into target when input idle")
+			("reload,r",	po::wvector<wstring>()->value_name("DLL..."),	"map file into target before main, or patch the changed pages of an earlier --reload of it")
 			("eject,e",		po::wvector<wstring>()->value_name("DLL..."),	"eject libraries before main")
 			("ejectw,E",	po::wvector<wstring>()->value_name("DLL..."),	"eject libraries when input idle")
+			("when-module",	po::wvector<wstring>()->value_name("DLL..."),	"do the *w steps once these modules are loaded instead of when input idle")
+			("when-threads",po::value<unsigned>()->value_name("N"),			"do the *w steps once the target has N threads")
+			("when-export",	po::wvector<wstring>()->value_name("DLL!EXPORT..."),"do the *w steps once these exports are mapped")
+			("poll-interval",po::value<unsigned>()->default_value(10, "")->value_name("MS"),
+																			"interval for polling --when-* conditions, default 10")
+			("trigger-timeout",po::value<unsigned>()->value_name("MS"),		"fail if --when-* conditions don't hold within MS")
 			("set-flags",	po::vector<string>()->value_name("FLAG..."),	"see --list-flags")
 			("unset-flags",	po::vector<string>()->value_name("FLAG..."),	"see --list-flags")
 
+			("scan-shards",	po::value<unsigned>()->default_value(1, "")->value_name("N"),
+																			"split address space scans into N shards queried in parallel")
+			("thread-priority",po::value<string>()->value_name("PRIORITY"),"priority of threads started in the target, idle, lowest, below-normal, normal, above-normal, highest or time-critical (default)")
+			("thread-cpu",	po::value<unsigned>()->value_name("N"),			"ideal processor of threads started in the target")
+			("thread-affinity",po::value<string>()->value_name("MASK"),		"processor affinity mask of threads started in the target, e.g. 0x3")
+			("thread-stack",po::value<unsigned>()->value_name("KB"),		"stack reserve of threads started in the target")
+			("pipeline-threads",po::value<unsigned>()->default_value(2, "")->value_name("N"),
+																			"threads running the steps of all targets, default 2")
+			("prepare-threads",po::value<unsigned>()->default_value(0, "")->value_name("N"),
+																			"threads preparing --map payloads, default one per core")
+
 			("print-own-pid",												"print the pid of this process")
 			("print-pid",													"print the pid of the target process")
 			("rethrow",														"rethrow exceptions")
@@ -73,7 +1038,15 @@ int main(int argc, char *argv[])
 																			" visual studio by resuming all threads for 2 seconds")
 
 			("wait-for-exit",												"wait for the target to exit before exiting")
-			("kill-on-exit",												"kill the target when exiting\n")
+			("wait-for-any",												"with many targets, wait only until the first one exits")
+			("wait-timeout",po::value<unsigned>()->value_name("MS"),		"fail if the targets are still running after MS")
+			("kill-on-exit",												"kill the target when exiting")
+			("plan",														"print what would be done to the target as JSON and exit, the target is only queried")
+			("ledger-json",	po::wvalue<wstring>()->value_name("FILE"),		"write every remote allocation as JSON to FILE")
+			("metrics-file",po::wvalue<wstring>()->value_name("FILE"),		"keep writing counters and histograms of the run to FILE in the Prometheus text format")
+			("metrics-interval",po::value<unsigned>()->default_value(1000, "")->value_name("MS"),
+																			"interval between --metrics-file updates, default 1000, 0 to write it only on exit")
+			("max-left-behind",po::value<unsigned>()->value_name("KB"),		"fail if more than KB stay committed in a target\n")
 
 			("verbose,v",	po::value<int>()->default_value(0,"")->implicit_value(1,"")->value_name("[=LVL]"),
 																			"level [0,3] e.g. -v2 or --verbose=2")
@@ -86,6 +1059,7 @@ int main(int argc, char *argv[])
 		;
 		desc.add(targets);
 		desc.add(launch_options);
+		desc.add(watch_options);
 		desc.add(options);
 
 		po::store(po::parse_command_line(argc, argv, desc), vars);
@@ -94,6 +1068,32 @@ int main(int argc, char *argv[])
 		int verbose = vars["verbose"].as<int>();
 		if (verbose < 0 || 3 < verbose)
 			BOOST_THROW_EXCEPTION(ex_injection() << e_text("invalid verbosity level " + to_string(verbose)));
+		Log::setLevel(verbose);
+
+		if (vars.count("ledger-json"))
+			ledgerWriter.path = vars["ledger-json"].as<wstring>();
+		if (vars.count("metrics-file"))
+			metricsWriter.start(vars["metrics-file"].as<wstring>(), vars["metrics-interval"].as<unsigned>());
+
+		RemoteThreadPolicy& policy = Process::remoteThreadPolicy;
+		if (vars.count("thread-priority"))
+			policy.priority = RemoteThreadPolicy::parsePriority(vars["thread-priority"].as<string>());
+		if (vars.count("thread-cpu"))
+			policy.idealProcessor = vars["thread-cpu"].as<unsigned>();
+		if (vars.count("thread-affinity"))
+		{
+			const string& mask = vars["thread-affinity"].as<string>();
+			try { policy.affinity = (DWORD_PTR)std::stoull(mask, nullptr, 0); }
+			catch (const std::exception&) { throw po::error("invalid --thread-affinity '" + mask + "'"); }
+			if (*policy.affinity == 0)
+				throw po::error("invalid --thread-affinity 0");
+		}
+		if (vars.count("thread-stack"))
+			policy.stackSize = (SIZE_T)vars["thread-stack"].as<unsigned>() * 1024;
+
+		Process::scanShards = vars["scan-shards"].as<unsigned>();
+		if (Process::scanShards == 0)
+			BOOST_THROW_EXCEPTION(ex_injection() << e_text("invalid number of scan shards 0"));
 
 		if (vars.count("help"))
 		{
@@ -103,6 +1103,11 @@ int main(int argc, char *argv[])
 			     << "Examples:" << endl
 			     << "  injectory --launch a.exe --map b.dll --args \"1 2 3\"" << endl
 			     << "  injectory --pid 12345 --inject b.dll --wait-for-exit" << endl
+			     << "  injectory --select \"exe:worker*.exe cmdline:--child session:1\" --inject b.dll" << endl
+			     << "  injectory --procname worker.exe --watch --inject hook.dll --metrics-file injectory.prom" << endl
+			     << "  injectory --launch a.exe --map b.dll --instances 100 --parallel 16" << endl
+			     << "  injectory --pid 12345 --map b.dll --eject c.dll --plan" << endl
+			     << "  injectory --pid 12345 --reload b.dll" << endl
 			     << desc << endl;
 			return 0;
 		}
@@ -117,15 +1122,15 @@ int main(int argc, char *argv[])
 		if (vars.count("list-flags"))
 		{
 			// group by Flag.group
-			map<string, vector<Flag*>> groups;
-			for (const auto&[_, flag] : Flags::all)
-				groups[flag->group].push_back(flag);
+			map<string, vector<const Flag*>> groups;
+			for (const Flag& flag : Flags::all)
+				groups[string(flag.group())].push_back(&flag);
 			
 			// print all group names and flags in each group
 			for (const auto&[groupName, groupFlags] : groups)
 			{
 				cout << endl << "  --" << groupName << " flags--" << endl;
-				for (Flag* flag : groupFlags)
+				for (const Flag* flag : groupFlags)
 					cout << flag->name << endl;
 			}
 
@@ -135,19 +1140,34 @@ int main(int argc, char *argv[])
 		if (vars.count("print-own-pid"))
 			cout << Process::current.id() << endl;
 
-		for (const string& flagName : vars["set-flags"].as<vector<string>>())
+		Flags::apply(vars["set-flags"].as<vector<string>>(), vars["unset-flags"].as<vector<string>>());
+
+		Job job;
+		if (vars.count("kill-on-exit"))
 		{
-			if (Flags::all.count(flagName))
-				Flags::all[flagName]->enable();
-			else
-				BOOST_THROW_EXCEPTION(ex_injection() << e_text("unknown flag '" + flagName + "'"));
+			job = Job::create();
+			JOBOBJECT_EXTENDED_LIMIT_INFORMATION jeli = { 0 };
+			jeli.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+			job.setInfo(JobObjectExtendedLimitInformation, jeli);
+		}
+
+		WorkPool pool(vars["prepare-threads"].as<unsigned>());
+		const Payloads payloads(vars, pool);
+		Pipeline pipeline(vars["pipeline-threads"].as<unsigned>());
+
+		if (vars.count("plan"))
+		{
+			Plan plan = planRun(vars, payloads);
+			cout << plan.json() << endl;
+			return plan.problems().empty() ? 0 : 1;
 		}
-		for (const string& flagName : vars["unset-flags"].as<vector<string>>())
+
+		payloads.preflight();
+
+		if (vars.count("watch"))
 		{
-			if (Flags::all.count(flagName))
-				Flags::all[flagName]->disable();
-			else
-				BOOST_THROW_EXCEPTION(ex_injection() << e_text("unknown flag '" + flagName + "'"));
+			watch(vars, job, pipeline, payloads);
+			return 0;
 		}
 
 		if (vars.count("pid"))
@@ -171,6 +1191,8 @@ int main(int argc, char *argv[])
 			proc = Process::findByWindow(wndclass, wndtitle);
 			proc.suspend();
 		}
+		else if (vars.count("select"))
+			return injectSelected(vars, job, pipeline, payloads) ? 0 : 1;
 		else if (vars.count("launch"))
 		{
 			fs::path app = vars["launch"].as<wstring>();
@@ -197,126 +1219,72 @@ int main(int argc, char *argv[])
 					env.set(kv);
 			}
 
-			if (verbose)
+			if (Log::enabled(Log::Info))
 			{
-				cout << "launching: '" << app.string() << "'" << endl;
-				cout << "  args: '" << to_string(args) << "'" << endl;
-				cout << "  cwd: " << (cwd?"'"+to_string(cwd.value())+"'":"(current)") << endl;
-				if (!any_env_changes)
-					cout << "  env: (current)" << endl;
-				else if (env.empty())
-					cout << "  env: (empty)" << endl;
-				else if (verbose < 3 && !clear_env)
+				const char* envState = !any_env_changes ? "current" : env.empty() ? "empty" : (verbose < 3 && !clear_env) ? "changed" : "full";
+				Log::info("launching", { { "app", app.wstring() }, { "args", args }, { "cwd", cwd ? *cwd : L"(current)" }, { "env", envState } });
+				if (any_env_changes && !env.empty() && verbose < 3 && !clear_env)
 				{
-					cout << "  env: (use --verbose=3 to show full)" << endl;
-					cout << "    unset:" << endl;
+					// only the changes, --verbose=3 shows all of it
 					for (const wstring& k : unset_env)
-						cout << "      " << to_string(k) << endl;
-					cout << "    set:" << endl;
+						Log::info("env unset", { { "key", k } });
 					for (const wstring& kv : set_env)
 					{
 						const wstring k = kv.substr(0, kv.find(L'='));
-						cout << "      " << to_string(k) << "=" << to_string(env[k].value()) << endl;
+						Log::info("env set", { { "key", k }, { "value", env[k].value() } });
 					}
 				}
-				else
+				else if (any_env_changes && !env.empty())
 				{
-					cout << "  env:" << endl;
 					for (const auto&[k, v] : env)
-						cout << "    " << to_string(k) << "=" << to_string(v) << endl;
+						Log::info("env", { { "key", k }, { "value", v } });
 				}
 			}
 
-			proc = Process::launch(app, args,
-				any_env_changes ? env : optional<Environment>(),
-				cwd, false, CREATE_SUSPENDED).process;
+			// the environment block is built once no matter how many instances are launched
+			const wstring envBlock = env.block();
+			const wstring* envBlockPtr = any_env_changes ? &envBlock : nullptr;
+			auto launch = [&] { return Process::launch(app, args, envBlockPtr, cwd, false, CREATE_SUSPENDED).process; };
+
+			const unsigned instances = vars["instances"].as<unsigned>();
+			if (instances == 0)
+				BOOST_THROW_EXCEPTION(ex_injection() << e_text("invalid number of instances 0"));
+			if (instances > 1)
+				return launchInstances(vars, job, pipeline, payloads, launch, instances) ? 0 : 1;
+
+			proc = launch();
 		}
 		else
-			throw po::error("missing target (--pid, --procname, --wndtitle, --wndclass or --launch)");
+			throw po::error("missing target (--pid, --procname, --wndtitle, --wndclass, --select or --launch)");
 
 		if (proc)
 		{
-			auto& inject = vars["inject"].as<vector<wstring>>();
-			auto& map = vars["map"].as<vector<wstring>>();
-			auto& eject = vars["eject"].as<vector<wstring>>();
-			auto& injectw = vars["injectw"].as<vector<wstring>>();
-			auto& mapw = vars["mapw"].as<vector<wstring>>();
-			auto& ejectw = vars["ejectw"].as<vector<wstring>>();
-
-			bool anyInjections = !(inject.empty() && map.empty() && eject.empty() && injectw.empty() && mapw.empty() && ejectw.empty());
-
-			if (anyInjections && (proc.is64bit() != is64bit))
-				BOOST_THROW_EXCEPTION(ex_target_bit_mismatch() << e_process(proc));
-
-			Job job;
-			if (vars.count("kill-on-exit"))
-			{
-				job = Job::create();
-				job.assignProcess(proc);
-				JOBOBJECT_EXTENDED_LIMIT_INFORMATION jeli = { 0 };
-				jeli.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
-				job.setInfo(JobObjectExtendedLimitInformation, jeli);
-			}
-
-			vector<Module> injectedModules;
-
-			for (const fs::path& lib : inject)	injectedModules.push_back(proc.inject(lib));
-			for (const fs::path& lib : map)		injectedModules.push_back(proc.mapRemoteModule(lib));
-			for (const fs::path& lib : eject)	proc.getInjected(lib).eject();
-
-			proc.resume();
-			if (!injectw.empty() || !mapw.empty() || !ejectw.empty())
-				proc.waitForInputIdle(5000);
-
-			for (const fs::path& lib : injectw)	injectedModules.push_back(proc.inject(lib));
-			for (const fs::path& lib : mapw)	injectedModules.push_back(proc.mapRemoteModule(lib));
-			for (const fs::path& lib : ejectw)	proc.getInjected(lib).eject();
-
-			if (verbose && injectedModules.size() > 0)
-			{
-				cout << "injected dll     AllocationBase EntryPoint SizeOfImage CheckSum" << endl;
-				for (Module& module : injectedModules)
-				{
-					IMAGE_NT_HEADERS nt_header = module.ntHeader();
-					cout << format("%-20s 0x%p 0x%p %8.1f kB 0x%08x")
-						% module.path().filename().string()
-						% module.handle()
-						% (void*)((DWORD_PTR)module.handle() + nt_header.OptionalHeader.AddressOfEntryPoint)
-						% (nt_header.OptionalHeader.SizeOfImage / 1024.0)
-						% nt_header.OptionalHeader.CheckSum;
-					cout << endl;
-				}
-			}
+			pipeline.run(targetTask(proc, vars, job, payloads)).get();
 
-
-			if (vars.count("vs-debug-workaround"))
-			{
-				//resume threads that may have been left suspended when debugging with visual studio
-				for (int i = 0; i < 20; i++)
-				{
-					proc.wait(100);
-					proc.resumeAllThreads();
-				}
-			}
-
-			if (vars.count("print-pid"))
-				cout << proc.id() << endl;
-
-			if (vars.count("wait-for-exit"))
-				proc.wait();
+			waitForExit(vars, { proc });
 
 			if (vars.count("kill-on-exit"))
 				proc.kill();
 		}
+
+		Log::trace([](auto log)
+		{
+			const Log::Stats stats = Log::stats();
+			log("log", { { "written", stats.written }, { "dropped", stats.dropped }, { "held", stats.held }, { "batches", stats.batches } });
+		});
 	}
 	catch (const po::error& e)
 	{
+		Log::flush();
 		cerr << "injectory: " << e.what() << endl;
 		cerr << "Try 'injectory --help' for more information." << endl;
 		if (vars.count("rethrow")) throw; else return 1;
 	}
 	catch (...)
 	{
+		Metrics::failure(exception_class(std::current_exception()));
+		// the run is over, whatever was held back for a still suspended target goes out first
+		Log::flush();
 		print_exception(std::current_exception(), "injectory");
 		if (vars.count("rethrow")) throw; else return 1;
 	}
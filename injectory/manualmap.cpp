@@ -3,159 +3,187 @@
 #include "injectory/library.hpp"
 #include "injectory/file.hpp"
 #include "injectory/memoryarea.hpp"
+#include "injectory/peimage.hpp"
+#include "injectory/reload.hpp"
+#include "injectory/log.hpp"
 
-#include <stdio.h>
 #include <Psapi.h>
-#include <boost/filesystem.hpp>
-#include <boost/interprocess/file_mapping.hpp>
-namespace ip = boost::interprocess;
+#include <boost/algorithm/string.hpp>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
 
-
-// Matt Pietrek's function
-IMAGE_SECTION_HEADER* GetEnclosingSectionHeader(DWORD_PTR rva, IMAGE_NT_HEADERS& nt_header)
+namespace
 {
-	IMAGE_SECTION_HEADER* section = IMAGE_FIRST_SECTION(&nt_header);
-
-	for (int i = 0; i < nt_header.FileHeader.NumberOfSections; i++, section++)
+	// export offsets only depend on the dll file, so they are looked up once per session
+	// no matter how many targets the same image is mapped into
+	DWORD_PTR exportOffset(const Module& localModule, const fs::path& path, const string& name)
 	{
-		// This 3 line idiocy is because Watcom's linker actually sets the
-		// Misc.VirtualSize field to 0.  (!!! - Retards....!!!)
-		DWORD_PTR size = section->Misc.VirtualSize;
-		if (size == 0)
-			size = section->SizeOfRawData;
-
-		// Is the RVA within this section?
-		if (rva >= section->VirtualAddress && rva < (section->VirtualAddress + size))
-			return section;
-	}
-
-	return 0;
-}
+		static std::mutex mutex;
+		static map<std::pair<wstring, string>, DWORD_PTR> cache;
 
-// Matt Pietrek's function
-void* GetPtrFromRVA(DWORD_PTR rva, IMAGE_NT_HEADERS& nt_header, const ip::mapped_region& imageBase)
-{
-	IMAGE_SECTION_HEADER* section = GetEnclosingSectionHeader(rva, nt_header);
-	if(!section)
-		return 0;
-	LONG_PTR delta = (LONG_PTR)( section->VirtualAddress - section->PointerToRawData );
-	return (void*)((byte*)imageBase.get_address() + rva - delta);
-}
+		auto key = std::make_pair(path.wstring(), name);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = cache.find(key);
+			if (it != cache.end())
+				return it->second;
+		}
 
-void Process::fixIAT(const ip::mapped_region& imageBase, IMAGE_NT_HEADERS& nt_header, IMAGE_IMPORT_DESCRIPTOR* imgImpDesc)
-{
-	fs::path parentPath = path().parent_path();
-	if (!SetDllDirectoryW(parentPath.wstring().c_str()))
-	{
-		DWORD errcode = GetLastError();
-		BOOST_THROW_EXCEPTION(ex_fix_iat() << e_api_function("SetDllDirectory") << e_text("could not set path to target process") << e_file(parentPath) << e_last_error(errcode));
+		DWORD_PTR offset = (DWORD_PTR)localModule.getProcAddress(name) - (DWORD_PTR)localModule.handle();
+		std::lock_guard<std::mutex> lock(mutex);
+		cache[key] = offset;
+		return offset;
 	}
 
-	while (LPSTR lpModuleName = (LPSTR)GetPtrFromRVA(imgImpDesc->Name, nt_header, imageBase))
+	// the base a dll was linked for, read from its file since the loader writes the address it
+	// actually loaded at into ImageBase of the copy in memory. nullopt if the file can't be read or
+	// isn't the build with timeStamp anymore
+	optional<uintptr_t> preferredBase(const fs::path& path, DWORD timeStamp)
 	{
-		// ACHTUNG: LoadLibraryEx kann eine DLL nur anhand des Namen aus einem anderen
-		// Verzeichnis laden wie der Zielprozess!
-		Module localModule = Module::load(to_wstring(lpModuleName), DONT_RESOLVE_DLL_REFERENCES);
+		static std::mutex mutex;
+		static map<wstring, std::pair<DWORD, uintptr_t>> cache; // path -> timestamp, base
 
-		Library lib(localModule.path());
-		Module remoteModule = isInjected(lib);
-		if (!remoteModule)
-			remoteModule = inject(lib);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = cache.find(path.wstring());
+			if (it != cache.end() && it->second.first == timeStamp)
+				return it->second.second;
+		}
 
-		IMAGE_THUNK_DATA* itd = (IMAGE_THUNK_DATA*)GetPtrFromRVA(imgImpDesc->FirstThunk, nt_header, imageBase);
+		IMAGE_DOS_HEADER dos_header = {};
+		IMAGE_NT_HEADERS nt_header = {};
+		try
+		{
+			File file = File::create(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE);
+			auto readAt = [&](LONG offset, void* buffer, DWORD size)
+			{
+				LARGE_INTEGER pos;
+				pos.QuadPart = offset;
+				DWORD numBytesRead = 0;
+				return SetFilePointerEx(file.handle(), pos, nullptr, FILE_BEGIN) &&
+					ReadFile(file.handle(), buffer, size, &numBytesRead, nullptr) && numBytesRead == size;
+			};
+			if (!readAt(0, &dos_header, sizeof(dos_header)) || dos_header.e_magic != IMAGE_DOS_SIGNATURE ||
+				!readAt(dos_header.e_lfanew, &nt_header, sizeof(nt_header)) || nt_header.Signature != IMAGE_NT_SIGNATURE)
+				return nullopt;
+		}
+		catch (const ex_injection&)
+		{
+			return nullopt;
+		}
+		if (nt_header.FileHeader.TimeDateStamp != timeStamp)
+			return nullopt;
+
+		const uintptr_t base = (uintptr_t)nt_header.OptionalHeader.ImageBase;
+		std::lock_guard<std::mutex> lock(mutex);
+		cache[path.wstring()] = { timeStamp, base };
+		return base;
+	}
 
-		while(itd->u1.AddressOfData)
+	// loads name without running it, searching dir first like the target does. the dll directory
+	// is process wide and targets are mapped on several pipeline threads at once, so it is set,
+	// used for this one load and restored under one lock
+	Module loadFrom(const fs::path& dir, const string& name)
+	{
+		static std::mutex mutex;
+		std::lock_guard<std::mutex> lock(mutex);
+
+		wstring previous;
+		DWORD length = GetDllDirectoryW(0, nullptr);
+		if (length > 0)
 		{
-			IMAGE_IMPORT_BY_NAME*iibn = (IMAGE_IMPORT_BY_NAME*)GetPtrFromRVA(itd->u1.AddressOfData, nt_header, imageBase);
-			itd->u1.Function = (DWORD_PTR)remoteModule.getProcAddress((LPCSTR)iibn->Name);
+			previous.resize(length);
+			previous.resize(GetDllDirectoryW(length, &previous[0]));
+		}
 
-			itd++;
-		}      
+		if (!SetDllDirectoryW(dir.wstring().c_str()))
+		{
+			DWORD errcode = GetLastError();
+			BOOST_THROW_EXCEPTION(ex_fix_iat() << e_api_function("SetDllDirectory") << e_text("could not set path to target process") << e_file(dir) << e_last_error(errcode));
+		}
+		struct Restore
+		{
+			const wstring& previous;
+			~Restore()
+			{
+				SetDllDirectoryW(previous.empty() ? nullptr : previous.c_str());
+			}
+		} restore{ previous };
 
-		imgImpDesc++;
+		// ACHTUNG: LoadLibraryEx kann eine DLL nur anhand des Namen aus einem anderen
+		// Verzeichnis laden wie der Zielprozess!
+		return Module::load(to_wstring(name), DONT_RESOLVE_DLL_REFERENCES);
 	}
 }
 
-void Process::mapSections(void* lpModuleBase, byte* dllBin, IMAGE_NT_HEADERS& nt_header)
+// only the regular imports, delay imports keep pointing at their load stubs so those
+// dlls are loaded on first call like with LoadLibrary
+ImportStats Process::fixIAT(PeImage& image)
 {
-	IMAGE_SECTION_HEADER* section = IMAGE_FIRST_SECTION(&nt_header);
+	ImportStats stats;
+	if (image.imports().empty())
+		return stats;
 
-	for (int i = 0; i < nt_header.FileHeader.NumberOfSections; i++, section++)
+	// bound imports are checked against the modules in the target, found in a single pass
+	std::map<string, Module> loaded;
+	if (std::any_of(image.imports().begin(), image.imports().end(), [](const PeImage::Import& i) { return i.boundTimeStamp.has_value(); }))
 	{
-		void* dst = (void*)( (DWORD_PTR)lpModuleBase + section->VirtualAddress );
-		const void* src = (const void*)( (DWORD_PTR)dllBin + section->PointerToRawData );
-
-		memory(dst, section->SizeOfRawData).write(src);
-
-		/*
-		// next section header, calculate virtualSize of section header
-		SIZE_T virtualSize = section->VirtualAddress;
-		//printf("section: %s | %p | %x\n", section->Name, section->VirtualAddress, virtualSize);
-		if (section->VirtualAddress)
-			virtualSize = section->VirtualAddress - virtualSize;
-		PDWORD lpflOldProtect = 0;
-		if(!VirtualProtectEx(hProcess, (LPVOID)( (DWORD_PTR)lpModuleBase + section->VirtualAddress ), virtualSize,
-			section->Characteristics & 0x00FFFFFF, lpflOldProtect))
+		for (Module& module : modules())
 		{
-			PRINT_ERROR_MSGA("VirtualProtectEx failed.");
-			return FALSE;
+			wstring name = module.mappedFilename(false);
+			if (!name.empty())
+				loaded.emplace(boost::to_lower_copy(fs::path(name).filename().string()), module);
 		}
-		*/
 	}
-}
 
-void fixRelocations(const ip::mapped_region& dllBin,
-	const MemoryArea& moduleBase,
-	IMAGE_NT_HEADERS& nt_header,
-	IMAGE_BASE_RELOCATION* imgBaseReloc
-	)
-{
-	LONG_PTR delta = (DWORD_PTR)moduleBase.address() - nt_header.OptionalHeader.ImageBase;
-	//SIZE_T relocationSize = pNtHeader->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].Size;
-	WORD* relocData = 0;
-
-	if (!imgBaseReloc->SizeOfBlock) // image has no relocations
-		return;
-	
-	do
+	// the bound addresses hold if the module is the same build and loaded at its preferred base.
+	// with ASLR most system dlls are relocated, their ImageBase in memory always matches where
+	// they are, so the preferred one comes from the file
+	auto sameBuild = [&](const string& name, DWORD timeStamp)
 	{
-		byte* relocBase = (byte*)GetPtrFromRVA(imgBaseReloc->VirtualAddress, nt_header, dllBin);
-		SIZE_T numRelocations = (imgBaseReloc->SizeOfBlock - sizeof(IMAGE_BASE_RELOCATION)) / sizeof(WORD);
-		SIZE_T i = 0;
-
-		//printf("numRelocations: %d\n", numRelocations);
-
-		relocData = (WORD*)( (DWORD_PTR)&imgBaseReloc + sizeof(IMAGE_BASE_RELOCATION) );
-
-		// loop over all relocation entries
-		for(i = 0; i < numRelocations; i++, relocData++)
+		auto it = loaded.find(boost::to_lower_copy(name));
+		if (it == loaded.end())
+			return false;
+		if (it->second.ntHeader().FileHeader.TimeDateStamp != timeStamp)
+			return false;
+		optional<uintptr_t> preferred;
+		try
 		{
-			// Get reloc data
-			BYTE RelocType = *relocData >> 12;
-			WORD Offset = *relocData & 0xFFF;
-
-			switch(RelocType)
-			{
-			case IMAGE_REL_BASED_ABSOLUTE:
-				break;
-
-			case IMAGE_REL_BASED_HIGHLOW:
-				*(DWORD32*)(relocBase + Offset) += (DWORD32)delta;
-				break;
-
-			case IMAGE_REL_BASED_DIR64:
-				*(DWORD64*)(relocBase + Offset) += delta;
-
-				break;
+			preferred = preferredBase(it->second.path(), timeStamp);
+		}
+		catch (const ex_injection&)
+		{
+			// gone since the module list was taken
+		}
+		return preferred && *preferred == (uintptr_t)it->second.handle();
+	};
 
-			default:
-				BOOST_THROW_EXCEPTION(ex("unsuppported relocation type"));
-			}
+	optional<fs::path> dir;
+	for (const PeImage::Import& import : image.imports())
+	{
+		if (import.boundTimeStamp && sameBuild(import.module, *import.boundTimeStamp) &&
+			std::all_of(import.boundForwarders.begin(), import.boundForwarders.end(), [&](const auto& f) { return sameBuild(f.first, f.second); }))
+		{
+			stats.bound += import.names.size();
+			continue;
 		}
 
-		imgBaseReloc = (IMAGE_BASE_RELOCATION*)relocData;
+		if (!dir)
+			dir = path().parent_path();
+		Module localModule = loadFrom(*dir, import.module);
+
+		Library lib(localModule.path());
+		Module remoteModule = isInjected(lib);
+		if (!remoteModule)
+			remoteModule = inject(lib);
 
-	} while( *(DWORD*)relocData );
+		IMAGE_THUNK_DATA* itd = image.at<IMAGE_THUNK_DATA>(import.iatRva, import.names.size());
+		for (const string& name : import.names)
+			(itd++)->u1.Function = (DWORD_PTR)remoteModule.handle() + exportOffset(localModule, lib.path(), name);
+		stats.resolved += import.names.size();
+	}
+	return stats;
 }
 
 void Process::callTlsInitializers(
@@ -184,63 +212,7 @@ Module Process::mapRemoteModule(const Library& lib)
 {
 	try
 	{
-		File file = File::create(lib.path(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL);
-
-		ip::file_mapping m_file(lib.path().string().c_str(), ip::read_only);
-		ip::mapped_region region(m_file, ip::read_only);
-
-		const IMAGE_DOS_HEADER& dos_header = *(IMAGE_DOS_HEADER*)region.get_address();
-		
-		if(dos_header.e_magic != IMAGE_DOS_SIGNATURE)
-			BOOST_THROW_EXCEPTION (ex_map_remote() << e_text("invalid DOS header"));
-		
-		IMAGE_NT_HEADERS& nt_header = *(IMAGE_NT_HEADERS*)((DWORD_PTR) region.get_address()+dos_header.e_lfanew);
-
-		if(nt_header.Signature != IMAGE_NT_SIGNATURE)
-			BOOST_THROW_EXCEPTION (ex_map_remote() << e_text("invalid PE header"));
-
-		// Allocate space for the module in the remote process
-		MemoryArea moduleBase = alloc(nt_header.OptionalHeader.SizeOfImage, false);
-		
-		// fix imports
-		IMAGE_IMPORT_DESCRIPTOR& imgImpDesc = *(IMAGE_IMPORT_DESCRIPTOR*)GetPtrFromRVA(
-			nt_header.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].VirtualAddress,
-			nt_header,
-			region);
-		if (nt_header.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].Size)
-			fixIAT(region, nt_header, &imgImpDesc);
-		
-		// fix relocs
-		IMAGE_BASE_RELOCATION& imgBaseReloc = *(IMAGE_BASE_RELOCATION*)GetPtrFromRVA(
-			(DWORD)(nt_header.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].VirtualAddress),
-			nt_header,
-			region);
-		if(nt_header.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].Size)
-			fixRelocations(region, moduleBase, nt_header, &imgBaseReloc);
-
-		// Write the PE header into the remote process's memory space
-		moduleBase.write(region.get_address(), nt_header.FileHeader.SizeOfOptionalHeader +
-			sizeof(nt_header.FileHeader) +
-			sizeof(nt_header.Signature));
-
-		// Map the sections into the remote process(they need to be aligned
-		// along their virtual addresses)
-		mapSections(moduleBase.address(), (byte*)region.get_address(), nt_header);
-
-		// call all tls callbacks
-		IMAGE_TLS_DIRECTORY& imgTlsDir = *(IMAGE_TLS_DIRECTORY*)GetPtrFromRVA(
-			nt_header.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_TLS].VirtualAddress,
-			nt_header,
-			region);
-		if(nt_header.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_TLS].Size)
-			callTlsInitializers((HMODULE)moduleBase.address(), DLL_PROCESS_ATTACH, imgTlsDir);
-
-		// call entry point
-		remoteDllMainCall(
-			(LPVOID)((DWORD_PTR)moduleBase.address() + nt_header.OptionalHeader.AddressOfEntryPoint),
-			(HMODULE)moduleBase.address(), 1, nullptr);
-
-		return isInjected((HMODULE)moduleBase.address());
+		return mapRemoteModule(PeImage::load(lib.path()));
 	}
 	catch (...)
 	{
@@ -248,3 +220,178 @@ Module Process::mapRemoteModule(const Library& lib)
 			boost::errinfo_nested_exception(boost::current_exception()));
 	}
 }
+
+Module Process::mapRemoteModule(const PeImage& prepared, WorkPool* pool, ImportStats* imports)
+{
+	try
+	{
+		PeImage image = mapImage(prepared, pool, imports);
+		return isInjected((HMODULE)image.ntHeader().OptionalHeader.ImageBase);
+	}
+	catch (...)
+	{
+		BOOST_THROW_EXCEPTION(ex("failed to map PE file into memory") << e_library(prepared.path()) << e_process(*this) <<
+			boost::errinfo_nested_exception(boost::current_exception()));
+	}
+}
+
+PeImage Process::mapImage(const PeImage& prepared, WorkPool* pool, ImportStats* imports)
+{
+	// Allocate space for the module in the remote process
+	MemoryArea moduleBase = alloc(prepared.size(), "mapped image " + prepared.path().filename().string(), false);
+
+	// relocate and fix imports in a local copy of the layout
+	PeImage image = prepared.relocated((uintptr_t)moduleBase.address(), pool);
+	ImportStats stats = fixIAT(image);
+	if (imports)
+		*imports = stats;
+
+	// headers and all sections in a single write
+	moduleBase.write(image.data(), image.size());
+
+	initializeImage(image, (HMODULE)moduleBase.address());
+	return image;
+}
+
+void Process::initializeImage(const PeImage& image, HMODULE hModule)
+{
+	// call all tls callbacks
+	const IMAGE_DATA_DIRECTORY& tlsDir = image.directory(IMAGE_DIRECTORY_ENTRY_TLS);
+	if (tlsDir.Size)
+	{
+		IMAGE_TLS_DIRECTORY imgTlsDir = *image.at<IMAGE_TLS_DIRECTORY>(tlsDir.VirtualAddress);
+		callTlsInitializers(hModule, DLL_PROCESS_ATTACH, imgTlsDir);
+	}
+
+	// call entry point
+	if (image.ntHeader().OptionalHeader.AddressOfEntryPoint)
+		remoteDllMainCall((LPVOID)((DWORD_PTR)hModule + image.ntHeader().OptionalHeader.AddressOfEntryPoint), hModule, DLL_PROCESS_ATTACH, nullptr);
+}
+
+Reload Process::reloadRemoteModule(const PeImage& prepared, MappedImages& images, WorkPool* pool)
+{
+	const auto start = std::chrono::steady_clock::now();
+	const SIZE_T pageSize = 0x1000;
+	Reload reload;
+
+	try
+	{
+		// the old mapping has to still be there, the target may have freed it and reused the
+		// address. before anything in it is called or patched, the header page and the page of
+		// the entry point have to read back as they were written
+		MappedImages::Image* old = images.find(prepared.path());
+		if (old)
+		{
+			MEMORY_BASIC_INFORMATION mbi = memBasicInfo((void*)old->base);
+			bool same = (uintptr_t)mbi.AllocationBase == old->base && mbi.State == MEM_COMMIT && mbi.Type == MEM_PRIVATE;
+
+			vector<size_t> pages = { 0 };
+			if (old->entryPoint / pageSize != 0)
+				pages.push_back(old->entryPoint / pageSize);
+			same = same && pages.back() < old->pageHashes.size();
+			if (same)
+			{
+				vector<byte> contents(pages.size() * pageSize);
+				vector<IoSpan> spans;
+				for (size_t i = 0; i < pages.size(); i++)
+					spans.push_back({ old->base + pages[i] * pageSize, contents.data() + i * pageSize, pageSize });
+				try
+				{
+					readv(spans, 0);
+				}
+				catch (...)
+				{
+					same = false;
+				}
+				for (size_t i = 0; same && i < pages.size(); i++)
+					same = MappedImages::pageHashes(contents.data() + i * pageSize, pageSize)[0] == old->pageHashes[pages[i]];
+			}
+
+			if (!same)
+			{
+				if (Log::enabled(Log::Info))
+					Log::info("old mapping gone", { { "dll", old->path.filename().wstring() }, { "base", (void*)old->base } });
+				images.erase(fs::path(old->path));
+				old = nullptr;
+			}
+		}
+
+		if (old && old->entryPoint)
+			remoteDllMainCall((LPVOID)(old->base + old->entryPoint), (HMODULE)old->base, DLL_PROCESS_DETACH, nullptr);
+
+		MappedImages::Image entry = { prepared.path(), 0, prepared.size(), prepared.ntHeader().OptionalHeader.AddressOfEntryPoint };
+		if (old && prepared.size() <= old->size)
+		{
+			PeImage image = prepared.relocated(old->base, pool);
+			reload.imports = fixIAT(image);
+			entry.base = old->base;
+			entry.size = old->size;
+			entry.pageHashes = MappedImages::pageHashes(image.data(), image.size(), pool);
+
+			// writable sections hold whatever the old build left in them, so they are always
+			// rewritten, the rest only where the contents as written differ
+			vector<bool> write(entry.pageHashes.size(), false);
+			const IMAGE_NT_HEADERS& nt_header = image.ntHeader();
+			const IMAGE_SECTION_HEADER* section = IMAGE_FIRST_SECTION(&nt_header);
+			for (int i = 0; i < nt_header.FileHeader.NumberOfSections; i++, section++)
+			{
+				if (!(section->Characteristics & IMAGE_SCN_MEM_WRITE))
+					continue;
+				const SIZE_T end = (std::min)((SIZE_T)section->VirtualAddress + (std::max)(section->Misc.VirtualSize, section->SizeOfRawData), (SIZE_T)image.size());
+				for (SIZE_T page = section->VirtualAddress / pageSize; page * pageSize < end; page++)
+					write[page] = true;
+			}
+
+			vector<IoSpan> spans;
+			for (size_t page = 0; page < write.size(); page++)
+			{
+				if (write[page] || page >= old->pageHashes.size() || entry.pageHashes[page] != old->pageHashes[page])
+				{
+					const SIZE_T offset = page * pageSize;
+					spans.push_back({ old->base + offset, (void*)(image.data() + offset), (std::min)(pageSize, (SIZE_T)image.size() - offset) });
+				}
+			}
+			writev(spans);
+			if (!FlushInstructionCache(handle(), (void*)old->base, image.size()))
+			{
+				DWORD errcode = GetLastError();
+				BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("FlushInstructionCache") << e_text("could not flush instruction cache") << e_last_error(errcode) << e_process(*this));
+			}
+
+			initializeImage(image, (HMODULE)old->base);
+			reload.inPlace = true;
+			reload.pages = write.size();
+			reload.pagesWritten = spans.size();
+		}
+		else
+		{
+			// the new build doesn't fit, the old one goes and the new one is mapped anew
+			if (old)
+			{
+				if (!VirtualFreeEx(handle(), (void*)old->base, 0, MEM_RELEASE))
+				{
+					DWORD errcode = GetLastError();
+					BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("VirtualFreeEx") << e_text("could not free the old mapping") << e_last_error(errcode) << e_process(*this));
+				}
+				Metrics::add(Metrics::RemoteFree);
+			}
+
+			PeImage image = mapImage(prepared, pool, &reload.imports);
+			entry.base = (uintptr_t)image.ntHeader().OptionalHeader.ImageBase;
+			entry.pageHashes = MappedImages::pageHashes(image.data(), image.size(), pool);
+			reload.pages = reload.pagesWritten = entry.pageHashes.size();
+		}
+
+		images.update(entry);
+		images.save();
+		reload.module = isInjected((HMODULE)entry.base);
+		reload.latency = std::chrono::steady_clock::now() - start;
+		Metrics::add(reload.inPlace ? Metrics::ReloadHit : Metrics::ReloadMiss);
+		return reload;
+	}
+	catch (...)
+	{
+		BOOST_THROW_EXCEPTION(ex("failed to reload PE file") << e_library(prepared.path()) << e_process(*this) <<
+			boost::errinfo_nested_exception(boost::current_exception()));
+	}
+}
@@ -2,6 +2,7 @@
 #include "injectory/common.hpp"
 #include "injectory/process.hpp"
 #include "injectory/api.hpp"
+#include "injectory/ledger.hpp"
 
 class MemoryAreaBase
 {
@@ -9,14 +10,32 @@ protected:
 	Process process; //keeps from closing the process handle, among other things
 	shared_ptr<void> address_;
 
-	MemoryAreaBase(const Process& process, void* address, bool freeOnDestruction = true)
+	MemoryAreaBase(const Process& process, void* address, bool freeOnDestruction = true, optional<Ledger::Id> ledgerId = nullopt)
 		: process(process)
 	{
 		if (freeOnDestruction)
-			address_ = shared_ptr<void>(address, bind(VirtualFreeEx, process.handle(), std::placeholders::_1, 0, MEM_RELEASE));
+		{
+			HANDLE h = process.handle();
+			address_ = shared_ptr<void>(address, [h, ledgerId](void* p)
+			{
+				Metrics::add(Metrics::RemoteFree);
+				if (VirtualFreeEx(h, p, 0, MEM_RELEASE) && ledgerId)
+					Ledger::instance().released(*ledgerId);
+			});
+		}
 		else
 			address_ = shared_ptr<void>(address, [](void*){});
 	}
+
+	// allocates in process and records the allocation in the ledger
+	static void* allocate(const Process& proc, const string& purpose, void* addressHint, SIZE_T size,
+		DWORD allocationType, DWORD protect, bool freeOnDestruction, optional<Ledger::Id>& ledgerId)
+	{
+		void* address = VirtualAllocEx_Throwing(proc, addressHint, size, allocationType, protect);
+		if (allocationType & MEM_COMMIT)
+			ledgerId = Ledger::instance().record(proc.id(), address, size, protect, purpose, freeOnDestruction);
+		return address;
+	}
 	virtual ~MemoryAreaBase()
 	{}
 
@@ -40,21 +59,22 @@ public:
 
 class MemoryArea : public MemoryAreaBase
 {
-	friend MemoryArea Process::alloc(SIZE_T, bool, DWORD, DWORD, void*);
+	friend MemoryArea Process::alloc(SIZE_T, const string&, bool, DWORD, DWORD, void*);
 	friend MemoryArea Process::memory(void*, SIZE_T);
 protected:
 	const SIZE_T size_;
 
-	MemoryArea(const Process& process, void* address, SIZE_T size, bool freeOnDestruction = true)
-		: MemoryAreaBase(process, address, freeOnDestruction)
+	MemoryArea(const Process& process, void* address, SIZE_T size, bool freeOnDestruction = true, optional<Ledger::Id> ledgerId = nullopt)
+		: MemoryAreaBase(process, address, freeOnDestruction, ledgerId)
 		, size_(size)
 	{}
 
-	static MemoryArea alloc(const Process& proc, SIZE_T size, bool freeOnDestruction,
+	static MemoryArea alloc(const Process& proc, SIZE_T size, const string& purpose, bool freeOnDestruction,
 		DWORD allocationType, DWORD protect, void* addressHint)
 	{
-		void* address = VirtualAllocEx_Throwing(proc, addressHint, size, allocationType, protect);
-		return MemoryArea(proc, address, size, freeOnDestruction);
+		optional<Ledger::Id> ledgerId;
+		void* address = allocate(proc, purpose, addressHint, size, allocationType, protect, freeOnDestruction, ledgerId);
+		return MemoryArea(proc, address, size, freeOnDestruction, ledgerId);
 	}
 
 public:
@@ -85,16 +105,17 @@ public:
 template<typename T>
 class MemoryAreaT : public MemoryAreaBase
 {
-	friend MemoryAreaT<T> Process::alloc(bool, DWORD, DWORD, void*);
+	friend MemoryAreaT<T> Process::alloc(const string&, bool, DWORD, DWORD, void*);
 	friend MemoryAreaT<T> Process::memory(void*);
 protected:
 	using MemoryAreaBase::MemoryAreaBase;
 
-	static MemoryAreaT<T> alloc(const Process& proc, bool freeOnDestruction,
+	static MemoryAreaT<T> alloc(const Process& proc, const string& purpose, bool freeOnDestruction,
 		DWORD allocationType, DWORD protect, void* addressHint)
 	{
-		void* area = VirtualAllocEx_Throwing(proc, addressHint, sizeof(T), allocationType, protect);
-		return MemoryAreaT<T>(proc, area, freeOnDestruction);
+		optional<Ledger::Id> ledgerId;
+		void* area = allocate(proc, purpose, addressHint, sizeof(T), allocationType, protect, freeOnDestruction, ledgerId);
+		return MemoryAreaT<T>(proc, area, freeOnDestruction, ledgerId);
 	}
 
 	virtual SIZE_T size() const override
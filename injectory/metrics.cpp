@@ -0,0 +1,207 @@
+#include "injectory/metrics.hpp"
+#include <cstdio>
+
+namespace
+{
+	struct Series
+	{
+		const char* name;
+		const char* labels;
+	};
+
+	// one line per counter, the lines of one metric have to follow each other
+	const Series series[Metrics::Counters] =
+	{
+		{ "injectory_injections_total",				"kind=\"inject\"" },
+		{ "injectory_injections_total",				"kind=\"map\"" },
+		{ "injectory_injections_total",				"kind=\"reload\"" },
+		{ "injectory_injections_total",				"kind=\"eject\"" },
+		{ "injectory_remote_operations_total",		"op=\"read\"" },
+		{ "injectory_remote_operations_total",		"op=\"write\"" },
+		{ "injectory_remote_operations_total",		"op=\"allocate\"" },
+		{ "injectory_remote_operations_total",		"op=\"free\"" },
+		{ "injectory_remote_operations_total",		"op=\"query\"" },
+		{ "injectory_remote_operations_total",		"op=\"thread\"" },
+		{ "injectory_remote_bytes_written_total",	"" },
+		{ "injectory_cache_hits_total",				"cache=\"payload\"" },
+		{ "injectory_cache_hits_total",				"cache=\"reload\"" },
+		{ "injectory_cache_hits_total",				"cache=\"process-info\"" },
+		{ "injectory_cache_misses_total",			"cache=\"payload\"" },
+		{ "injectory_cache_misses_total",			"cache=\"reload\"" },
+		{ "injectory_cache_misses_total",			"cache=\"process-info\"" },
+	};
+
+	const std::map<std::string, const char*> help =
+	{
+		{ "injectory_injections_total",				"Libraries injected, mapped, reloaded and ejected." },
+		{ "injectory_remote_operations_total",		"Calls that read, write, allocate, free or query memory of a target or start a thread in it." },
+		{ "injectory_remote_bytes_written_total",	"Bytes written to targets." },
+		{ "injectory_cache_hits_total",				"Work found already done." },
+		{ "injectory_cache_misses_total",			"Work that had to be done." },
+	};
+
+	struct HistogramSeries
+	{
+		const char* name;
+		const char* help;
+	};
+
+	const HistogramSeries histograms[Metrics::Histograms] =
+	{
+		{ "injectory_suspension_seconds", "Time targets spent suspended by injectory." },
+	};
+
+	std::string number(double v)
+	{
+		char buf[32];
+		std::snprintf(buf, sizeof(buf), "%.9g", v);
+		return buf;
+	}
+}
+
+Metrics::Shard::Shard()
+{
+	for (auto& c : counters)
+		c.store(0, std::memory_order_relaxed);
+	for (auto& h : buckets)
+	{
+		for (auto& b : h)
+			b.store(0, std::memory_order_relaxed);
+	}
+	for (auto& s : sumNanos)
+		s.store(0, std::memory_order_relaxed);
+}
+
+Metrics& Metrics::instance()
+{
+	static Metrics metrics;
+	return metrics;
+}
+
+Metrics::Shard& Metrics::shard()
+{
+	thread_local Shard* own = nullptr;
+	if (!own)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		shards.push_back(std::make_unique<Shard>());
+		own = shards.back().get();
+	}
+	return *own;
+}
+
+void Metrics::observe(Histogram histogram, clock::duration d)
+{
+	const double seconds = std::chrono::duration<double>(d).count();
+	size_t bucket = 0;
+	while (bucket < bucketCount - 1 && seconds > bounds[bucket])
+		bucket++;
+
+	Shard& s = instance().shard();
+	bump(s.buckets[histogram][bucket], 1);
+	bump(s.sumNanos[histogram], (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+void Metrics::failure(const std::string& errorClass)
+{
+	Shard& s = instance().shard();
+	std::lock_guard<std::mutex> lock(s.mutex);
+	s.failures[errorClass]++;
+}
+
+void Metrics::suspended(uint64_t pid)
+{
+	Metrics& m = instance();
+	std::lock_guard<std::mutex> lock(m.mutex);
+	auto& [since, nested] = m.suspended_[pid];
+	if (nested++ == 0)
+		since = clock::now();
+}
+
+void Metrics::resumed(uint64_t pid)
+{
+	Metrics& m = instance();
+	clock::duration window;
+	{
+		std::lock_guard<std::mutex> lock(m.mutex);
+		auto it = m.suspended_.find(pid);
+		if (it == m.suspended_.end() || --it->second.second > 0)
+			return;
+		window = clock::now() - it->second.first;
+		m.suspended_.erase(it);
+	}
+	observe(SuspensionWindow, window);
+}
+
+void Metrics::forget(uint64_t pid)
+{
+	Metrics& m = instance();
+	std::lock_guard<std::mutex> lock(m.mutex);
+	m.suspended_.erase(pid);
+}
+
+std::string Metrics::text()
+{
+	Metrics& m = instance();
+	uint64_t counters[Counters] = {};
+	uint64_t buckets[Histograms][bucketCount] = {};
+	uint64_t sumNanos[Histograms] = {};
+	std::map<std::string, uint64_t> failures;
+	{
+		// the shards only grow, values read while their owners write are at most one record behind
+		std::lock_guard<std::mutex> lock(m.mutex);
+		for (const std::unique_ptr<Shard>& s : m.shards)
+		{
+			for (size_t i = 0; i < Counters; i++)
+				counters[i] += s->counters[i].load(std::memory_order_relaxed);
+			for (size_t h = 0; h < Histograms; h++)
+			{
+				for (size_t b = 0; b < bucketCount; b++)
+					buckets[h][b] += s->buckets[h][b].load(std::memory_order_relaxed);
+				sumNanos[h] += s->sumNanos[h].load(std::memory_order_relaxed);
+			}
+			std::lock_guard<std::mutex> shardLock(s->mutex);
+			for (const auto& [errorClass, n] : s->failures)
+				failures[errorClass] += n;
+		}
+	}
+
+	std::string out;
+	const char* last = "";
+	for (size_t i = 0; i < Counters; i++)
+	{
+		const Series& c = series[i];
+		if (std::string(c.name) != last)
+		{
+			out += std::string("# HELP ") + c.name + " " + help.at(c.name) + "\n";
+			out += std::string("# TYPE ") + c.name + " counter\n";
+			last = c.name;
+		}
+		out += c.name;
+		if (*c.labels)
+			out += std::string("{") + c.labels + "}";
+		out += " " + std::to_string(counters[i]) + "\n";
+	}
+
+	out += "# HELP injectory_failures_total Targets that failed, by the class of the error.\n";
+	out += "# TYPE injectory_failures_total counter\n";
+	for (const auto& [errorClass, n] : failures)
+		out += "injectory_failures_total{class=\"" + errorClass + "\"} " + std::to_string(n) + "\n";
+
+	for (size_t h = 0; h < Histograms; h++)
+	{
+		const std::string name = histograms[h].name;
+		out += "# HELP " + name + " " + histograms[h].help + "\n";
+		out += "# TYPE " + name + " histogram\n";
+		uint64_t cumulative = 0;
+		for (size_t b = 0; b < bucketCount; b++)
+		{
+			cumulative += buckets[h][b];
+			const std::string le = b < bucketCount - 1 ? number(bounds[b]) : "+Inf";
+			out += name + "_bucket{le=\"" + le + "\"} " + std::to_string(cumulative) + "\n";
+		}
+		out += name + "_sum " + number(sumNanos[h] / 1e9) + "\n";
+		out += name + "_count " + std::to_string(cumulative) + "\n";
+	}
+	return out;
+}
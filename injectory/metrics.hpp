@@ -0,0 +1,96 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// cumulative counters and histograms of a run in the Prometheus text format. every thread records
+// into its own shard, which only it writes, so recording is a load and a store without locking or
+// contention, and the shards are only summed up when the text is asked for
+class Metrics
+{
+public:
+	enum Counter
+	{
+		Injected,
+		Mapped,
+		Reloaded,
+		Ejected,
+		RemoteRead,
+		RemoteWrite,
+		RemoteAllocate,
+		RemoteFree,
+		RemoteQuery,
+		RemoteThread,
+		BytesWritten,
+		PayloadHit,		// a --map payload already parsed for an earlier target
+		ReloadHit,		// a --reload patched in place
+		ProcessInfoHit,	// path, bitness, creation time, PEB or image base of a target asked again
+		PayloadMiss,
+		ReloadMiss,
+		ProcessInfoMiss,
+		Counters
+	};
+
+	enum Histogram
+	{
+		SuspensionWindow,	// from suspending a target until it is resumed
+		Histograms
+	};
+
+	using clock = std::chrono::steady_clock;
+
+	// upper bounds in seconds, the last bucket is +Inf
+	static constexpr double bounds[] = { 0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1, 2, 5 };
+	static constexpr size_t bucketCount = sizeof(bounds) / sizeof(bounds[0]) + 1;
+
+private:
+	struct Shard
+	{
+		std::atomic<uint64_t> counters[Counters];
+		std::atomic<uint64_t> buckets[Histograms][bucketCount];
+		std::atomic<uint64_t> sumNanos[Histograms];
+
+		// failures are rare and their classes open ended, the owner takes the lock only to record one
+		std::mutex mutex;
+		std::map<std::string, uint64_t> failures;
+
+		Shard();
+	};
+
+	std::mutex mutex;
+	std::vector<std::unique_ptr<Shard>> shards;	// kept after their thread exits, the counts are cumulative
+	std::map<uint64_t, std::pair<clock::time_point, int>> suspended_;	// pid -> since, nested suspensions
+
+	Shard& shard();
+
+	// single writer, no locked add needed
+	static void bump(std::atomic<uint64_t>& a, uint64_t n)
+	{
+		a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+public:
+	static void add(Counter counter, uint64_t n = 1)
+	{
+		bump(instance().shard().counters[counter], n);
+	}
+
+	static void observe(Histogram histogram, clock::duration d);
+
+	// class as exception_class names it
+	static void failure(const std::string& errorClass);
+
+	// Process::suspend and resume, the window is observed when the last suspension is lifted
+	static void suspended(uint64_t pid);
+	static void resumed(uint64_t pid);
+	static void forget(uint64_t pid);
+
+	static std::string text();
+
+	static Metrics& instance();
+};
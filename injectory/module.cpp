@@ -42,10 +42,28 @@ wstring Module::mappedFilename(bool throwOnFail) const
 
 void Module::eject()
 {
-	PTHREAD_START_ROUTINE freeLibrary = (PTHREAD_START_ROUTINE)Module::kernel32().getProcAddress("FreeLibrary");
+	static const PTHREAD_START_ROUTINE freeLibrary = (PTHREAD_START_ROUTINE)Module::kernel32().getProcAddress("FreeLibrary");
 	process.runInHiddenThread(freeLibrary, handle());
 }
 
+vector<string> Module::imports() const
+{
+	if (process != Process::current)
+		return load(path(), DONT_RESOLVE_DLL_REFERENCES).imports();
+
+	const byte* base = (const byte*)handle();
+	const IMAGE_DOS_HEADER& dos_header = *(const IMAGE_DOS_HEADER*)base;
+	const IMAGE_NT_HEADERS& nt_header = *(const IMAGE_NT_HEADERS*)(base + dos_header.e_lfanew);
+	const IMAGE_DATA_DIRECTORY& dir = nt_header.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+
+	vector<string> names;
+	if (!dir.Size)
+		return names;
+	for (auto desc = (const IMAGE_IMPORT_DESCRIPTOR*)(base + dir.VirtualAddress); desc->Name; desc++)
+		names.push_back((const char*)(base + desc->Name));
+	return names;
+}
+
 IMAGE_DOS_HEADER Module::dosHeader()
 {
 	return process.memory<IMAGE_DOS_HEADER>(handle());
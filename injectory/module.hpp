@@ -11,6 +11,9 @@ class Module : public Handle<HINSTANCE__>
 	friend Module Process::isInjected(HMODULE);
 	friend Module Process::isInjected(const Library&);
 	friend Module Process::map(const File& file);
+	friend vector<Module> Process::getInjected(const vector<Library>&);
+	friend void Process::listModules();
+	friend class ExportTrigger;
 private:
 	Process process;
 
@@ -63,6 +66,8 @@ public:
 	fs::path path() const;
 	wstring mappedFilename(bool throwOnFail = true) const;
 	void eject();
+	// names of the dlls in the import directory, remote modules are loaded locally without running them
+	vector<string> imports() const;
 
 	IMAGE_DOS_HEADER dosHeader();
 	IMAGE_NT_HEADERS ntHeader();
@@ -176,10 +181,37 @@ public:
 		ThreadHideFromDebugger
 	};
 
+	enum MY_PROCESS_INFORMATION_CLASS
+	{
+		ProcessBasicInformation = 0,
+		ProcessCommandLineInformation = 60,	// windows 8.1 and later
+	};
+
+	// STATUS_INFO_LENGTH_MISMATCH, ntstatus.h doesn't go together with windows.h
+	static const NTSTATUS infoLengthMismatch = (NTSTATUS)0xC0000004L;
+
+	struct MY_UNICODE_STRING
+	{
+		USHORT Length;			// in bytes
+		USHORT MaximumLength;
+		PWSTR Buffer;
+	};
+
+	struct MY_PROCESS_BASIC_INFORMATION
+	{
+		NTSTATUS ExitStatus;
+		PVOID PebBaseAddress;
+		ULONG_PTR AffinityMask;
+		LONG BasePriority;
+		ULONG_PTR UniqueProcessId;
+		ULONG_PTR InheritedFromUniqueProcessId;
+	};
+
 public:
 	const function<NTSTATUS(HANDLE)> ntResumeProcess_;
 	const function<NTSTATUS(HANDLE)> ntSuspendProcess_;
 	const function<NTSTATUS(HANDLE, MY_THREAD_INFORMATION_CLASS, PVOID, ULONG)> ntSetInformationThread_;
+	const function<NTSTATUS(HANDLE, MY_PROCESS_INFORMATION_CLASS, PVOID, ULONG, PULONG)> ntQueryInformationProcess_;
 
 public:
 	ModuleNtdll()
@@ -187,6 +219,7 @@ public:
 		, ntResumeProcess_(getProcAddress<NTSTATUS(HANDLE)>("NtResumeProcess"))
 		, ntSuspendProcess_(getProcAddress<NTSTATUS(HANDLE)>("NtSuspendProcess"))
 		, ntSetInformationThread_(getProcAddress<NTSTATUS(HANDLE, MY_THREAD_INFORMATION_CLASS, PVOID, ULONG)>("NtSetInformationThread"))
+		, ntQueryInformationProcess_(getProcAddress<NTSTATUS(HANDLE, MY_PROCESS_INFORMATION_CLASS, PVOID, ULONG, PULONG)>("NtQueryInformationProcess"))
 	{}
 
 
@@ -216,4 +249,11 @@ public:
 		if (!NT_SUCCESS(status))
 			BOOST_THROW_EXCEPTION(ex() << e_thread(thread) << e_api_function("NtSetInformationThread") << e_nt_status(status));
 	}
+
+	void ntQueryInformationProcess(const Process& proc, MY_PROCESS_INFORMATION_CLASS infoClass, void* info, unsigned long infoLength) const
+	{
+		NTSTATUS status = ntQueryInformationProcess_(proc.handle(), infoClass, info, infoLength, nullptr);
+		if (!NT_SUCCESS(status))
+			BOOST_THROW_EXCEPTION(ex("could not query process information") << e_process(proc) << e_api_function("NtQueryInformationProcess") << e_nt_status(status));
+	}
 };
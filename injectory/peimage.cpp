@@ -0,0 +1,304 @@
+#include "injectory/peimage.hpp"
+#include "injectory/file.hpp"
+#include <boost/algorithm/string.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <algorithm>
+namespace ip = boost::interprocess;
+
+PeImage PeImage::load(const fs::path& path, bool checkOnly)
+{
+	// fails with a proper error if the file can't be opened
+	File file = File::create(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL);
+
+	ip::file_mapping m_file(path.string().c_str(), ip::read_only);
+	ip::mapped_region region(m_file, ip::read_only);
+	const byte* data = (const byte*)region.get_address();
+	const size_t fileSize = region.get_size();
+
+	auto check = [&](bool ok, const string& what)
+	{
+		if (!ok)
+			BOOST_THROW_EXCEPTION(ex_map_remote() << e_text(what) << e_file(path));
+	};
+
+	check(fileSize >= sizeof(IMAGE_DOS_HEADER), "file too small");
+	const IMAGE_DOS_HEADER& dos_header = *(const IMAGE_DOS_HEADER*)data;
+	check(dos_header.e_magic == IMAGE_DOS_SIGNATURE, "invalid DOS header");
+	check(dos_header.e_lfanew > 0 && (size_t)dos_header.e_lfanew + sizeof(IMAGE_NT_HEADERS) <= fileSize, "invalid DOS header");
+
+	const IMAGE_NT_HEADERS& nt_header = *(const IMAGE_NT_HEADERS*)(data + dos_header.e_lfanew);
+	check(nt_header.Signature == IMAGE_NT_SIGNATURE, "invalid PE header");
+	check(nt_header.OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR_MAGIC, "image bitness doesn't match injectory");
+
+	const size_t sizeOfImage = nt_header.OptionalHeader.SizeOfImage;
+	const size_t sizeOfHeaders = nt_header.OptionalHeader.SizeOfHeaders;
+	check(sizeOfHeaders <= fileSize && sizeOfHeaders <= sizeOfImage &&
+		dos_header.e_lfanew + sizeof(IMAGE_NT_HEADERS) <= sizeOfHeaders, "invalid SizeOfHeaders");
+
+	PeImage pe;
+	pe.path_ = path;
+	pe.image_.assign(sizeOfImage, 0);
+	memcpy(pe.image_.data(), data, sizeOfHeaders);
+
+	// lay out the sections at their virtual addresses
+	const IMAGE_SECTION_HEADER* section = IMAGE_FIRST_SECTION(&nt_header);
+	check((const byte*)(section + nt_header.FileHeader.NumberOfSections) <= data + sizeOfHeaders, "invalid section table");
+	for (int i = 0; i < nt_header.FileHeader.NumberOfSections; i++, section++)
+	{
+		size_t rawSize = section->SizeOfRawData;
+		if (section->Misc.VirtualSize)
+			rawSize = (std::min)(rawSize, (size_t)section->Misc.VirtualSize);
+		if (rawSize == 0)
+			continue;
+		check(section->PointerToRawData + rawSize <= fileSize && section->VirtualAddress + rawSize <= sizeOfImage,
+			"section out of bounds");
+		memcpy(pe.image_.data() + section->VirtualAddress, data + section->PointerToRawData, rawSize);
+	}
+
+	// the builds of the dependencies the IAT was bound against, if it was
+	map<string, std::pair<DWORD, vector<std::pair<string, DWORD>>>> bound;
+	const IMAGE_DATA_DIRECTORY& boundDir = pe.directory(IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT);
+	for (DWORD offset = 0; offset + sizeof(IMAGE_BOUND_IMPORT_DESCRIPTOR) <= boundDir.Size; )
+	{
+		const IMAGE_BOUND_IMPORT_DESCRIPTOR desc = *pe.at<IMAGE_BOUND_IMPORT_DESCRIPTOR>(boundDir.VirtualAddress + offset);
+		if (!desc.OffsetModuleName)
+			break;
+		offset += sizeof(IMAGE_BOUND_IMPORT_DESCRIPTOR);
+
+		auto& entry = bound[boost::to_lower_copy(pe.stringAt(boundDir.VirtualAddress + desc.OffsetModuleName))];
+		entry.first = desc.TimeDateStamp;
+		for (WORD i = 0; i < desc.NumberOfModuleForwarderRefs; i++, offset += sizeof(IMAGE_BOUND_FORWARDER_REF))
+		{
+			const IMAGE_BOUND_FORWARDER_REF ref = *pe.at<IMAGE_BOUND_FORWARDER_REF>(boundDir.VirtualAddress + offset);
+			entry.second.push_back({ pe.stringAt(boundDir.VirtualAddress + ref.OffsetModuleName), ref.TimeDateStamp });
+		}
+	}
+
+	// imports, resolved per target since they depend on where the target has its modules
+	const IMAGE_DATA_DIRECTORY& importDir = pe.directory(IMAGE_DIRECTORY_ENTRY_IMPORT);
+	if (importDir.Size)
+	{
+		for (DWORD rva = importDir.VirtualAddress; ; rva += sizeof(IMAGE_IMPORT_DESCRIPTOR))
+		{
+			const IMAGE_IMPORT_DESCRIPTOR desc = *pe.at<IMAGE_IMPORT_DESCRIPTOR>(rva);
+			if (!desc.Name)
+				break;
+
+			Import import;
+			import.module = pe.stringAt(desc.Name);
+			import.iatRva = desc.FirstThunk;
+
+			// a stamp of -1 means see the bound import directory, any other non-zero stamp is an old
+			// style binding, only usable without forwarders. either way the names must be separate
+			if (desc.OriginalFirstThunk && desc.TimeDateStamp == (DWORD)-1)
+			{
+				auto it = bound.find(boost::to_lower_copy(import.module));
+				if (it != bound.end())
+				{
+					import.boundTimeStamp = it->second.first;
+					import.boundForwarders = it->second.second;
+				}
+			}
+			else if (desc.OriginalFirstThunk && desc.TimeDateStamp != 0 && desc.ForwarderChain == (DWORD)-1)
+				import.boundTimeStamp = desc.TimeDateStamp;
+
+			// the name table, or the IAT itself when the linker left no separate one
+			DWORD thunkRva = desc.OriginalFirstThunk ? desc.OriginalFirstThunk : desc.FirstThunk;
+			for (;; thunkRva += sizeof(IMAGE_THUNK_DATA))
+			{
+				const IMAGE_THUNK_DATA thunk = *pe.at<IMAGE_THUNK_DATA>(thunkRva);
+				if (!thunk.u1.AddressOfData)
+					break;
+				if (IMAGE_SNAP_BY_ORDINAL(thunk.u1.Ordinal))
+				{
+					if (!checkOnly)
+						BOOST_THROW_EXCEPTION(ex_map_remote() << e_text("import by ordinal from " + import.module + " not supported") << e_file(path));
+					import.names.push_back("#" + to_string(IMAGE_ORDINAL(thunk.u1.Ordinal)));
+				}
+				else
+					import.names.push_back(pe.stringAt((DWORD)thunk.u1.AddressOfData + offsetof(IMAGE_IMPORT_BY_NAME, Name)));
+			}
+			pe.at<IMAGE_THUNK_DATA>(import.iatRva, import.names.size());
+			pe.imports_.push_back(std::move(import));
+		}
+	}
+
+	// delay imports are only checked and listed, they stay lazy
+	const IMAGE_DATA_DIRECTORY& delayDir = pe.directory(IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT);
+	if (delayDir.Size)
+	{
+		for (DWORD rva = delayDir.VirtualAddress; ; rva += sizeof(IMAGE_DELAYLOAD_DESCRIPTOR))
+		{
+			const IMAGE_DELAYLOAD_DESCRIPTOR desc = *pe.at<IMAGE_DELAYLOAD_DESCRIPTOR>(rva);
+			if (!desc.DllNameRVA)
+				break;
+
+			// descriptors from old linkers hold virtual addresses for the preferred base
+			auto toRva = [&](ULONGLONG v) { return (DWORD)(desc.Attributes.RvaBased ? v : v - nt_header.OptionalHeader.ImageBase); };
+
+			DelayImport import;
+			import.module = pe.stringAt(toRva(desc.DllNameRVA));
+			import.iatRva = toRva(desc.ImportAddressTableRVA);
+			import.moduleHandleRva = toRva(desc.ModuleHandleRVA);
+			for (DWORD thunkRva = toRva(desc.ImportNameTableRVA); ; thunkRva += sizeof(IMAGE_THUNK_DATA))
+			{
+				const IMAGE_THUNK_DATA thunk = *pe.at<IMAGE_THUNK_DATA>(thunkRva);
+				if (!thunk.u1.AddressOfData)
+					break;
+				if (IMAGE_SNAP_BY_ORDINAL(thunk.u1.Ordinal))
+					import.names.push_back("#" + to_string(IMAGE_ORDINAL(thunk.u1.Ordinal)));
+				else
+					import.names.push_back(pe.stringAt(toRva(thunk.u1.AddressOfData) + offsetof(IMAGE_IMPORT_BY_NAME, Name)));
+			}
+			pe.at<IMAGE_THUNK_DATA>(import.iatRva, import.names.size());
+			pe.at<HMODULE>(import.moduleHandleRva);
+			pe.delayImports_.push_back(std::move(import));
+		}
+	}
+
+	const IMAGE_DATA_DIRECTORY& relocDir = pe.directory(IMAGE_DIRECTORY_ENTRY_BASERELOC);
+	for (DWORD rva = relocDir.VirtualAddress; rva < relocDir.VirtualAddress + relocDir.Size; )
+	{
+		const IMAGE_BASE_RELOCATION& block = *pe.at<IMAGE_BASE_RELOCATION>(rva);
+		if (block.SizeOfBlock < sizeof(IMAGE_BASE_RELOCATION))
+			break;
+		pe.at<byte>(rva, block.SizeOfBlock);
+		pe.relocBlocks_.push_back(rva);
+		rva += block.SizeOfBlock;
+	}
+
+	return pe;
+}
+
+const IMAGE_NT_HEADERS& PeImage::ntHeader() const
+{
+	const IMAGE_DOS_HEADER& dos_header = *(const IMAGE_DOS_HEADER*)image_.data();
+	return *(const IMAGE_NT_HEADERS*)(image_.data() + dos_header.e_lfanew);
+}
+
+string PeImage::stringAt(DWORD rva) const
+{
+	const char* s = at<char>(rva);
+	size_t len = strnlen(s, image_.size() - rva);
+	if (rva + len == image_.size())
+		BOOST_THROW_EXCEPTION(ex_map_remote() << e_text("unterminated string") << e_file(path_));
+	return string(s, len);
+}
+
+size_t PeImage::fixups() const
+{
+	size_t n = 0;
+	for (DWORD rva : relocBlocks_)
+	{
+		const IMAGE_BASE_RELOCATION& block = *at<IMAGE_BASE_RELOCATION>(rva);
+		const WORD* entries = (const WORD*)(&block + 1);
+		const size_t count = (block.SizeOfBlock - sizeof(IMAGE_BASE_RELOCATION)) / sizeof(WORD);
+		for (size_t i = 0; i < count; i++)
+		{
+			if ((entries[i] >> 12) != IMAGE_REL_BASED_ABSOLUTE)
+				n++;
+		}
+	}
+	return n;
+}
+
+size_t PeImage::tlsCallbacks() const
+{
+	const IMAGE_DATA_DIRECTORY& tlsDir = directory(IMAGE_DIRECTORY_ENTRY_TLS);
+	if (!tlsDir.Size)
+		return 0;
+
+	// the array holds virtual addresses for the preferred base
+	const IMAGE_TLS_DIRECTORY& tls = *at<IMAGE_TLS_DIRECTORY>(tlsDir.VirtualAddress);
+	if (!tls.AddressOfCallBacks)
+		return 0;
+	const DWORD rva = (DWORD)((uintptr_t)tls.AddressOfCallBacks - ntHeader().OptionalHeader.ImageBase);
+
+	size_t n = 0;
+	while (*at<ULONG_PTR>(rva + (DWORD)(n * sizeof(ULONG_PTR))))
+		n++;
+	return n;
+}
+
+vector<string> PeImage::missingDependencies(const vector<fs::path>& dirs) const
+{
+	vector<string> missing;
+	for (const Import& import : imports_)
+	{
+		if (boost::istarts_with(import.module, "api-ms-") || boost::istarts_with(import.module, "ext-ms-"))
+			continue;
+		const wstring name = to_wstring(import.module);
+		if (GetModuleHandleW(name.c_str()))
+			continue;
+
+		boost::system::error_code ec;
+		bool found = std::any_of(dirs.begin(), dirs.end(), [&](const fs::path& dir) { return fs::is_regular_file(dir / name, ec); });
+		if (!found)
+			found = SearchPathW(nullptr, name.c_str(), nullptr, 0, nullptr, nullptr) != 0;
+		if (!found)
+			missing.push_back(import.module);
+	}
+	return missing;
+}
+
+PeImage PeImage::relocated(uintptr_t base, WorkPool* pool) const
+{
+	PeImage pe = *this;
+	LONG_PTR delta = (LONG_PTR)(base - ntHeader().OptionalHeader.ImageBase);
+	if (delta == 0)
+		return pe;
+
+	pe.at<IMAGE_NT_HEADERS>(pe.at<IMAGE_DOS_HEADER>(0)->e_lfanew)->OptionalHeader.ImageBase = base;
+
+	// every block covers one page, so blocks can be fixed up concurrently except for
+	// the rare fixups that straddle into the next page, those are done afterwards
+	const size_t blocks = relocBlocks_.size();
+	if (pool && pool->size() > 1 && blocks >= 64)
+	{
+		pool->parallelFor(blocks, 32, [&](size_t begin, size_t end) { pe.relocate(delta, begin, end, false); });
+		pe.relocate(delta, 0, blocks, true);
+	}
+	else
+	{
+		pe.relocate(delta, 0, blocks, false);
+		pe.relocate(delta, 0, blocks, true);
+	}
+	return pe;
+}
+
+void PeImage::relocate(LONG_PTR delta, size_t firstBlock, size_t lastBlock, bool pageCrossing)
+{
+	const DWORD pageSize = 0x1000;
+	for (size_t b = firstBlock; b < lastBlock; b++)
+	{
+		const IMAGE_BASE_RELOCATION& block = *at<IMAGE_BASE_RELOCATION>(relocBlocks_[b]);
+		const WORD* entries = (const WORD*)(&block + 1);
+		const size_t count = (block.SizeOfBlock - sizeof(IMAGE_BASE_RELOCATION)) / sizeof(WORD);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const BYTE type = entries[i] >> 12;
+			const WORD offset = entries[i] & 0xFFF;
+
+			size_t size;
+			switch (type)
+			{
+			case IMAGE_REL_BASED_ABSOLUTE:	continue;
+			case IMAGE_REL_BASED_HIGHLOW:	size = sizeof(DWORD32); break;
+			case IMAGE_REL_BASED_DIR64:		size = sizeof(DWORD64); break;
+			default:
+				BOOST_THROW_EXCEPTION(ex_map_remote() << e_text("unsupported relocation type " + to_string(type)) << e_file(path_));
+			}
+
+			if ((offset + size > pageSize) != pageCrossing)
+				continue;
+
+			byte* target = at<byte>(block.VirtualAddress + offset, size);
+			if (type == IMAGE_REL_BASED_HIGHLOW)
+				*(DWORD32*)target += (DWORD32)delta;
+			else
+				*(DWORD64*)target += delta;
+		}
+	}
+}
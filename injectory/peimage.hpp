@@ -0,0 +1,115 @@
+#pragma once
+#include "injectory/common.hpp"
+#include "injectory/exception.hpp"
+#include "injectory/workpool.hpp"
+
+// a PE file read from disk and laid out the way the loader maps it. parsing, validating and
+// rebasing don't depend on the target, so they can run on a WorkPool ahead of time and the
+// result is shared by every target the file is mapped into
+class PeImage
+{
+public:
+	struct Import
+	{
+		string module;
+		DWORD iatRva;			// FirstThunk
+		vector<string> names;	// one per IAT slot, #N for an ordinal if the image was loaded to be checked only
+
+		// set when the IAT already holds addresses bound against this build of module
+		optional<DWORD> boundTimeStamp;
+		// the modules and builds those addresses forward into
+		vector<std::pair<string, DWORD>> boundForwarders;
+	};
+
+	// left as they are when mapping, the IAT slots point at the linker's load stubs in the
+	// image itself, which are relocated like any other code and load the dll on first call
+	struct DelayImport
+	{
+		string module;
+		DWORD iatRva;
+		DWORD moduleHandleRva;	// where the stub keeps the HMODULE once loaded
+		vector<string> names;	// "#n" for imports by ordinal
+	};
+
+private:
+	fs::path path_;
+	vector<byte> image_;		// SizeOfImage bytes, headers and sections at their rvas
+	vector<Import> imports_;
+	vector<DelayImport> delayImports_;
+	vector<DWORD> relocBlocks_;	// rvas of the IMAGE_BASE_RELOCATION blocks
+
+	PeImage() = default;
+
+public:
+	// the mapper can't resolve imports by ordinal and rejects them, an image that LoadLibrary maps
+	// and that is only loaded to be checked lists them as #N with checkOnly
+	static PeImage load(const fs::path& path, bool checkOnly = false);
+
+	const fs::path& path() const
+	{
+		return path_;
+	}
+
+	size_t size() const
+	{
+		return image_.size();
+	}
+
+	const byte* data() const
+	{
+		return image_.data();
+	}
+
+	const IMAGE_NT_HEADERS& ntHeader() const;
+
+	const IMAGE_DATA_DIRECTORY& directory(int index) const
+	{
+		return ntHeader().OptionalHeader.DataDirectory[index];
+	}
+
+	// a pointer to count T:s at rva, throws if they are not inside the image
+	template <typename T>
+	const T* at(DWORD rva, size_t count = 1) const
+	{
+		if (rva > image_.size() || (image_.size() - rva) / sizeof(T) < count)
+			BOOST_THROW_EXCEPTION(ex_map_remote() << e_text("rva out of bounds") << e_file(path_));
+		return (const T*)(image_.data() + rva);
+	}
+	template <typename T>
+	T* at(DWORD rva, size_t count = 1)
+	{
+		return const_cast<T*>(static_cast<const PeImage*>(this)->at<T>(rva, count));
+	}
+
+	const vector<Import>& imports() const
+	{
+		return imports_;
+	}
+
+	const vector<DelayImport>& delayImports() const
+	{
+		return delayImports_;
+	}
+
+	size_t relocationBlocks() const
+	{
+		return relocBlocks_.size();
+	}
+
+	// fixups applied when the image is rebased
+	size_t fixups() const;
+
+	// entries in the TLS callback array, each one is a remote call when mapping
+	size_t tlsCallbacks() const;
+
+	// imported modules LoadLibrary wouldn't find in dirs or on the standard search path.
+	// api sets and modules injectory has loaded itself always count as found
+	vector<string> missingDependencies(const vector<fs::path>& dirs) const;
+
+	// a copy of the image rebased to base. the fixups of large images are spread over the pool
+	PeImage relocated(uintptr_t base, WorkPool* pool = nullptr) const;
+
+private:
+	string stringAt(DWORD rva) const;
+	void relocate(LONG_PTR delta, size_t firstBlock, size_t lastBlock, bool pageCrossing);
+};
@@ -0,0 +1,153 @@
+#include "injectory/pipeline.hpp"
+#include "injectory/reactor.hpp"
+
+Pipeline::Pipeline(unsigned threadCount)
+	: queue(std::make_shared<Queue>())
+{
+	for (unsigned i = 0; i < (threadCount ? threadCount : 1); i++)
+		threads.emplace_back(&Pipeline::worker, this);
+}
+
+Pipeline::~Pipeline()
+{
+	{
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		queue->stopping = true;
+	}
+	queue->cv.notify_all();
+	for (std::thread& t : threads)
+		t.join();
+}
+
+std::future<Pipeline::clock::time_point> Pipeline::run(shared_ptr<Task> task)
+{
+	std::future<clock::time_point> future = task->done.get_future();
+	{
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		queue->inFlight++;
+	}
+	queue->post(task);
+	return future;
+}
+
+size_t Pipeline::inFlight()
+{
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	return queue->inFlight;
+}
+
+WinHandle Pipeline::timer(WinHandle& timer, DWORD millis)
+{
+	if (!timer)
+		timer = WinHandle(CreateWaitableTimerW(nullptr, TRUE, nullptr), CloseHandle);
+	LARGE_INTEGER due;
+	due.QuadPart = -(LONGLONG)millis * 10000; // relative, in 100ns
+	// setting a manual reset timer again also resets it
+	if (!timer || !SetWaitableTimer(timer.handle(), &due, 0, nullptr, nullptr, FALSE))
+	{
+		DWORD errcode = GetLastError();
+		BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("SetWaitableTimer") << e_text("could not create timer") << e_last_error(errcode));
+	}
+	return timer;
+}
+
+void Pipeline::Queue::post(shared_ptr<Task> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!stopping)
+			ready.push_back(std::move(task));
+	}
+	if (!task)
+		return cv.notify_one();
+
+	// back from the reactor while the pipeline is going away
+	try
+	{
+		BOOST_THROW_EXCEPTION(ex_injection() << e_text("pipeline stopped while the task was waiting"));
+	}
+	catch (...)
+	{
+		finish(*task, std::current_exception());
+	}
+}
+
+void Pipeline::Queue::finish(Task& task, std::exception_ptr error)
+{
+	if (error && task.onFailure_)
+	{
+		try
+		{
+			task.onFailure_();
+		}
+		catch (...)
+		{
+			// the failed step is what gets reported, onFailure reports its own problems
+		}
+	}
+
+	if (error)
+		task.done.set_exception(error);
+	else
+		task.done.set_value(clock::now());
+
+	// the steps may hold handles and memory of the target
+	task.steps_.clear();
+	task.steps_.shrink_to_fit();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	inFlight--;
+}
+
+void Pipeline::worker()
+{
+	for (;;)
+	{
+		shared_ptr<Task> task;
+		{
+			std::unique_lock<std::mutex> lock(queue->mutex);
+			queue->cv.wait(lock, [this] { return queue->stopping || !queue->ready.empty(); });
+			if (queue->ready.empty())
+				return;
+			task = std::move(queue->ready.front());
+			queue->ready.pop_front();
+		}
+
+		try
+		{
+			// run steps until one has to wait
+			while (task->next < task->steps_.size())
+			{
+				Await await = task->steps_[task->next]();
+				if (!await.retry)
+					task->next++;
+				if (await.handle)
+				{
+					// the queue and not the pipeline, which may be destroyed before the handle is signaled
+					WaitReactor::instance().watch(await.handle, [q = queue, task](DWORD waitResult)
+					{
+						if (waitResult != WAIT_FAILED)
+							return q->post(task);
+						// the next step would run while the remote thread or the target is still busy
+						try
+						{
+							BOOST_THROW_EXCEPTION(ex_wait_for_multiple_objects() << e_api_function("WaitForMultipleObjects") << e_text("could not wait for the next step"));
+						}
+						catch (...)
+						{
+							q->finish(*task, std::current_exception());
+						}
+					});
+					task = nullptr;
+					break;
+				}
+			}
+			if (task)
+				queue->finish(*task);
+		}
+		catch (...)
+		{
+			queue->finish(*task, std::current_exception());
+		}
+	}
+}
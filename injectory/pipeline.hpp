@@ -0,0 +1,118 @@
+#pragma once
+#include "injectory/common.hpp"
+#include "injectory/exception.hpp"
+#include "injectory/winhandle.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+
+// runs the steps of many tasks on a few threads. a step that would block on a remote thread,
+// a timer or a process instead returns the handle, and the task is parked in the WaitReactor
+// until it is signaled, so no thread is tied up while a target is waited for
+class Pipeline
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+	// what a step wants to happen next
+	struct Await
+	{
+		WinHandle handle;	// resume when signaled, empty to continue right away
+		bool retry = false;	// run the same step again instead of the next one
+
+		static Await next()
+		{
+			return {};
+		}
+		static Await on(const WinHandle& handle)
+		{
+			return { handle, false };
+		}
+		static Await retryAfter(const WinHandle& handle)
+		{
+			return { handle, true };
+		}
+	};
+
+	using Step = function<Await()>;
+
+	class Task
+	{
+		friend class Pipeline;
+	private:
+		vector<Step> steps_;
+		size_t next = 0;
+		std::promise<clock::time_point> done;
+		function<void()> onFailure_;
+
+	public:
+		Task& then(Step step)
+		{
+			steps_.push_back(std::move(step));
+			return *this;
+		}
+
+		// convenience for steps that never wait
+		Task& thenDo(function<void()> step)
+		{
+			return then(Step([step] { step(); return Await::next(); }));
+		}
+
+		// runs when a step failed, before the failure is handed to whoever waits for the task
+		Task& onFailure(function<void()> undo)
+		{
+			onFailure_ = std::move(undo);
+			return *this;
+		}
+
+		size_t steps() const
+		{
+			return steps_.size();
+		}
+
+		// bytes held by the task itself, without what its steps capture
+		size_t footprint() const
+		{
+			return sizeof(Task) + steps_.capacity() * sizeof(Step);
+		}
+	};
+
+private:
+	// shared with the reactor callbacks of parked tasks, which may run after the pipeline is gone.
+	// a task that comes back once it stopped fails instead of running on
+	struct Queue
+	{
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::deque<shared_ptr<Task>> ready;
+		size_t inFlight = 0;
+		bool stopping = false;
+
+		void post(shared_ptr<Task> task);
+		void finish(Task& task, std::exception_ptr error = nullptr);
+	};
+
+	shared_ptr<Queue> queue;
+	vector<std::thread> threads;
+
+public:
+	explicit Pipeline(unsigned threadCount);
+	Pipeline(const Pipeline&) = delete;
+	Pipeline& operator=(const Pipeline&) = delete;
+	~Pipeline();
+
+	// becomes ready with the time the last step finished, or with the exception of the failing step
+	std::future<clock::time_point> run(shared_ptr<Task> task);
+
+	size_t inFlight();
+
+	// sets timer to be signaled after millis and returns it, for polling steps. it is created on
+	// first use, a step that polls keeps one for all its rounds
+	static WinHandle timer(WinHandle& timer, DWORD millis);
+
+private:
+	void worker();
+};
@@ -0,0 +1,270 @@
+#include "injectory/plan.hpp"
+#include "injectory/module.hpp"
+#include "injectory/flags.hpp"
+#include <boost/algorithm/string.hpp>
+#include <chrono>
+
+namespace
+{
+	string lowerFilename(const fs::path& path)
+	{
+		return boost::to_lower_copy(path.filename().string());
+	}
+
+	string jsonCost(const Plan::Cost& c)
+	{
+		return (format("\"allocations\":%d,\"writes\":%d,\"bytesWritten\":%d,\"protectCalls\":%d,\"remoteThreads\":%d,\"addressSpaceScans\":%d")
+			% c.allocations % c.writes % c.bytesWritten % c.protectCalls % c.remoteThreads % c.scans).str();
+	}
+
+	string jsonPaths(const vector<fs::path>& paths)
+	{
+		string out = "[";
+		for (size_t i = 0; i < paths.size(); i++)
+			out += (i ? "," : "") + jsonString(paths[i].string());
+		return out + "]";
+	}
+}
+
+Plan::Cost& Plan::Cost::operator+=(const Cost& other)
+{
+	allocations += other.allocations;
+	writes += other.writes;
+	bytesWritten += other.bytesWritten;
+	protectCalls += other.protectCalls;
+	remoteThreads += other.remoteThreads;
+	scans += other.scans;
+	return *this;
+}
+
+Plan Plan::running(Process& proc)
+{
+	Plan plan;
+
+	const bool targetIs64bit = proc.is64bit();
+	if (targetIs64bit != is64bit)
+		plan.problem("target bitness doesn't match injectory");
+
+	// also a measurement of what one pass over the address space costs in this target
+	auto start = std::chrono::steady_clock::now();
+	vector<Module> modules = proc.modules();
+	plan.model.scanMillis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	for (const Module& module : modules)
+	{
+		wstring name = module.mappedFilename(false);
+		if (!name.empty())
+			plan.loaded.insert(lowerFilename(name));
+	}
+
+	plan.target = (format("{\"pid\":%d,\"path\":%s,\"bits\":%d,\"imageBase\":\"0x%x\",\"modules\":%d}")
+		% proc.id() % jsonString(proc.path().string()) % (targetIs64bit ? 64 : 32) % proc.imageBase() % plan.loaded.size()).str();
+	return plan;
+}
+
+Plan Plan::launched(const fs::path& exe)
+{
+	Plan plan;
+	plan.loaded = { "ntdll.dll", lowerFilename(exe) };
+	plan.target = (format("{\"launch\":%s,\"assumedModules\":[\"ntdll.dll\",%s]}")
+		% jsonString(exe.string()) % jsonString(exe.filename().string())).str();
+	return plan;
+}
+
+void Plan::flags(const vector<string>& set, const vector<string>& unset)
+{
+	for (const auto&[names, enable] : { std::make_pair(&set, true), std::make_pair(&unset, false) })
+	{
+		for (const string& name : *names)
+		{
+			const Flag* flag = Flags::find(name);
+			if (!flag)
+				problem("unknown flag '" + name + "'");
+			else if (flag->kind == Flag::Privilege)
+				privileges.push_back({ name, enable });
+			else
+				errorModes.push_back({ name, enable });
+		}
+	}
+}
+
+bool Plan::isLoaded(const fs::path& path) const
+{
+	return loaded.count(lowerFilename(path)) > 0;
+}
+
+// a path written to the target and LoadLibraryW run on it in a remote thread,
+// with a scan before to check it isn't there already and one after to find it
+Plan::Cost Plan::loadLibraryCost(const fs::path& path)
+{
+	Cost c;
+	c.allocations = 1;
+	c.writes = 1;
+	c.bytesWritten = (path.wstring().size() + 1) * sizeof(wchar_t);
+	c.remoteThreads = 1;
+	c.scans = 2;
+	return c;
+}
+
+void Plan::inject(const vector<wstring>& paths, Phase phase)
+{
+	for (const fs::path& path : paths)
+	{
+		if (!fs::exists(path))
+			problem("library not found: " + path.string());
+		if (isLoaded(path))
+			problem("library already in process: " + path.string());
+
+		steps_.push_back({ phase, "inject", { path }, loadLibraryCost(path), "" });
+		loaded.insert(lowerFilename(path));
+	}
+}
+
+void Plan::map(const PeImage& image, Phase phase, bool parallelRelocation)
+{
+	Step step = { phase, "map", { image.path() } };
+
+	// the image in one allocation and one write, then one remote call for the
+	// entry point and each tls callback
+	const size_t dllMainCalls = image.tlsCallbacks() + (image.ntHeader().OptionalHeader.AddressOfEntryPoint ? 1 : 0);
+	step.cost.allocations = 1 + 2 * dllMainCalls;
+	step.cost.writes = 1 + 2 * dllMainCalls;
+	step.cost.bytesWritten = image.size() + dllMainCalls * Process::dllMainCallSize();
+	step.cost.remoteThreads = dllMainCalls;
+	step.cost.scans = image.imports().size() + 1;
+
+	// imports not in the target are injected with LoadLibrary first, found the way fixIAT does
+	string imports;
+	for (const PeImage::Import& import : image.imports())
+	{
+		bool wasLoaded = isLoaded(import.module);
+		if (!wasLoaded)
+		{
+			Module local = Module::load(to_wstring(import.module), DONT_RESOLVE_DLL_REFERENCES, true, false);
+			if (!local)
+				problem("import " + import.module + " of " + image.path().filename().string() + " not found");
+			else
+			{
+				step.cost += loadLibraryCost(local.path());
+				loaded.insert(lowerFilename(import.module));
+			}
+		}
+		imports += (imports.empty() ? "" : ",") + (format("{\"module\":%s,\"functions\":%d,\"loaded\":%s,\"bound\":%s}")
+			% jsonString(import.module) % import.names.size() % (wasLoaded ? "true" : "false") % (import.boundTimeStamp ? "true" : "false")).str();
+	}
+
+	// delay imports cost nothing up front, they are loaded by the target on first call
+	string delayImports;
+	for (const PeImage::DelayImport& import : image.delayImports())
+	{
+		delayImports += (delayImports.empty() ? "" : ",") + (format("{\"module\":%s,\"functions\":%d,\"loaded\":%s}")
+			% jsonString(import.module) % import.names.size() % (isLoaded(import.module) ? "true" : "false")).str();
+	}
+
+	step.details = (format("\"imageSize\":%d,\"relocationBlocks\":%d,\"fixups\":%d,\"parallelRelocation\":%s,\"tlsCallbacks\":%d,\"entryPoint\":%s,\"imports\":[%s],\"delayImports\":[%s]")
+		% image.size() % image.relocationBlocks() % image.fixups() % (parallelRelocation && image.relocationBlocks() >= 64 ? "true" : "false")
+		% image.tlsCallbacks() % (image.ntHeader().OptionalHeader.AddressOfEntryPoint ? "true" : "false") % imports % delayImports).str();
+	steps_.push_back(std::move(step));
+}
+
+void Plan::eject(const vector<wstring>& paths, Phase phase)
+{
+	if (paths.empty())
+		return;
+
+	Step step = { phase, "eject" };
+	for (const fs::path& path : paths)
+	{
+		if (!isLoaded(path))
+			problem("library not in process: " + path.string());
+		step.libraries.push_back(path);
+		loaded.erase(lowerFilename(path));
+	}
+
+	// one scan to find them all, the batch code once and a parameter block per batch
+	const size_t batches = (paths.size() + Process::ejectBatchMax - 1) / Process::ejectBatchMax;
+	step.cost.allocations = 2;
+	step.cost.writes = 1 + batches;
+	step.cost.bytesWritten = Process::ejectCodeSize() + batches * Process::ejectBatchSize();
+	step.cost.remoteThreads = batches;
+	step.cost.scans = 1;
+	step.details = (format("\"batches\":%d") % batches).str();
+	steps_.push_back(std::move(step));
+}
+
+void Plan::waitFor(const string& condition, DWORD pollMillis, optional<DWORD> timeoutMillis)
+{
+	trigger = (format("{\"condition\":%s,\"pollInterval\":%d,\"timeout\":%s}")
+		% jsonString(condition) % pollMillis % (timeoutMillis ? to_string(*timeoutMillis) : string("null"))).str();
+}
+
+void Plan::problem(const string& text)
+{
+	problems_.push_back(text);
+}
+
+Plan::Cost Plan::total() const
+{
+	Cost c;
+	for (const Step& step : steps_)
+		c += step.cost;
+	return c;
+}
+
+Plan::Cost Plan::total(Phase phase) const
+{
+	Cost c;
+	for (const Step& step : steps_)
+	{
+		if (step.phase == phase)
+			c += step.cost;
+	}
+	return c;
+}
+
+double Plan::suspensionMillis() const
+{
+	const Cost c = total(Suspended);
+	return c.allocations * model.allocationMillis
+		+ c.writes * model.writeMillis
+		+ c.bytesWritten / model.bytesPerMilli
+		+ c.remoteThreads * model.remoteThreadMillis
+		+ c.scans * model.scanMillis;
+}
+
+string Plan::json() const
+{
+	string out = "{\"target\":" + target + (format(",\"instances\":%d") % instances).str();
+
+	out += ",\"flags\":{\"privileges\":[";
+	for (size_t i = 0; i < privileges.size(); i++)
+		out += (i ? "," : "") + (format("{\"name\":%s,\"enable\":%s}") % jsonString(privileges[i].first) % (privileges[i].second ? "true" : "false")).str();
+	out += "],\"errorModes\":[";
+	for (size_t i = 0; i < errorModes.size(); i++)
+		out += (i ? "," : "") + (format("{\"name\":%s,\"enable\":%s}") % jsonString(errorModes[i].first) % (errorModes[i].second ? "true" : "false")).str();
+	out += (format("],\"tokenAdjustments\":%d}") % (privileges.empty() ? 0 : 1)).str();
+
+	out += ",\"trigger\":" + trigger;
+
+	out += ",\"steps\":[";
+	for (size_t i = 0; i < steps_.size(); i++)
+	{
+		const Step& step = steps_[i];
+		out += (i ? "," : "") + (format("{\"phase\":\"%s\",\"action\":\"%s\",\"libraries\":%s,%s")
+			% (step.phase == Suspended ? "suspended" : "triggered") % step.action % jsonPaths(step.libraries) % jsonCost(step.cost)).str();
+		out += (step.details.empty() ? "" : ",") + step.details + "}";
+	}
+	out += "]";
+
+	out += ",\"total\":{" + jsonCost(total()) + "}";
+	out += ",\"suspended\":{" + jsonCost(total(Suspended)) + "}";
+	out += ",\"remoteThreadPolicy\":" + jsonString(Process::remoteThreadPolicy.describe());
+	out += (format(",\"estimatedSuspensionMs\":%.3f") % suspensionMillis()).str();
+	out += (format(",\"costModel\":{\"allocationMs\":%.3f,\"writeMs\":%.3f,\"bytesPerMs\":%.0f,\"remoteThreadMs\":%.3f,\"scanMs\":%.3f}")
+		% model.allocationMillis % model.writeMillis % model.bytesPerMilli % model.remoteThreadMillis % model.scanMillis).str();
+
+	out += ",\"problems\":[";
+	for (size_t i = 0; i < problems_.size(); i++)
+		out += (i ? "," : "") + jsonString(problems_[i]);
+	return out + "]}";
+}
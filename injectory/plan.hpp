@@ -0,0 +1,94 @@
+#pragma once
+#include "injectory/common.hpp"
+#include "injectory/process.hpp"
+#include "injectory/peimage.hpp"
+#include <set>
+
+// what a run would do to a target, worked out from the payloads and read-only queries of the
+// target. nothing is allocated, written or started in it
+class Plan
+{
+public:
+	enum Phase
+	{
+		Suspended,	// before the target is resumed
+		Triggered,	// the *w steps, once the trigger holds or the target is input idle
+	};
+
+	struct Cost
+	{
+		size_t allocations = 0;
+		size_t writes = 0;
+		SIZE_T bytesWritten = 0;
+		size_t protectCalls = 0;
+		size_t remoteThreads = 0;
+		size_t scans = 0;	// passes over the target's address space
+
+		Cost& operator+=(const Cost& other);
+	};
+
+	// rough cost of each remote operation, only used to estimate how long the target stays suspended
+	struct CostModel
+	{
+		double allocationMillis = 0.05;
+		double writeMillis = 0.02;
+		double bytesPerMilli = 1 << 20;
+		double remoteThreadMillis = 1.0;
+		double scanMillis = 0.5;	// measured on the target when there is one
+	};
+
+	struct Step
+	{
+		Phase phase;
+		string action;
+		vector<fs::path> libraries;
+		Cost cost;
+		string details;	// extra members of the step's json object
+	};
+
+private:
+	string target;					// json object describing the target
+	std::set<string> loaded;		// lowercase filenames of the images in the target
+	CostModel model;
+	vector<std::pair<string, bool>> privileges;
+	vector<std::pair<string, bool>> errorModes;
+	string trigger = "null";
+	vector<Step> steps_;
+	vector<string> problems_;
+
+	Plan() = default;
+
+public:
+	unsigned instances = 1;
+
+	// a running target, its bitness and modules are queried
+	static Plan running(Process& proc);
+	// a target launched suspended, only ntdll and the exe itself are mapped at that point
+	static Plan launched(const fs::path& exe);
+
+	void flags(const vector<string>& set, const vector<string>& unset);
+	void inject(const vector<wstring>& paths, Phase phase);
+	void map(const PeImage& image, Phase phase, bool parallelRelocation);
+	void eject(const vector<wstring>& paths, Phase phase);
+	void waitFor(const string& condition, DWORD pollMillis, optional<DWORD> timeoutMillis);
+	void problem(const string& text);
+
+	const vector<Step>& steps() const
+	{
+		return steps_;
+	}
+
+	const vector<string>& problems() const
+	{
+		return problems_;
+	}
+
+	Cost total() const;
+	Cost total(Phase phase) const;
+	double suspensionMillis() const;
+	string json() const;
+
+private:
+	bool isLoaded(const fs::path& path) const;
+	static Cost loadLibraryCost(const fs::path& path);
+};
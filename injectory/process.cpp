@@ -4,9 +4,24 @@
 #include "injectory/module.hpp"
 #include "injectory/library.hpp"
 #include "injectory/file.hpp"
+#include "injectory/reactor.hpp"
+#include "injectory/log.hpp"
 #include <TlHelp32.h>
+#include <mutex>
 
 Process Process::current(GetCurrentProcessId(), GetCurrentProcess());
+unsigned Process::scanShards = 1;
+RemoteThreadPolicy Process::remoteThreadPolicy;
+
+namespace
+{
+	// executable part of a mapped image
+	bool isModuleCode(const Region& r)
+	{
+		return (r.allocationProtect & PAGE_EXECUTE_WRITECOPY) &&
+			(r.protect & (PAGE_EXECUTE | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY));
+	}
+}
 
 Process Process::open(const pid_t& pid, bool inheritHandle, DWORD desiredAccess)
 {
@@ -26,28 +41,38 @@ ProcessWithThread Process::launch(const fs::path& app, const wstring& args,
 	bool inheritHandles, DWORD creationFlags,
 	SECURITY_ATTRIBUTES* processAttributes, SECURITY_ATTRIBUTES* threadAttributes,
 	STARTUPINFOW startupInfo)
+{
+	wstring envBlock = env ? env->block() : wstring();
+	return launch(app, args, env ? &envBlock : nullptr, cwd, inheritHandles, creationFlags, processAttributes, threadAttributes, startupInfo);
+}
+
+ProcessWithThread Process::launch(const fs::path& app, const wstring& args,
+	const wstring* envBlock,
+	optional<wstring> cwd,
+	bool inheritHandles, DWORD creationFlags,
+	SECURITY_ATTRIBUTES* processAttributes, SECURITY_ATTRIBUTES* threadAttributes,
+	STARTUPINFOW startupInfo)
 {
 	startupInfo.cb = sizeof(STARTUPINFOW); // needed
 	PROCESS_INFORMATION pi = {};
 	wstring commandLine = L'"' + app.wstring() + L"\" " + args;
-
-	wstring envstring;
-	if (env)
-	{
-		for (const auto&[k, v] : *env)
-			envstring += k + L'=' + v + L'\0';
-		envstring += L'\0';
-	}
 	creationFlags |= CREATE_UNICODE_ENVIRONMENT;
 
 	if (!CreateProcessW(app.c_str(), &commandLine[0], processAttributes, threadAttributes, inheritHandles,
-			creationFlags, env?(void*)envstring.c_str():nullptr, cwd?cwd->c_str():nullptr, &startupInfo, &pi))
+			creationFlags, envBlock?(void*)envBlock->c_str():nullptr, cwd?cwd->c_str():nullptr, &startupInfo, &pi))
 	{
 		DWORD errcode = GetLastError();
 		BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("CreateProcess") << e_last_error(errcode) << e_file(app));
 	}
 	else
+	{
+		if (creationFlags & CREATE_SUSPENDED)
+		{
+			Log::suspended(pi.dwProcessId);
+			Metrics::suspended(pi.dwProcessId);
+		}
 		return ProcessWithThread(Process(pi.dwProcessId, pi.hProcess), Thread(pi.dwThreadId, pi.hThread));
+	}
 }
 
 Process Process::findByWindow(wstring className, wstring windowName)
@@ -90,12 +115,64 @@ Process Process::findByExeName(wstring name)
 	BOOST_THROW_EXCEPTION(ex_injection() << e_text("could not get find process '" + to_string(name) + "'"));
 }
 
+vector<ProcessEntry> Process::list(const function<bool(const wstring& exeName)>& filter)
+{
+	WinHandle procSnap(CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0), CloseHandle);
+
+	if (procSnap.handle() == INVALID_HANDLE_VALUE)
+	{
+		DWORD errcode = GetLastError();
+		BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("CreateToolhelp32Snapshot") << e_text("could not get process snapshot") << e_last_error(errcode));
+	}
+
+	vector<ProcessEntry> entries;
+	PROCESSENTRY32W pe32 = { sizeof(PROCESSENTRY32W) };
+	if (Process32FirstW(procSnap.handle(), &pe32))
+	{
+		do
+		{
+			if (!filter(pe32.szExeFile))
+				continue;
+
+			try
+			{
+				// only matches get opened, for the creation time
+				Process proc = Process::open(pe32.th32ProcessID, false, PROCESS_QUERY_LIMITED_INFORMATION);
+				entries.push_back({ pe32.th32ProcessID, proc.creationTime(), pe32.szExeFile });
+			}
+			catch (...)
+			{
+				// exited since the snapshot or access denied
+			}
+		} while (Process32NextW(procSnap.handle(), &pe32));
+	}
+	return entries;
+}
+
 void Process::suspend(bool suspend_) const
 {
 	if (suspend_)
-		Module::ntdll().ntSuspendProcess(*this);
+	{
+		// output is held before the target stops, so no line is written while it is suspended
+		Log::suspended(id());
+		Metrics::suspended(id());
+		try
+		{
+			Module::ntdll().ntSuspendProcess(*this);
+		}
+		catch (...)
+		{
+			Log::resumed(id());
+			Metrics::forget(id());
+			throw;
+		}
+	}
 	else
+	{
 		Module::ntdll().ntResumeProcess(*this);
+		Metrics::resumed(id());
+		Log::resumed(id());
+	}
 }
 
 void Process::suspendAllThreads(bool _suspend) const
@@ -138,14 +215,70 @@ vector<Thread> Process::threads(bool inheritHandle, DWORD desiredAccess) const
 	return threads_;
 }
 
+size_t Process::threadCount() const
+{
+	size_t count = 0;
+	WinHandle snap(CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, id()), CloseHandle);
+	if (snap.handle() == INVALID_HANDLE_VALUE)
+	{
+		DWORD errcode = GetLastError();
+		BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("CreateToolhelp32Snapshot") << e_text("could not get thread snapshot") << e_process(*this) << e_last_error(errcode));
+	}
+
+	THREADENTRY32 te = { sizeof(te) };
+	if (Thread32First(snap.handle(), &te))
+	{
+		do
+		{
+			if (te.th32OwnerProcessID == id())
+				count++;
+			te.dwSize = sizeof(te);
+		} while (Thread32Next(snap.handle(), &te));
+	}
+	return count;
+}
+
 MemoryArea Process::memory(void* address, SIZE_T size)
 {
 	return MemoryArea(*this, address, size, false);
 }
 
-MemoryArea Process::alloc(SIZE_T size, bool freeOnDestruction, DWORD allocationType, DWORD protect, void* addressHint)
+void Process::readv(const vector<IoSpan>& spans, uintptr_t maxGap) const
+{
+	IoPlan plan = IoPlan::reads(spans, maxGap);
+	vector<byte> buffer;
+	for (size_t i = 0; i < plan.transfers().size(); i++)
+	{
+		const IoPlan::Transfer& t = plan.transfers()[i];
+		buffer.resize(t.size());
+		SIZE_T numBytesRead = 0;
+		Metrics::add(Metrics::RemoteRead);
+		if (ReadProcessMemory(handle(), (void*)t.begin, buffer.data(), t.size(), &numBytesRead) && numBytesRead == t.size())
+			plan.scatter(i, buffer.data());
+		else
+		{
+			for (size_t s : t.spans)
+				ReadProcessMemory_Throwing(*this, (void*)spans[s].remote, spans[s].local, spans[s].size);
+		}
+	}
+}
+
+void Process::writev(const vector<IoSpan>& spans) const
 {
-	return MemoryArea::alloc(*this, size, freeOnDestruction, allocationType, protect, addressHint);
+	IoPlan plan = IoPlan::writes(spans);
+	vector<byte> buffer;
+	for (size_t i = 0; i < plan.transfers().size(); i++)
+	{
+		const IoPlan::Transfer& t = plan.transfers()[i];
+		buffer.resize(t.size());
+		plan.gather(i, buffer.data());
+		WriteProcessMemory_Throwing(*this, (void*)t.begin, buffer.data(), buffer.size());
+	}
+}
+
+MemoryArea Process::alloc(SIZE_T size, const string& purpose, bool freeOnDestruction, DWORD allocationType, DWORD protect, void* addressHint)
+{
+	return MemoryArea::alloc(*this, size, purpose, freeOnDestruction, allocationType, protect, addressHint);
 }
 
 Module Process::inject(const Library& lib)
@@ -153,82 +286,249 @@ Module Process::inject(const Library& lib)
 	if (isInjected(lib))
 		BOOST_THROW_EXCEPTION(ex_injection() << e_text("library already in process") << e_library(lib.path()) << e_process(*this));
 
-	// copy the pathname to the remote process
-	SIZE_T libPathLen = (lib.path().wstring().size() + 1) * sizeof(wchar_t);
-	MemoryArea libFileRemote = alloc(libPathLen, true, MEM_COMMIT, PAGE_READWRITE);
-	libFileRemote.write((void*)(lib.path().c_str()));
-
-	PTHREAD_START_ROUTINE loadLibraryW = (PTHREAD_START_ROUTINE)Module::kernel32().getProcAddress("LoadLibraryW");
-	/*DWORD exitCode =*/ runInHiddenThread(loadLibraryW, libFileRemote.address());
+	RemoteCall call = startInject(lib);
+	call.thread.wait();
+	/*DWORD exitCode =*/ call.result();
 
 	return isInjected(lib);
 }
 
-DWORD Process::runInHiddenThread(PTHREAD_START_ROUTINE startAddress, LPVOID parameter)
+RemoteCall Process::startInHiddenThread(PTHREAD_START_ROUTINE startAddress, LPVOID parameter, shared_ptr<void> keepAlive)
 {
-	Thread thread = createRemoteThread(startAddress, parameter, CREATE_SUSPENDED);
-	thread.setPriority(THREAD_PRIORITY_TIME_CRITICAL);
+	const RemoteThreadPolicy& policy = remoteThreadPolicy;
+	Thread thread = createRemoteThread(startAddress, parameter,
+		CREATE_SUSPENDED | (policy.stackSize ? STACK_SIZE_PARAM_IS_A_RESERVATION : 0), nullptr, policy.stackSize);
+	thread.setPriority(policy.priority);
+	if (policy.idealProcessor)
+		thread.setIdealProcessor(*policy.idealProcessor);
+	if (policy.affinity)
+		thread.setAffinity(*policy.affinity);
 	thread.hideFromDebugger();
 	thread.resume();
-	DWORD exitCode = thread.waitForTermination();
+	return { thread, keepAlive, id() };
+}
+
+DWORD RemoteCall::result() const
+{
+	// STILL_ACTIVE would pass for a result
+	if (thread.wait(0) == WAIT_TIMEOUT)
+		BOOST_THROW_EXCEPTION(ex_injection() << e_text("remote call hasn't returned yet") << e_tid(thread.id()));
+
+	Thread::Times times = thread.times();
+	RemoteThreadTimes::instance().record(pid, (times.exit - times.creation) / 1e4, (times.kernel + times.user) / 1e4);
+
+	DWORD exitCode = thread.exitCode();
 	if (!exitCode)
 		BOOST_THROW_EXCEPTION(ex_injection() << e_text("call to function in remote process failed"));
 	return exitCode;
 }
 
-bool Process::is64bit() const
+void RemoteCall::abandon()
 {
-	SYSTEM_INFO systemInfo = getNativeSystemInfo();
+	// unless it is known to have exited
+	if (keepAlive && thread && WaitForSingleObject(thread.handle(), 0) != WAIT_OBJECT_0)
+		new shared_ptr<void>(std::move(keepAlive)); // leaked on purpose
+	*this = RemoteCall();
+}
 
-	if (systemInfo.wProcessorArchitecture == PROCESSOR_ARCHITECTURE_AMD64) // x64
-		return Module::kernel32().isWow64Process(*this);
-	else if (systemInfo.wProcessorArchitecture == PROCESSOR_ARCHITECTURE_INTEL) // x86
-		return false;
-	else
-		BOOST_THROW_EXCEPTION(ex_injection() << e_text("failed to determine whether x86 or x64") << e_process(*this));
+DWORD Process::runInHiddenThread(PTHREAD_START_ROUTINE startAddress, LPVOID parameter)
+{
+	RemoteCall call = startInHiddenThread(startAddress, parameter);
+	call.thread.wait();
+	return call.result();
 }
 
-Module Process::isInjected(const Library& lib)
+std::future<DWORD> Process::async(const RemoteCall& call)
 {
-	MEMORY_BASIC_INFORMATION mem_basic_info = { 0 };
-	SYSTEM_INFO sys_info = getSystemInfo();
+	auto promise = std::make_shared<std::promise<DWORD>>();
+	std::future<DWORD> future = promise->get_future();
+	WaitReactor::instance().watch(call.thread, [call, promise](DWORD waitResult)
+	{
+		try
+		{
+			if (waitResult == WAIT_FAILED)
+				BOOST_THROW_EXCEPTION(ex_wait_for_multiple_objects() << e_text("could not wait for remote thread") << e_tid(call.thread.id()));
+			promise->set_value(call.result());
+		}
+		catch (...)
+		{
+			promise->set_exception(std::current_exception());
+		}
+	});
+	return future;
+}
+
+std::future<DWORD> Process::runInHiddenThreadAsync(PTHREAD_START_ROUTINE startAddress, LPVOID parameter, shared_ptr<void> keepAlive)
+{
+	return async(startInHiddenThread(startAddress, parameter, keepAlive));
+}
+
+RemoteCall Process::startInject(const Library& lib)
+{
+	// copy the pathname to the remote process
+	SIZE_T libPathLen = (lib.path().wstring().size() + 1) * sizeof(wchar_t);
+	auto libFileRemote = std::make_shared<MemoryArea>(alloc(libPathLen, "LoadLibrary path", true, MEM_COMMIT, PAGE_READWRITE));
+	libFileRemote->write((void*)(lib.path().c_str()));
+
+	static const PTHREAD_START_ROUTINE loadLibraryW = (PTHREAD_START_ROUTINE)Module::kernel32().getProcAddress("LoadLibraryW");
+	return startInHiddenThread(loadLibraryW, libFileRemote->address(), libFileRemote);
+}
+
+std::future<DWORD> Process::injectAsync(const Library& lib)
+{
+	return async(startInject(lib));
+}
 
-	for (SIZE_T mem = 0; mem < (SIZE_T)sys_info.lpMaximumApplicationAddress; mem += mem_basic_info.RegionSize)
+bool Process::is64bit() const
+{
+	return info_->is64bit.get([this]
 	{
-		mem_basic_info = memBasicInfo((const void*)mem);
+		// the machine doesn't change either
+		static const WORD architecture = getNativeSystemInfo().wProcessorArchitecture;
 
-		if ((mem_basic_info.AllocationProtect & PAGE_EXECUTE_WRITECOPY) &&
-			(mem_basic_info.Protect & (PAGE_EXECUTE | PAGE_EXECUTE_READ |
-				PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY)))
+		if (architecture == PROCESSOR_ARCHITECTURE_AMD64) // x64
 		{
-			Module module((HMODULE)mem_basic_info.AllocationBase, *this);
-			if (boost::iequals(module.mappedFilename(*this), lib.ntFilename()))
-				return module;
+			Metrics::add(Metrics::RemoteQuery);
+			return Module::kernel32().isWow64Process(*this);
 		}
-	}
+		else if (architecture == PROCESSOR_ARCHITECTURE_INTEL) // x86
+			return false;
+		else
+			BOOST_THROW_EXCEPTION(ex_injection() << e_text("failed to determine whether x86 or x64") << e_process(*this));
+	});
+}
 
-	return Module(); // access denied or not found
+uintptr_t Process::peb() const
+{
+	return info_->peb.get([this]
+	{
+		ModuleNtdll::MY_PROCESS_BASIC_INFORMATION pbi = { 0 };
+		Metrics::add(Metrics::RemoteQuery);
+		Module::ntdll().ntQueryInformationProcess(*this, ModuleNtdll::ProcessBasicInformation, &pbi, sizeof(pbi));
+		return (uintptr_t)pbi.PebBaseAddress;
+	});
 }
 
-Module Process::isInjected(HMODULE hmodule)
+const wstring& Process::commandLine() const
 {
-	MEMORY_BASIC_INFORMATION mem_basic_info = { 0 };
-	SYSTEM_INFO sys_info = getSystemInfo();
+	return info_->commandLine.get([this]
+	{
+		// a MY_UNICODE_STRING followed by the text it points to
+		vector<uint8_t> buffer(1024);
+		for (;;)
+		{
+			ULONG needed = 0;
+			Metrics::add(Metrics::RemoteQuery);
+			NTSTATUS status = Module::ntdll().ntQueryInformationProcess_(handle(), ModuleNtdll::ProcessCommandLineInformation, buffer.data(), (ULONG)buffer.size(), &needed);
+			if (status == ModuleNtdll::infoLengthMismatch && needed > buffer.size())
+			{
+				buffer.resize(needed);
+				continue;
+			}
+			if (!ModuleNtdll::NT_SUCCESS(status))
+				BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("NtQueryInformationProcess") << e_text("could not get command line") << e_process(*this) << e_nt_status(status));
+
+			const ModuleNtdll::MY_UNICODE_STRING* s = (const ModuleNtdll::MY_UNICODE_STRING*)buffer.data();
+			return wstring(s->Buffer, s->Length / sizeof(wchar_t));
+		}
+	});
+}
+
+uintptr_t Process::imageBase() const
+{
+	return info_->imageBase.get([this]
+	{
+		// PEB: four flag bytes padded to a pointer, Mutant, ImageBaseAddress
+		uintptr_t base = 0;
+		ReadProcessMemory_Throwing(*this, (void*)(peb() + 2 * sizeof(void*)), &base, sizeof(base));
+		return base;
+	});
+}
 
-	for (SIZE_T mem = 0; mem < (SIZE_T)sys_info.lpMaximumApplicationAddress; mem += mem_basic_info.RegionSize)
+RegionMap::Query Process::regionQuery() const
+{
+	handle_t h = handle();
+	return [h](uintptr_t address) -> optional<Region>
 	{
-		mem_basic_info = memBasicInfo((const void*)mem);
+		MEMORY_BASIC_INFORMATION mbi = { 0 };
+		Metrics::add(Metrics::RemoteQuery);
+		if (!VirtualQueryEx(h, (const void*)address, &mbi, sizeof(mbi)))
+			return nullopt; // past the end of the address space
+
+		Region r;
+		r.base = (uintptr_t)mbi.BaseAddress;
+		r.size = mbi.RegionSize;
+		r.allocationBase = (uintptr_t)mbi.AllocationBase;
+		r.state = mbi.State;
+		r.protect = mbi.Protect;
+		r.allocationProtect = mbi.AllocationProtect;
+		r.type = mbi.Type;
+		return r;
+	};
+}
+
+RegionMap Process::regions() const
+{
+	SYSTEM_INFO sys_info = getSystemInfo();
+	return RegionMap::scan(regionQuery(), 0, (uintptr_t)sys_info.lpMaximumApplicationAddress, scanShards);
+}
 
-		if ((mem_basic_info.AllocationProtect & PAGE_EXECUTE_WRITECOPY) &&
-			(mem_basic_info.Protect & (PAGE_EXECUTE | PAGE_EXECUTE_READ |
-				PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY)))
+optional<Region> Process::findRegion(const function<bool(const Region&)>& pred) const
+{
+	if (scanShards > 1)
+	{
+		for (const Region& r : regions().regions())
 		{
-			if ((HMODULE)mem_basic_info.AllocationBase == hmodule)
-				return Module(hmodule, *this);
+			if (pred(r))
+				return r;
 		}
+		return nullopt;
+	}
+
+	SYSTEM_INFO sys_info = getSystemInfo();
+	RegionMap::Query query = regionQuery();
+	for (uintptr_t mem = 0; mem < (uintptr_t)sys_info.lpMaximumApplicationAddress; )
+	{
+		optional<Region> r = query(mem);
+		if (!r)
+			break;
+		if (pred(*r))
+			return r;
+		mem = r->end();
 	}
+	return nullopt;
+}
+
+RegionMap::Diff Process::refresh(RegionMap& map, const vector<RegionMap::Range>& windows) const
+{
+	return map.refresh(regionQuery(), windows);
+}
+
+Module Process::isInjected(const Library& lib)
+{
+	wstring ntFilename = lib.ntFilename();
+	optional<Region> r = findRegion([&](const Region& r)
+	{
+		return isModuleCode(r) && boost::iequals(Module((HMODULE)r.allocationBase, *this).mappedFilename(), ntFilename);
+	});
 
-	return Module(); // access denied or not found
+	if (r)
+		return Module((HMODULE)r->allocationBase, *this);
+	else
+		return Module(); // access denied or not found
+}
+
+Module Process::isInjected(HMODULE hmodule)
+{
+	optional<Region> r = findRegion([&](const Region& r)
+	{
+		return isModuleCode(r) && (HMODULE)r.allocationBase == hmodule;
+	});
+
+	if (r)
+		return Module(hmodule, *this);
+	else
+		return Module(); // access denied or not found
 }
 
 Module Process::getInjected(const Library& lib)
@@ -238,6 +538,39 @@ Module Process::getInjected(const Library& lib)
 	else
 		BOOST_THROW_EXCEPTION(ex_injection() << e_text("failed to find injected library") << e_process(*this) << e_library(lib.path()));
 }
+vector<Module> Process::getInjected(const vector<Library>& libs)
+{
+	vector<wstring> ntFilenames;
+	for (const Library& lib : libs)
+		ntFilenames.push_back(lib.ntFilename());
+
+	vector<Module> modules(libs.size());
+	size_t found = 0;
+	findRegion([&](const Region& r)
+	{
+		if (!isModuleCode(r))
+			return false;
+
+		wstring mapped = Module((HMODULE)r.allocationBase, *this).mappedFilename(false);
+		for (size_t i = 0; i < libs.size(); i++)
+		{
+			if (!modules[i] && boost::iequals(mapped, ntFilenames[i]))
+			{
+				modules[i] = Module((HMODULE)r.allocationBase, *this);
+				found++;
+			}
+		}
+		return found == libs.size();
+	});
+
+	for (size_t i = 0; i < libs.size(); i++)
+	{
+		if (!modules[i])
+			BOOST_THROW_EXCEPTION(ex_injection() << e_text("failed to find injected library") << e_process(*this) << e_library(libs[i].path()));
+	}
+	return modules;
+}
+
 Module Process::getInjected(HMODULE hmodule)
 {
 	if (Module module = isInjected(hmodule))
@@ -264,23 +597,76 @@ Module Process::map(const File& file)
 	return module;
 }
 
-void Process::listModules()
+vector<Module> Process::modules() const
 {
-	MEMORY_BASIC_INFORMATION mem_basic_info = { 0 };
-	SYSTEM_INFO sys_info = getSystemInfo();
+	vector<Module> modules;
+	uintptr_t ab = 0;
+	for (const Region& r : regions().regions())
+	{
+		if (ab == r.allocationBase || !isModuleCode(r))
+			continue;
+		ab = r.allocationBase;
+		modules.push_back(Module((HMODULE)r.allocationBase, *this));
+	}
+	return modules;
+}
 
+void Process::listModules()
+{
 	cout << "BASE\t\t SIZE\t\t  MODULE" << endl;
 
-	for (SIZE_T mem = 0; mem < (SIZE_T)sys_info.lpMaximumApplicationAddress; mem += mem_basic_info.RegionSize)
+	// the regions are already known, no need to scan again through getInjected()
+	for (Module& module : modules())
 	{
-		void* ab = mem_basic_info.AllocationBase;
-		mem_basic_info = memBasicInfo((void*)mem);
-		if (ab == mem_basic_info.AllocationBase)
-			continue;
-
-		Module module = getInjected((HMODULE)mem_basic_info.AllocationBase);
 		wstring ntMappedFileName = module.mappedFilename(false);
 		if (!ntMappedFileName.empty())
 			cout << format("0x%p, %.1f kB, ") % module.handle() % (module.ntHeader().OptionalHeader.SizeOfImage / 1024.0) << to_string(ntMappedFileName) << endl;
 	}
 }
+
+LUID Process::lookupPrivilege(const wstring& privilegeName)
+{
+	static std::mutex mutex;
+	static map<wstring, LUID> cache;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = cache.find(privilegeName);
+	if (it != cache.end())
+		return it->second;
+
+	LUID luid = {0};
+	if (!LookupPrivilegeValueW(nullptr, privilegeName.c_str(), &luid))
+	{
+		DWORD errcode = GetLastError();
+		BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("LookupPrivilegeValue") << e_text("could not look up privilege value for '" + to_string(privilegeName) + "'") << e_last_error(errcode));
+	}
+	if (luid.LowPart == 0 && luid.HighPart == 0)
+		BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("LookupPrivilegeValue") << e_text("could not get LUID for '" + to_string(privilegeName)+"'"));
+
+	cache[privilegeName] = luid;
+	return luid;
+}
+
+void Process::setPrivileges(const vector<std::pair<wstring, bool>>& privileges)
+{
+	if (privileges.empty())
+		return;
+
+	// TOKEN_PRIVILEGES ends in a variable length array
+	vector<byte> buffer(offsetof(TOKEN_PRIVILEGES, Privileges) + privileges.size() * sizeof(LUID_AND_ATTRIBUTES));
+	TOKEN_PRIVILEGES& token_privileges = *(TOKEN_PRIVILEGES*)buffer.data();
+	token_privileges.PrivilegeCount = (DWORD)privileges.size();
+	for (size_t i = 0; i < privileges.size(); i++)
+	{
+		token_privileges.Privileges[i].Luid = lookupPrivilege(privileges[i].first);
+		token_privileges.Privileges[i].Attributes = privileges[i].second ? SE_PRIVILEGE_ENABLED : 0;
+	}
+
+	// Apply the adjusted privileges
+	WinHandle token = openToken(TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY | TOKEN_READ);
+	if (!AdjustTokenPrivileges(token.handle(), FALSE, &token_privileges, (DWORD)buffer.size(), (PTOKEN_PRIVILEGES)0, (PDWORD)0))
+	{
+		DWORD errcode = GetLastError();
+		BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("AdjustTokenPrivileges") << e_text("could not adjust token privileges") << e_last_error(errcode));
+	}
+}
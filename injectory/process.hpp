@@ -4,7 +4,13 @@
 #include "injectory/thread.hpp"
 #include "injectory/winhandle.hpp"
 #include "injectory/environment.hpp"
-#include <boost/interprocess/mapped_region.hpp>
+#include "injectory/regionmap.hpp"
+#include "injectory/watch.hpp"
+#include "injectory/ioplan.hpp"
+#include "injectory/threadpolicy.hpp"
+#include "injectory/metrics.hpp"
+#include "injectory/processinfo.hpp"
+#include <future>
 #include <winnt.h>
 #include <Psapi.h>
 
@@ -15,15 +21,44 @@ class MemoryAreaT;
 class MemoryArea;
 struct ProcessWithThread;
 class Module;
+class PeImage;
+class WorkPool;
+class MappedImages;
+struct Reload;
+
+// a call into a remote process that was started but not waited for
+struct RemoteCall
+{
+	Thread thread;
+	shared_ptr<void> keepAlive; // e.g. memory holding the parameter, released with the call
+	pid_t pid = 0;
+
+	// exit code of the finished thread, throws if the remote function returned 0 or hasn't returned yet.
+	// also records the thread's times in RemoteThreadTimes
+	DWORD result() const;
+
+	// for a call given up on, if the thread still runs its memory is left to the target
+	// instead of being freed under it
+	void abandon();
+};
+
+// how the IAT of a mapped image was filled in, in thunks
+struct ImportStats
+{
+	size_t bound = 0;		// left as bound, the target has the build they were bound against
+	size_t resolved = 0;	// looked up
+};
 
 class Process : public WinHandle
 {
 private:
 	pid_t id_;
+	shared_ptr<ProcessInfo> info_;
 public:
 	Process(pid_t id, handle_t handle)
 		: WinHandle(handle, CloseHandle)
 		, id_(id)
+		, info_(std::make_shared<ProcessInfo>())
 	{}
 	Process()
 		: Process(0, nullptr)
@@ -34,23 +69,83 @@ public:
 		return id_;
 	}
 
-	fs::path path() const
+	const fs::path& path() const
 	{
-		WCHAR buffer[MAX_PATH + 1] = { 0 };
-		if (!GetModuleFileNameExW(handle(), (HMODULE)0, buffer, MAX_PATH))
+		return info_->path.get([this]() -> fs::path
 		{
-			DWORD errcode = GetLastError();
-			BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("GetModuleFileNameEx") << e_text("could not get path to process") << e_process(*this) << e_last_error(errcode));
-		}
-		return buffer;
+			WCHAR buffer[MAX_PATH + 1] = { 0 };
+			Metrics::add(Metrics::RemoteQuery);
+			if (!GetModuleFileNameExW(handle(), (HMODULE)0, buffer, MAX_PATH))
+			{
+				DWORD errcode = GetLastError();
+				BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("GetModuleFileNameEx") << e_text("could not get path to process") << e_process(*this) << e_last_error(errcode));
+			}
+			return buffer;
+		});
 	}
 
+	// address of the process environment block, in the target's own bitness where that matches ours
+	uintptr_t peb() const;
+	// where the exe is loaded, read from the PEB
+	uintptr_t imageBase() const;
+	// the command line the process was created with
+	const wstring& commandLine() const;
+
 	void waitForInputIdle(DWORD millis) const
 	{
 		if (WaitForInputIdle(handle(), millis) != 0)
 			BOOST_THROW_EXCEPTION(ex_wait_for_input_idle());
 	}
 
+	// polls without blocking, for callers that wait for input idle on their own
+	bool isInputIdle() const
+	{
+		DWORD ret = WaitForInputIdle(handle(), 0);
+		if (ret != 0 && ret != WAIT_TIMEOUT)
+			BOOST_THROW_EXCEPTION(ex_wait_for_input_idle());
+		return ret == 0;
+	}
+
+	// in 100ns intervals since 1601, together with id() this identifies the process
+	uint64_t creationTime() const
+	{
+		return info_->creationTime.get([this] { return times().first; });
+	}
+
+	// in 100ns intervals since 1601, only meaningful once the process has exited. not cached
+	uint64_t exitTime() const
+	{
+		return times().second;
+	}
+
+	// STILL_ACTIVE while running
+	DWORD exitCode() const
+	{
+		DWORD code = 0;
+		if (!GetExitCodeProcess(handle(), &code))
+		{
+			DWORD errcode = GetLastError();
+			BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("GetExitCodeProcess") << e_text("could not get process exit code") << e_process(*this) << e_last_error(errcode));
+		}
+		return code;
+	}
+
+private:
+	std::pair<uint64_t, uint64_t> times() const
+	{
+		FILETIME creation, exit, kernel, user;
+		Metrics::add(Metrics::RemoteQuery);
+		if (!GetProcessTimes(handle(), &creation, &exit, &kernel, &user))
+		{
+			DWORD errcode = GetLastError();
+			BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("GetProcessTimes") << e_text("could not get process times") << e_process(*this) << e_last_error(errcode));
+		}
+		return {
+			((uint64_t)creation.dwHighDateTime << 32) | creation.dwLowDateTime,
+			((uint64_t)exit.dwHighDateTime << 32) | exit.dwLowDateTime };
+	}
+
+public:
 	bool isRunning()
 	{
 		return wait(0) == WAIT_TIMEOUT;
@@ -81,18 +176,23 @@ public:
 	}
 
 	vector<Thread> threads(bool inheritHandle = false, DWORD desiredAccess = THREAD_SET_INFORMATION) const;
+	// like threads().size() but without opening any thread handles
+	size_t threadCount() const;
 
 
 public: // memory
 	template <typename T>
-	MemoryAreaT<T> alloc(bool freeOnDestruction = true,
+	MemoryAreaT<T> alloc(const string& purpose,
+		bool freeOnDestruction = true,
 		DWORD allocationType = MEM_COMMIT | MEM_RESERVE,
 		DWORD protect = PAGE_EXECUTE_READWRITE,
 		void* addressHint = nullptr)
 	{
-		return MemoryAreaT<T>::alloc(*this, freeOnDestruction, allocationType, protect, addressHint);
+		return MemoryAreaT<T>::alloc(*this, purpose, freeOnDestruction, allocationType, protect, addressHint);
 	}
+	// purpose tags the allocation in the Ledger
 	MemoryArea alloc(SIZE_T size,
+		const string& purpose,
 		bool freeOnDestruction = true,
 		DWORD allocationType = MEM_COMMIT | MEM_RESERVE,
 		DWORD protect = PAGE_EXECUTE_READWRITE,
@@ -105,18 +205,31 @@ public: // memory
 	}
 	MemoryArea memory(void* address, SIZE_T size);
 
+	// reads all spans with as few ReadProcessMemory calls as IoPlan manages, merging spans up to
+	// maxGap bytes apart. a merged read that fails, e.g. over an unreadable gap, is retried per span
+	void readv(const vector<IoSpan>& spans, uintptr_t maxGap = IoPlan::pageSize) const;
+	// writes all spans, merging only those that touch or overlap
+	void writev(const vector<IoSpan>& spans) const;
+
 
 public:
 	Module inject(const Library& lib);
 	Module mapRemoteModule(const Library& lib);
+	// maps an image prepared ahead of time, large relocations are spread over pool
+	Module mapRemoteModule(const PeImage& image, WorkPool* pool = nullptr, ImportStats* imports = nullptr);
+	// maps image, or when images has an earlier build of it that the new one fits into, detaches
+	// that, writes only the pages that changed and initializes it again at the same base
+	Reload reloadRemoteModule(const PeImage& image, MappedImages& images, WorkPool* pool = nullptr);
 
 	void callTlsInitializers(HMODULE hModule, DWORD fdwReason, IMAGE_TLS_DIRECTORY& imgTlsDir);
-	void fixIAT(const boost::interprocess::mapped_region& imageBase, IMAGE_NT_HEADERS& nt_header, IMAGE_IMPORT_DESCRIPTOR* imgImpDesc);
+	// bound imports whose dependency is the build they were bound against are left as they are
+	ImportStats fixIAT(PeImage& image);
 
 	bool is64bit() const;
 	MEMORY_BASIC_INFORMATION memBasicInfo(const void* addr)
 	{
 		MEMORY_BASIC_INFORMATION mem_basic_info = { 0 };
+		Metrics::add(Metrics::RemoteQuery);
 		SIZE_T size = VirtualQueryEx(handle(), addr, &mem_basic_info, sizeof(MEMORY_BASIC_INFORMATION));
 		if (!size)
 		{
@@ -126,6 +239,16 @@ public:
 		return mem_basic_info;
 	}
 
+	// VirtualQueryEx as a RegionMap::Query
+	RegionMap::Query regionQuery() const;
+	// full scan of the user address space, sharded across scanShards threads
+	RegionMap regions() const;
+	// returns the first region matching pred, walking sequentially with early exit
+	// or scanning the whole address space in parallel depending on scanShards
+	optional<Region> findRegion(const function<bool(const Region&)>& pred) const;
+	// re-queries only the given windows of a previous scan
+	RegionMap::Diff refresh(RegionMap& map, const vector<RegionMap::Range>& windows) const;
+
 	// returns the injected module or an empty Module
 	Module isInjected(const Library& lib);
 	// returns the injected module or an empty Module
@@ -134,16 +257,41 @@ public:
 	Module getInjected(const Library& lib);
 	// returns the injected module or throws
 	Module getInjected(HMODULE hmodule);
+	// resolves all libraries in one pass over the address space, throws if any is missing
+	vector<Module> getInjected(const vector<Library>& libs);
+
+	// frees all modules with a single remote thread, importers before the modules they import,
+	// and returns whether FreeLibrary succeeded for each
+	vector<bool> eject(const vector<Module>& modules);
+
+	// bytes a remoteDllMainCall and an eject batch write into the target
+	static SIZE_T dllMainCallSize();
+	static SIZE_T ejectCodeSize();
+	static SIZE_T ejectBatchSize();
+	static const size_t ejectBatchMax;
 
+	// every image mapped in the target, in one pass over the address space
+	vector<Module> modules() const;
 	void listModules();
 
 	Module map(const File& file);
 
 	DWORD runInHiddenThread(PTHREAD_START_ROUTINE startAddress, LPVOID parameter);
+	// starts the hidden thread without waiting for it
+	RemoteCall startInHiddenThread(PTHREAD_START_ROUTINE startAddress, LPVOID parameter, shared_ptr<void> keepAlive = nullptr);
+	// starts LoadLibraryW for lib in the remote process
+	RemoteCall startInject(const Library& lib);
+	// like runInHiddenThread but returns right away, the exit code is delivered through the WaitReactor
+	std::future<DWORD> runInHiddenThreadAsync(PTHREAD_START_ROUTINE startAddress, LPVOID parameter, shared_ptr<void> keepAlive = nullptr);
+	// becomes ready when LoadLibraryW for lib returned in the remote process
+	std::future<DWORD> injectAsync(const Library& lib);
+	// delivers the result of a started call through the WaitReactor
+	static std::future<DWORD> async(const RemoteCall& call);
 	Thread createRemoteThread(PTHREAD_START_ROUTINE startAddr, LPVOID parameter, DWORD creationFlags = 0,
 		LPSECURITY_ATTRIBUTES attr = nullptr, SIZE_T stackSize = 0)
 	{
 		DWORD tid;
+		Metrics::add(Metrics::RemoteThread);
 		handle_t thandle = CreateRemoteThread(handle(), attr, stackSize, startAddr, parameter, creationFlags, &tid);
 		if (!thandle)
 		{
@@ -155,7 +303,11 @@ public:
 	}
 
 	void remoteDllMainCall(void* moduleEntry, HMODULE hModule, DWORD ul_reason_for_call, void* lpReserved);
-	void mapSections(void* moduleBase, byte* dllBin, IMAGE_NT_HEADERS& nt_header);
+
+	// allocates, relocates, fixes imports, writes and initializes, returns the image as written
+	PeImage mapImage(const PeImage& prepared, WorkPool* pool, ImportStats* imports = nullptr);
+	// tls callbacks and the entry point with DLL_PROCESS_ATTACH
+	void initializeImage(const PeImage& image, HMODULE hModule);
 
 	WinHandle openToken(DWORD desiredAccess)
 	{
@@ -170,28 +322,14 @@ public:
 
 	void enablePrivilege(wstring privilegeName, bool enable = true)
 	{
-		LUID luid = {0};
-		if (!LookupPrivilegeValueW(nullptr, privilegeName.c_str(), &luid))
-		{
-			DWORD errcode = GetLastError();
-			BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("LookupPrivilegeValue") << e_text("could not look up privilege value for '" + to_string(privilegeName) + "'") << e_last_error(errcode));
-		}
-		if (luid.LowPart == 0 && luid.HighPart == 0)
-			BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("LookupPrivilegeValue") << e_text("could not get LUID for '" + to_string(privilegeName)+"'"));
+		setPrivileges({ { privilegeName, enable } });
+	}
 
-		// Set the privileges we need
-		TOKEN_PRIVILEGES token_privileges = {1};
-		token_privileges.Privileges[0].Luid = luid;
-		token_privileges.Privileges[0].Attributes = enable ? SE_PRIVILEGE_ENABLED : 0;
+	// enables or disables all privileges with one token open and one AdjustTokenPrivileges call
+	void setPrivileges(const vector<std::pair<wstring, bool>>& privileges);
 
-		// Apply the adjusted privileges
-		WinHandle token = openToken(TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY | TOKEN_READ);
-		if (!AdjustTokenPrivileges(token.handle(), FALSE, &token_privileges, sizeof(TOKEN_PRIVILEGES), (PTOKEN_PRIVILEGES)0, (PDWORD)0))
-		{
-			DWORD errcode = GetLastError();
-			BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("AdjustTokenPrivileges") << e_text("could not adjust token privileges") << e_last_error(errcode));
-		}
-	}
+	// looked up once per name and cached for the session
+	static LUID lookupPrivilege(const wstring& privilegeName);
 
 public:
 	static Process open(const pid_t& pid, bool inheritHandle = false, DWORD desiredAccess =
@@ -212,8 +350,17 @@ public:
 		bool inheritHandles = false, DWORD creationFlags = 0,
 		SECURITY_ATTRIBUTES* processAttributes = nullptr, SECURITY_ATTRIBUTES* threadAttributes = nullptr,
 		STARTUPINFOW startupInfo = {});
+	// with an environment block from Environment::block() that is built once for many launches
+	static ProcessWithThread launch(const fs::path& app, const wstring& args,
+		const wstring* envBlock,
+		optional<wstring> cwd,
+		bool inheritHandles = false, DWORD creationFlags = 0,
+		SECURITY_ATTRIBUTES* processAttributes = nullptr, SECURITY_ATTRIBUTES* threadAttributes = nullptr,
+		STARTUPINFOW startupInfo = {});
 
 	static Process findByExeName(wstring name);
+	// all running processes whose exe name passes filter, with creation times
+	static vector<ProcessEntry> list(const function<bool(const wstring& exeName)>& filter);
 	static Process findByWindow(wstring className, wstring windowName);
 
 public:
@@ -222,7 +369,21 @@ public:
 		return id() != 0 || handle() != nullptr;
 	}
 
+	// without these, comparisons went through operator bool
+	bool operator==(const Process& other) const
+	{
+		return id() == other.id();
+	}
+	bool operator!=(const Process& other) const
+	{
+		return !(*this == other);
+	}
+
 	static Process current;
+	// number of shards to split address space scans into, 1 is a sequential walk
+	static unsigned scanShards;
+	// applied to every thread started in a target
+	static RemoteThreadPolicy remoteThreadPolicy;
 };
 
 struct ProcessWithThread
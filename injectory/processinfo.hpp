@@ -0,0 +1,46 @@
+#pragma once
+#include "injectory/common.hpp"
+#include "injectory/metrics.hpp"
+#include <atomic>
+#include <mutex>
+
+// what is known about a process and doesn't change while it lives, queried on first use and shared
+// by all copies of its Process. a field is filled at most once, a fill that throws leaves it empty
+// and the next use tries again. reading a filled field is one acquire load
+class ProcessInfo
+{
+public:
+	template <typename T>
+	class Field
+	{
+	private:
+		std::once_flag once;
+		std::atomic<bool> filled = false;
+		T value;
+
+	public:
+		template <typename Fill>
+		const T& get(Fill fill)
+		{
+			if (filled.load(std::memory_order_acquire))
+			{
+				Metrics::add(Metrics::ProcessInfoHit);
+				return value;
+			}
+			std::call_once(once, [&]
+			{
+				Metrics::add(Metrics::ProcessInfoMiss);
+				value = fill();
+				filled.store(true, std::memory_order_release);
+			});
+			return value;
+		}
+	};
+
+	Field<fs::path> path;
+	Field<bool> is64bit;
+	Field<uint64_t> creationTime;	// 100ns intervals since 1601
+	Field<uintptr_t> peb;
+	Field<uintptr_t> imageBase;		// of the exe, from the PEB
+	Field<wstring> commandLine;		// as it was created with
+};
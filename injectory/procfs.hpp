@@ -0,0 +1,368 @@
+#pragma once
+#if defined(__linux__)
+#include "injectory/ioplan.hpp"
+#include "injectory/regionmap.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// the memory and query layer of Process for another process on Linux, so the cost of remote
+// reads and writes, region scans and thread enumeration can be measured against a real second
+// process. process_vm_readv/writev take a list of remote and local pieces in one call, so the
+// vectored paths need no merging. regions come from /proc/<pid>/maps with the Win32 MEM_* and
+// PAGE_* values Region uses elsewhere, an ELF file mapped executable counts as an image
+class LinuxProcess
+{
+private:
+	pid_t pid_;
+
+	[[noreturn]] static void fail(const char* what)
+	{
+		throw std::system_error(errno, std::generic_category(), what);
+	}
+
+	static std::string readFile(const std::string& path)
+	{
+		int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			fail("open");
+		std::string data;
+		char buf[64 * 1024];
+		for (;;)
+		{
+			ssize_t n = ::read(fd, buf, sizeof(buf));
+			if (n < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				int err = errno;
+				::close(fd);
+				errno = err;
+				fail("read");
+			}
+			if (n == 0)
+				break;
+			data.append(buf, (size_t)n);
+		}
+		::close(fd);
+		return data;
+	}
+
+	static uintptr_t parseHex(const char*& p, const char* end)
+	{
+		uintptr_t v = 0;
+		for (; p < end; p++)
+		{
+			char c = *p;
+			if (c >= '0' && c <= '9')		v = (v << 4) | (uintptr_t)(c - '0');
+			else if (c >= 'a' && c <= 'f')	v = (v << 4) | (uintptr_t)(c - 'a' + 10);
+			else if (c >= 'A' && c <= 'F')	v = (v << 4) | (uintptr_t)(c - 'A' + 10);
+			else break;
+		}
+		return v;
+	}
+
+	static void skipField(const char*& p, const char* end)
+	{
+		while (p < end && *p != ' ' && *p != '\n')
+			p++;
+		while (p < end && *p == ' ')
+			p++;
+	}
+
+	static uint32_t protection(bool r, bool w, bool x, bool shared, bool file)
+	{
+		// private writable file mappings are copy on write like image sections
+		const bool copy = file && !shared;
+		if (x)
+			return w ? (copy ? 0x80 : 0x40) : (r ? 0x20 : 0x10);	// PAGE_EXECUTE_*
+		if (w)
+			return copy ? 0x08 : 0x04;		// PAGE_WRITECOPY, PAGE_READWRITE
+		return r ? 0x02 : 0x01;				// PAGE_READONLY, PAGE_NOACCESS
+	}
+
+	// the bytes actually moved, spans are cut at IOV_MAX pieces per call
+	template <typename Call>
+	static size_t transfer(const std::vector<IoSpan>& spans, Call call)
+	{
+		size_t done = 0;
+		std::vector<iovec> local, remote;
+		for (size_t first = 0; first < spans.size(); first += IOV_MAX)
+		{
+			const size_t last = (std::min)(spans.size(), first + (size_t)IOV_MAX);
+			local.clear();
+			remote.clear();
+			size_t expected = 0;
+			for (size_t i = first; i < last; i++)
+			{
+				local.push_back({ spans[i].local, spans[i].size });
+				remote.push_back({ (void*)spans[i].remote, spans[i].size });
+				expected += spans[i].size;
+			}
+			ssize_t n = call(local.data(), local.size(), remote.data(), remote.size());
+			if (n < 0)
+				return done;
+			done += (size_t)n;
+			if ((size_t)n != expected)
+			{
+				// a short transfer leaves errno alone, it stopped at memory it couldn't access
+				errno = EFAULT;
+				return done;
+			}
+		}
+		return done;
+	}
+
+	static size_t total(const std::vector<IoSpan>& spans)
+	{
+		size_t n = 0;
+		for (const IoSpan& s : spans)
+			n += s.size;
+		return n;
+	}
+
+public:
+	explicit LinuxProcess(pid_t pid)
+		: pid_(pid)
+	{}
+
+	static LinuxProcess self()
+	{
+		return LinuxProcess(::getpid());
+	}
+
+	pid_t id() const
+	{
+		return pid_;
+	}
+
+	bool isRunning() const
+	{
+		return ::kill(pid_, 0) == 0 || errno == EPERM;
+	}
+
+	std::string exe() const
+	{
+		char buf[PATH_MAX];
+		ssize_t n = ::readlink(("/proc/" + std::to_string(pid_) + "/exe").c_str(), buf, sizeof(buf));
+		if (n < 0)
+			fail("readlink");
+		return std::string(buf, (size_t)n);
+	}
+
+	void read(uintptr_t remote, void* local, size_t size) const
+	{
+		readv({ { remote, local, size } });
+	}
+
+	void write(uintptr_t remote, const void* local, size_t size) const
+	{
+		writev({ { remote, const_cast<void*>(local), size } });
+	}
+
+	template <typename T>
+	T memory(uintptr_t remote) const
+	{
+		T t;
+		read(remote, &t, sizeof(T));
+		return t;
+	}
+
+	// all spans in one process_vm_readv, throws if any of them couldn't be read completely
+	void readv(const std::vector<IoSpan>& spans) const
+	{
+		const pid_t pid = pid_;
+		size_t n = transfer(spans, [pid](const iovec* l, size_t ln, const iovec* r, size_t rn)
+		{
+			return ::process_vm_readv(pid, l, ln, r, rn, 0);
+		});
+		if (n != total(spans))
+			fail("process_vm_readv");
+	}
+
+	// all spans in one process_vm_writev, later spans win where they overlap
+	void writev(const std::vector<IoSpan>& spans) const
+	{
+		const pid_t pid = pid_;
+		size_t n = transfer(spans, [pid](const iovec* l, size_t ln, const iovec* r, size_t rn)
+		{
+			return ::process_vm_writev(pid, l, ln, r, rn, 0);
+		});
+		if (n != total(spans))
+			fail("process_vm_writev");
+	}
+
+	// every mapping in /proc/<pid>/maps with the gaps between them as free regions
+	std::vector<Region> maps() const
+	{
+		const std::string data = readFile("/proc/" + std::to_string(pid_) + "/maps");
+		std::vector<Region> regions;
+		std::vector<std::pair<uint64_t, uintptr_t>> imageBases; // inode -> first mapping
+		uintptr_t last = 0;
+
+		const char* p = data.data();
+		const char* end = p + data.size();
+		while (p < end)
+		{
+			// start-end perms offset dev inode path
+			Region r;
+			r.base = parseHex(p, end);
+			p++;
+			const uintptr_t stop = parseHex(p, end);
+			p++;
+			if (end - p < 4)
+				break;
+			const bool rd = p[0] == 'r', wr = p[1] == 'w', ex = p[2] == 'x', shared = p[3] == 's';
+			skipField(p, end);	// perms
+			skipField(p, end);	// offset
+			skipField(p, end);	// dev
+			uint64_t inode = 0;
+			for (; p < end && *p >= '0' && *p <= '9'; p++)
+				inode = inode * 10 + (uint64_t)(*p - '0');
+			while (p < end && *p == ' ')
+				p++;
+			const char* name = p;
+			while (p < end && *p != '\n')
+				p++;
+			const std::string path(name, p);
+			if (p < end)
+				p++;
+
+			if (r.base > last)
+			{
+				Region gap;
+				gap.base = last;
+				gap.size = r.base - last;
+				gap.allocationBase = last;
+				regions.push_back(gap);
+			}
+
+			r.size = stop - r.base;
+			r.state = Region::Commit;
+			r.protect = protection(rd, wr, ex, shared, inode != 0);
+			r.allocationProtect = r.protect;
+			r.allocationBase = r.base;
+			if (inode == 0)
+				r.type = Region::Private;
+			else
+			{
+				// all mappings of an executable file share the allocation base of the first one
+				auto it = std::find_if(imageBases.begin(), imageBases.end(), [&](const auto& b) { return b.first == inode; });
+				bool image = it != imageBases.end() || ex || path.find(".so") != std::string::npos;
+				r.type = image ? Region::Image : (shared ? Region::Mapped : Region::Private);
+				if (image)
+				{
+					if (it == imageBases.end())
+						imageBases.push_back({ inode, r.base });
+					else
+						r.allocationBase = it->second;
+					r.allocationProtect = 0x80; // PAGE_EXECUTE_WRITECOPY, like images on Windows
+				}
+			}
+			regions.push_back(r);
+			last = stop;
+		}
+		return regions;
+	}
+
+	// answers RegionMap queries from one read of /proc/<pid>/maps, there is no per address query
+	RegionMap::Query regionQuery() const
+	{
+		auto regions = std::make_shared<std::vector<Region>>(maps());
+		return [regions](uintptr_t address) -> std::optional<Region>
+		{
+			auto it = std::upper_bound(regions->begin(), regions->end(), address,
+				[](uintptr_t a, const Region& r) { return a < r.base; });
+			if (it == regions->begin())
+				return std::nullopt;
+			--it;
+			if (address >= it->end())
+				return std::nullopt; // past the last mapping
+			Region r = *it;
+			r.size -= address - r.base;
+			r.base = address;
+			return r;
+		};
+	}
+
+	RegionMap regions() const
+	{
+		std::vector<Region> all = maps();
+		return RegionMap::scan(regionQuery(), 0, all.empty() ? 0 : all.back().end());
+	}
+
+	// ids of all threads, from /proc/<pid>/task
+	std::vector<pid_t> threads() const
+	{
+		const std::string path = "/proc/" + std::to_string(pid_) + "/task";
+		DIR* dir = ::opendir(path.c_str());
+		if (!dir)
+			fail("opendir");
+		std::vector<pid_t> tids;
+		while (dirent* e = ::readdir(dir))
+		{
+			if (e->d_name[0] >= '0' && e->d_name[0] <= '9')
+				tids.push_back((pid_t)std::strtol(e->d_name, nullptr, 10));
+		}
+		::closedir(dir);
+		std::sort(tids.begin(), tids.end());
+		return tids;
+	}
+};
+
+// a range of another process's memory, reads and writes like MemoryArea
+class LinuxMemoryArea
+{
+private:
+	LinuxProcess process;
+	uintptr_t address_;
+	size_t size_;
+
+public:
+	LinuxMemoryArea(const LinuxProcess& process, uintptr_t address, size_t size)
+		: process(process)
+		, address_(address)
+		, size_(size)
+	{}
+
+	uintptr_t address() const
+	{
+		return address_;
+	}
+
+	size_t size() const
+	{
+		return size_;
+	}
+
+	void write(const void* src)
+	{
+		write(src, size_);
+	}
+
+	void write(const void* src, size_t size)
+	{
+		process.write(address_, src, size);
+	}
+
+	std::vector<uint8_t> read() const
+	{
+		std::vector<uint8_t> buf(size_);
+		process.read(address_, buf.data(), buf.size());
+		return buf;
+	}
+};
+#endif
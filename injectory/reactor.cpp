@@ -0,0 +1,152 @@
+#include "injectory/reactor.hpp"
+
+WaitReactor& WaitReactor::instance()
+{
+	static WaitReactor r;
+	return r;
+}
+
+WaitReactor::Waiter::Waiter()
+	: wake(CreateEventW(nullptr, FALSE, FALSE, nullptr), CloseHandle)
+{
+	if (!wake)
+	{
+		DWORD errcode = GetLastError();
+		BOOST_THROW_EXCEPTION(ex_wait_for_multiple_objects() << e_api_function("CreateEvent") << e_text("could not create waiter event") << e_last_error(errcode));
+	}
+}
+
+void WaitReactor::Waiter::run()
+{
+	vector<Entry> entries;
+	vector<handle_t> handles;
+	for (;;)
+	{
+		handles.clear();
+		handles.push_back(wake.handle());
+		for (const Entry& e : entries)
+			handles.push_back(e.handle.handle());
+
+		DWORD ret = WaitForMultipleObjects((DWORD)handles.size(), &handles[0], FALSE, INFINITE);
+
+		if (ret == WAIT_OBJECT_0)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (stopping)
+				return;
+			for (Entry& e : pending)
+				entries.push_back(std::move(e));
+			pending.clear();
+			continue;
+		}
+
+		size_t i;
+		if (ret > WAIT_OBJECT_0 && ret < WAIT_OBJECT_0 + handles.size())
+			i = ret - WAIT_OBJECT_0 - 1;
+		else if (ret > WAIT_ABANDONED_0 && ret < WAIT_ABANDONED_0 + handles.size())
+			i = ret - WAIT_ABANDONED_0 - 1;
+		else
+		{
+			// one of the handles is bad, each is probed to find it, the others are signaled or still waited for
+			vector<std::pair<Entry, DWORD>> done;
+			for (auto it = entries.begin(); it != entries.end(); )
+			{
+				DWORD probe = WaitForSingleObject(it->handle.handle(), 0);
+				if (probe == WAIT_TIMEOUT)
+				{
+					++it;
+					continue;
+				}
+				done.push_back({ std::move(*it), probe == WAIT_FAILED ? WAIT_FAILED : probe == WAIT_ABANDONED ? WAIT_ABANDONED_0 : WAIT_OBJECT_0 });
+				it = entries.erase(it);
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				count -= done.size();
+			}
+			for (auto& [e, result] : done)
+				e.callback(result);
+			continue;
+		}
+
+		Entry e = std::move(entries[i]);
+		entries.erase(entries.begin() + i);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			count--;
+		}
+		e.callback(ret >= WAIT_ABANDONED_0 ? WAIT_ABANDONED_0 : WAIT_OBJECT_0);
+	}
+}
+
+WaitReactor::~WaitReactor()
+{
+	for (auto& waiter : waiters)
+	{
+		{
+			std::lock_guard<std::mutex> lock(waiter->mutex);
+			waiter->stopping = true;
+		}
+		SetEvent(waiter->wake.handle());
+		waiter->thread.join();
+	}
+}
+
+void WaitReactor::watch(const WinHandle& handle, Callback callback)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	Waiter* waiter = nullptr;
+	for (auto& w : waiters)
+	{
+		std::lock_guard<std::mutex> wlock(w->mutex);
+		if (w->count < handlesPerWaiter)
+		{
+			waiter = w.get();
+			break;
+		}
+	}
+	if (!waiter)
+	{
+		waiters.push_back(std::make_unique<Waiter>());
+		waiter = waiters.back().get();
+		waiter->thread = std::thread(&Waiter::run, waiter);
+	}
+
+	{
+		std::lock_guard<std::mutex> wlock(waiter->mutex);
+		waiter->pending.push_back({ handle, std::move(callback) });
+		waiter->count++;
+	}
+	if (!SetEvent(waiter->wake.handle()))
+	{
+		DWORD errcode = GetLastError();
+		BOOST_THROW_EXCEPTION(ex_wait_for_multiple_objects() << e_api_function("SetEvent") << e_text("could not wake waiter thread") << e_last_error(errcode));
+	}
+}
+
+std::future<DWORD> WaitReactor::exitCode(const Thread& thread)
+{
+	auto promise = std::make_shared<std::promise<DWORD>>();
+	std::future<DWORD> future = promise->get_future();
+	watch(thread, [thread, promise](DWORD waitResult)
+	{
+		try
+		{
+			if (waitResult == WAIT_FAILED)
+				BOOST_THROW_EXCEPTION(ex_wait_for_multiple_objects() << e_api_function("WaitForMultipleObjects") << e_text("could not wait for thread") << e_tid(thread.id()));
+			promise->set_value(thread.exitCode());
+		}
+		catch (...)
+		{
+			promise->set_exception(std::current_exception());
+		}
+	});
+	return future;
+}
+
+size_t WaitReactor::waiterCount()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return waiters.size();
+}
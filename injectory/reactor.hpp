@@ -0,0 +1,61 @@
+#pragma once
+#include "injectory/common.hpp"
+#include "injectory/exception.hpp"
+#include "injectory/winhandle.hpp"
+#include "injectory/thread.hpp"
+#include <future>
+#include <mutex>
+#include <thread>
+
+// waits on any number of handles with a few threads, each covering up to
+// MAXIMUM_WAIT_OBJECTS-1 handles plus an event used to hand it new ones
+class WaitReactor
+{
+public:
+	// gets the result of the wait, WAIT_OBJECT_0, WAIT_ABANDONED_0 or WAIT_FAILED
+	using Callback = function<void(DWORD waitResult)>;
+
+	static const size_t handlesPerWaiter = MAXIMUM_WAIT_OBJECTS - 1;
+
+private:
+	struct Entry
+	{
+		WinHandle handle;
+		Callback callback;
+	};
+
+	class Waiter
+	{
+	public:
+		WinHandle wake;
+		std::mutex mutex;
+		vector<Entry> pending;
+		size_t count = 0; // handles owned, including pending ones
+		bool stopping = false;
+		std::thread thread;
+
+		Waiter();
+		void run();
+	};
+
+	std::mutex mutex;
+	vector<std::unique_ptr<Waiter>> waiters;
+
+public:
+	WaitReactor() = default;
+	WaitReactor(const WaitReactor&) = delete;
+	WaitReactor& operator=(const WaitReactor&) = delete;
+	~WaitReactor();
+
+	// calls callback once on a waiter thread when handle is signaled, callbacks should be short.
+	// WAIT_FAILED means handle can't be waited on, not that whatever it stands for is done
+	void watch(const WinHandle& handle, Callback callback);
+
+	// becomes ready with the exit code when the thread terminates
+	std::future<DWORD> exitCode(const Thread& thread);
+
+	size_t waiterCount();
+
+public:
+	static WaitReactor& instance();
+};
@@ -0,0 +1,342 @@
+#pragma once
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// a range of pages with identical attributes, mirrors MEMORY_BASIC_INFORMATION
+// but without depending on Windows.h so the region logic stays portable
+struct Region
+{
+	// same values as the Win32 MEM_* constants
+	static constexpr uint32_t Commit	= 0x1000;
+	static constexpr uint32_t Reserve	= 0x2000;
+	static constexpr uint32_t Free		= 0x10000;
+	static constexpr uint32_t Private	= 0x20000;
+	static constexpr uint32_t Mapped	= 0x40000;
+	static constexpr uint32_t Image		= 0x1000000;
+
+	uintptr_t base = 0;
+	uintptr_t size = 0;
+	uintptr_t allocationBase = 0;
+	uint32_t state = Free;
+	uint32_t protect = 0;
+	uint32_t allocationProtect = 0;
+	uint32_t type = 0;
+
+	uintptr_t end() const
+	{
+		return base + size;
+	}
+
+	bool isFree() const
+	{
+		return state == Free;
+	}
+
+	// the first region of a mapped image, i.e. the module handle
+	bool isModuleBase() const
+	{
+		return type == Image && base == allocationBase;
+	}
+
+	bool operator==(const Region& o) const
+	{
+		return base == o.base && size == o.size && allocationBase == o.allocationBase &&
+			state == o.state && protect == o.protect && allocationProtect == o.allocationProtect && type == o.type;
+	}
+	bool operator!=(const Region& o) const
+	{
+		return !(*this == o);
+	}
+};
+
+
+
+// a sorted list of all regions in an address range that can be refreshed
+// incrementally by re-querying only windows where something is known to have changed
+class RegionMap
+{
+public:
+	// returns the region containing address, or nullopt past the end of the address space
+	using Query = std::function<std::optional<Region>(uintptr_t address)>;
+
+	struct Range
+	{
+		uintptr_t begin;
+		uintptr_t end;
+	};
+
+	struct Diff
+	{
+		std::vector<Region> added;
+		std::vector<Region> removed;
+		std::vector<uintptr_t> addedModules;
+		std::vector<uintptr_t> removedModules;
+		size_t queries = 0;
+
+		bool empty() const
+		{
+			return added.empty() && removed.empty();
+		}
+	};
+
+private:
+	std::vector<Region> regions_;
+	uintptr_t begin_ = 0;
+	uintptr_t end_ = 0;
+
+public:
+	RegionMap() = default;
+
+	const std::vector<Region>& regions() const
+	{
+		return regions_;
+	}
+
+	uintptr_t begin() const
+	{
+		return begin_;
+	}
+
+	uintptr_t end() const
+	{
+		return end_;
+	}
+
+	// returns the region containing address or nullptr
+	const Region* find(uintptr_t address) const
+	{
+		auto it = std::upper_bound(regions_.begin(), regions_.end(), address,
+			[](uintptr_t a, const Region& r) { return a < r.base; });
+		if (it == regions_.begin())
+			return nullptr;
+		--it;
+		return address < it->end() ? &*it : nullptr;
+	}
+
+	// allocation bases of all mapped images, sorted
+	std::vector<uintptr_t> modules() const
+	{
+		std::vector<uintptr_t> bases;
+		for (const Region& r : regions_)
+		{
+			if (r.isModuleBase())
+				bases.push_back(r.base);
+		}
+		return bases;
+	}
+
+	// free ranges are the only places where a new allocation or module can show up
+	std::vector<Range> freeRanges() const
+	{
+		std::vector<Range> ranges;
+		for (const Region& r : regions_)
+		{
+			if (r.isFree())
+				ranges.push_back({ r.base, r.end() });
+		}
+		return ranges;
+	}
+
+	// walks [begin, end) and appends the regions to out, returns the number of queries
+	static size_t walk(const Query& query, uintptr_t begin, uintptr_t end, std::vector<Region>& out)
+	{
+		size_t queries = 0;
+		for (uintptr_t addr = begin; addr < end; )
+		{
+			std::optional<Region> r = query(addr);
+			queries++;
+			if (!r || r->size == 0)
+				break;
+			out.push_back(*r);
+			addr = r->end();
+		}
+		return queries;
+	}
+
+	static RegionMap scan(const Query& query, uintptr_t begin, uintptr_t end)
+	{
+		RegionMap map;
+		map.begin_ = begin;
+		map.end_ = end;
+		walk(query, begin, end, map.regions_);
+		return map;
+	}
+
+	// splits [begin, end) into page aligned shards that are walked concurrently by up to
+	// threads workers (0 means one per shard) and stitched into the same list a sequential scan gives
+	static RegionMap scan(const Query& query, uintptr_t begin, uintptr_t end, unsigned shards, unsigned threads = 0)
+	{
+		const uintptr_t pageSize = 0x1000;
+		uintptr_t shardSize = ((end - begin) / (std::max)(shards, 1u) + pageSize - 1) & ~(pageSize - 1);
+		if (shards <= 1 || shardSize == 0)
+			return scan(query, begin, end);
+
+		std::vector<Range> ranges;
+		for (uintptr_t b = begin; b < end; b += (std::min)(shardSize, end - b))
+			ranges.push_back({ b, (std::min)(b + shardSize, end) });
+
+		std::vector<std::vector<Region>> results(ranges.size());
+		std::atomic<size_t> next = 0;
+		auto worker = [&]
+		{
+			for (size_t i = next++; i < ranges.size(); i = next++)
+				walk(query, ranges[i].begin, ranges[i].end, results[i]);
+		};
+
+		if (threads == 0 || threads > ranges.size())
+			threads = (unsigned)ranges.size();
+		std::vector<std::thread> pool;
+		for (unsigned i = 1; i < threads; i++)
+			pool.emplace_back(worker);
+		worker();
+		for (std::thread& t : pool)
+			t.join();
+
+		// the last region of a shard usually runs into the next one, where it was
+		// queried again starting at the shard boundary, so drop or clip those
+		RegionMap map;
+		map.begin_ = begin;
+		map.end_ = end;
+		for (const std::vector<Region>& shard : results)
+		{
+			for (Region r : shard)
+			{
+				if (!map.regions_.empty())
+				{
+					uintptr_t covered = map.regions_.back().end();
+					if (r.end() <= covered)
+						continue;
+					if (r.base < covered)
+					{
+						r.size = r.end() - covered;
+						r.base = covered;
+					}
+				}
+				map.regions_.push_back(r);
+			}
+		}
+		return map;
+	}
+
+	// re-queries only the given windows, widened to the known region boundaries around them,
+	// and returns what changed
+	Diff refresh(const Query& query, std::vector<Range> windows)
+	{
+		Diff diff;
+		const std::vector<uintptr_t> modulesBefore = modules();
+
+		std::sort(windows.begin(), windows.end(), [](const Range& a, const Range& b) { return a.begin < b.begin; });
+
+		std::vector<Region> merged;
+		merged.reserve(regions_.size());
+		auto old = regions_.begin();
+
+		for (const Range& window : windows)
+		{
+			uintptr_t begin = (std::max)(window.begin, begin_);
+			uintptr_t end = (std::min)(window.end, end_);
+			if (begin >= end)
+				continue;
+
+			// windows overlapping an already refreshed span are covered
+			if (!merged.empty() && begin < merged.back().end())
+				begin = merged.back().end();
+			if (begin >= end)
+				continue;
+
+			// keep unchanged regions before the window
+			while (old != regions_.end() && old->end() <= begin)
+				merged.push_back(*old++);
+
+			// start at the boundary of the region containing the window start
+			uintptr_t pos = (old != regions_.end() && old->base < begin) ? old->base : begin;
+			if (!merged.empty() && pos < merged.back().end())
+				pos = merged.back().end();
+
+			// walk until the fresh regions line up with an old boundary again
+			std::vector<Region> fresh;
+			auto probe = old;
+			for (;;)
+			{
+				std::optional<Region> r = query(pos);
+				diff.queries++;
+				if (!r || r->size == 0)
+				{
+					pos = end_;
+					break;
+				}
+				fresh.push_back(*r);
+				pos = r->end();
+				if (pos >= end_)
+					break;
+				if (pos < end)
+					continue;
+				while (probe != regions_.end() && probe->end() < pos)
+					++probe;
+				if (probe == regions_.end() || probe->end() == pos || probe->base == pos)
+					break;
+			}
+
+			// a full scan never splits a free region, but the walk starts where the window does, so a free
+			// region ending there is taken back and queried from its own start
+			if (!merged.empty() && !fresh.empty() && merged.back().isFree() && fresh.front().isFree() &&
+				merged.back().end() == fresh.front().base)
+			{
+				const Region before = merged.back();
+				std::optional<Region> whole = query(before.base);
+				diff.queries++;
+				if (whole && whole->base == before.base && whole->end() == fresh.front().end())
+				{
+					merged.pop_back();
+					fresh.front() = *whole;
+					// before was either added by an earlier window or kept from the old map
+					auto added = std::find(diff.added.begin(), diff.added.end(), before);
+					if (added != diff.added.end())
+						diff.added.erase(added);
+					else
+						diff.removed.push_back(before);
+				}
+			}
+
+			// everything old that was re-walked is replaced
+			replaceStale(old, pos, fresh, diff);
+			merged.insert(merged.end(), fresh.begin(), fresh.end());
+		}
+		merged.insert(merged.end(), old, regions_.end());
+		regions_ = std::move(merged);
+
+		const std::vector<uintptr_t> modulesAfter = modules();
+		std::set_difference(modulesAfter.begin(), modulesAfter.end(), modulesBefore.begin(), modulesBefore.end(),
+			std::back_inserter(diff.addedModules));
+		std::set_difference(modulesBefore.begin(), modulesBefore.end(), modulesAfter.begin(), modulesAfter.end(),
+			std::back_inserter(diff.removedModules));
+		return diff;
+	}
+
+private:
+	// moves old regions up to pos out of the map and records which of them
+	// and which of the fresh ones differ
+	void replaceStale(std::vector<Region>::iterator& old, uintptr_t pos, const std::vector<Region>& fresh, Diff& diff)
+	{
+		std::vector<Region> stale;
+		while (old != regions_.end() && old->base < pos)
+			stale.push_back(*old++);
+
+		for (const Region& r : stale)
+		{
+			if (std::find(fresh.begin(), fresh.end(), r) == fresh.end())
+				diff.removed.push_back(r);
+		}
+		for (const Region& r : fresh)
+		{
+			if (std::find(stale.begin(), stale.end(), r) == stale.end())
+				diff.added.push_back(r);
+		}
+	}
+};
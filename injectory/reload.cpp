@@ -0,0 +1,87 @@
+#include "injectory/reload.hpp"
+#include "injectory/process.hpp"
+#include "injectory/fasthash.hpp"
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <algorithm>
+#include <sstream>
+
+MappedImages MappedImages::of(const Process& proc)
+{
+	MappedImages registry;
+	registry.file = fs::temp_directory_path() / "injectory" / (format("%d-%016x.images") % proc.id() % proc.creationTime()).str();
+
+	// one image per line: base size entry hash,hash,... path
+	fs::ifstream in(registry.file);
+	string line;
+	while (std::getline(in, line))
+	{
+		std::istringstream ss(line);
+		Image image;
+		string hashes;
+		if (!(ss >> std::hex >> image.base >> image.size >> image.entryPoint >> hashes))
+			continue;
+		std::getline(ss >> std::ws, line);
+		image.path = to_wstring(line);
+
+		// a line that doesn't parse is dropped, that image is mapped anew
+		vector<string> parts;
+		boost::split(parts, hashes, boost::is_any_of(","));
+		try
+		{
+			for (const string& part : parts)
+				image.pageHashes.push_back(std::stoull(part, nullptr, 16));
+		}
+		catch (const std::exception&)
+		{
+			continue;
+		}
+		if (!image.path.empty())
+			registry.images.push_back(std::move(image));
+	}
+	return registry;
+}
+
+MappedImages::Image* MappedImages::find(const fs::path& path)
+{
+	for (Image& image : images)
+	{
+		if (boost::iequals(image.path.filename().wstring(), path.filename().wstring()))
+			return &image;
+	}
+	return nullptr;
+}
+
+void MappedImages::erase(const fs::path& path)
+{
+	images.erase(std::remove_if(images.begin(), images.end(), [&](const Image& image)
+	{
+		return boost::iequals(image.path.filename().wstring(), path.filename().wstring());
+	}), images.end());
+}
+
+void MappedImages::update(Image image)
+{
+	erase(image.path);
+	images.push_back(std::move(image));
+}
+
+void MappedImages::save() const
+{
+	fs::create_directories(file.parent_path());
+	fs::ofstream out(file, std::ios::trunc);
+	for (const Image& image : images)
+	{
+		out << std::hex << image.base << ' ' << image.size << ' ' << image.entryPoint << ' ';
+		for (size_t i = 0; i < image.pageHashes.size(); i++)
+			out << (i ? "," : "") << image.pageHashes[i];
+		out << ' ' << to_string(image.path.wstring()) << '\n';
+	}
+	if (!out)
+		BOOST_THROW_EXCEPTION(ex_injection() << e_text("could not save mapped images") << e_file(file));
+}
+
+vector<uint64_t> MappedImages::pageHashes(const byte* data, size_t size, WorkPool* pool)
+{
+	return FastHash::chunks(data, size, 0x1000, pool);
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "injectory/common.hpp"
+#include "injectory/module.hpp"
+#include "injectory/workpool.hpp"
+#include <chrono>
+
+// the images --reload mapped into one process, kept in a file per process so that a later
+// run can patch them in place. keyed by pid and creation time so a reused pid starts empty
+class MappedImages
+{
+public:
+	struct Image
+	{
+		fs::path path;
+		uintptr_t base;
+		SIZE_T size;				// of the allocation, a new build fits if it is no larger
+		DWORD entryPoint;			// rva, 0 if there is none
+		vector<uint64_t> pageHashes;	// of the relocated and import-fixed contents as written
+	};
+
+private:
+	fs::path file;
+	vector<Image> images;
+
+public:
+	static MappedImages of(const Process& proc);
+
+	// the image previously mapped from a file with the same name
+	Image* find(const fs::path& path);
+	void erase(const fs::path& path);
+	void update(Image image);
+	void save() const;
+
+	static vector<uint64_t> pageHashes(const byte* data, size_t size, WorkPool* pool = nullptr);
+};
+
+// what a --reload did
+struct Reload
+{
+	Module module;
+	bool inPlace = false;		// patched at the old base instead of mapped anew
+	size_t pages = 0;
+	size_t pagesWritten = 0;
+	ImportStats imports;
+	std::chrono::steady_clock::duration latency;
+};
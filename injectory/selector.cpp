@@ -0,0 +1,365 @@
+#include "injectory/selector.hpp"
+#include <boost/algorithm/string.hpp>
+#include <TlHelp32.h>
+#include <algorithm>
+#include <cwctype>
+
+ProcessSnapshot ProcessSnapshot::take(const Selector& selector)
+{
+	ProcessSnapshot snapshot;
+	FILETIME now;
+	GetSystemTimeAsFileTime(&now);
+	snapshot.taken = ((uint64_t)now.dwHighDateTime << 32) | now.dwLowDateTime;
+
+	WinHandle procSnap(CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0), CloseHandle);
+	if (procSnap.handle() == INVALID_HANDLE_VALUE)
+	{
+		DWORD errcode = GetLastError();
+		BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("CreateToolhelp32Snapshot") << e_text("could not get process snapshot") << e_last_error(errcode));
+	}
+
+	const bool sessions = selector.uses(Selector::Session);
+	PROCESSENTRY32W pe32 = { sizeof(PROCESSENTRY32W) };
+	if (Process32FirstW(procSnap.handle(), &pe32))
+	{
+		do
+		{
+			Entry e;
+			e.pid = pe32.th32ProcessID;
+			e.parentPid = pe32.th32ParentProcessID;
+			e.exeName = pe32.szExeFile;
+			if (sessions && !ProcessIdToSessionId(e.pid, &e.session))
+				e.session = (DWORD)-1; // exited since the snapshot, matches no session
+			snapshot.byPid[e.pid] = snapshot.processes.size();
+			snapshot.processes.push_back(std::move(e));
+		} while (Process32NextW(procSnap.handle(), &pe32));
+	}
+
+	if (selector.uses(Selector::Title) || selector.uses(Selector::Class))
+	{
+		EnumWindows([](HWND hwnd, LPARAM param) -> BOOL
+		{
+			Window w;
+			GetWindowThreadProcessId(hwnd, &w.pid);
+
+			WCHAR className[256];
+			int n = GetClassNameW(hwnd, className, 256);
+			w.className.assign(className, (std::max)(n, 0));
+
+			// the text a window keeps itself, no message is sent to a window that might hang
+			int length = GetWindowTextLengthW(hwnd);
+			if (length > 0)
+			{
+				w.title.resize(length + 1);
+				n = GetWindowTextW(hwnd, &w.title[0], length + 1);
+				w.title.resize((std::max)(n, 0));
+			}
+
+			((vector<Window>*)param)->push_back(std::move(w));
+			return TRUE;
+		}, (LPARAM)&snapshot.windows);
+
+		std::stable_sort(snapshot.windows.begin(), snapshot.windows.end(), [](const Window& a, const Window& b) { return a.pid < b.pid; });
+		for (size_t i = 0; i < snapshot.windows.size(); )
+		{
+			size_t end = i;
+			while (end < snapshot.windows.size() && snapshot.windows[end].pid == snapshot.windows[i].pid)
+				end++;
+			auto it = snapshot.byPid.find(snapshot.windows[i].pid);
+			if (it != snapshot.byPid.end())
+			{
+				snapshot.processes[it->second].firstWindow = i;
+				snapshot.processes[it->second].windowCount = end - i;
+			}
+			i = end;
+		}
+	}
+	return snapshot;
+}
+
+const Process* ProcessSnapshot::open(const Entry& e) const
+{
+	if (!e.opened)
+	{
+		e.opened = true;
+		try
+		{
+			e.proc = Process::open(e.pid, false, PROCESS_QUERY_LIMITED_INFORMATION);
+		}
+		catch (...)
+		{
+			// exited since the snapshot or access denied
+		}
+	}
+	return e.proc ? &e.proc : nullptr;
+}
+
+optional<uint64_t> ProcessSnapshot::creationTime(const Entry& e) const
+{
+	const Process* proc = open(e);
+	if (!proc)
+		return nullopt;
+	try { return proc->creationTime(); }
+	catch (...) { return nullopt; }
+}
+
+optional<wstring> ProcessSnapshot::commandLine(const Entry& e) const
+{
+	const Process* proc = open(e);
+	if (!proc)
+		return nullopt;
+	try { return proc->commandLine(); }
+	catch (...) { return nullopt; }
+}
+
+
+
+namespace
+{
+	// in 100ns intervals
+	optional<uint64_t> parseDuration(const wstring& s)
+	{
+		size_t end = 0;
+		uint64_t n = 0;
+		try { n = std::stoull(s, &end); }
+		catch (const std::exception&) { return nullopt; }
+
+		const wstring unit = s.substr(end);
+		if (unit == L"ms")
+			return n * 10000;
+		else if (unit == L"s" || unit.empty())
+			return n * 10000000;
+		else if (unit == L"m")
+			return n * 600000000;
+		else if (unit == L"h")
+			return n * 36000000000;
+		return nullopt;
+	}
+}
+
+Selector Selector::parse(const wstring& expression)
+{
+	auto fail = [&](const string& why)
+	{
+		BOOST_THROW_EXCEPTION(ex_injection() << e_text("invalid selector '" + to_string(expression) + "', " + why));
+	};
+
+	static const map<wstring, Key> keys =
+	{
+		{ L"pid",		Pid },
+		{ L"parent",	Parent },
+		{ L"session",	Session },
+		{ L"exe",		Exe },
+		{ L"title",		Title },
+		{ L"class",		Class },
+		{ L"age",		Age },
+		{ L"cmdline",	CmdLine },
+	};
+
+	Selector selector;
+	selector.expression = expression;
+	const size_t n = expression.size();
+	for (size_t i = 0; ; )
+	{
+		while (i < n && std::iswspace(expression[i]))
+			i++;
+		if (i == n)
+			break;
+
+		Term term;
+		if (expression[i] == L'!')
+		{
+			term.negate = true;
+			i++;
+		}
+
+		const size_t start = i;
+		while (i < n && std::iswalpha(expression[i]))
+			i++;
+		const wstring key = boost::to_lower_copy(expression.substr(start, i - start));
+		auto it = keys.find(key);
+		if (it == keys.end())
+			fail("unknown key '" + to_string(key) + "'");
+		term.key = it->second;
+
+		if (i == n || (expression[i] != L':' && expression[i] != L'<' && expression[i] != L'>'))
+			fail("expected :, < or > after '" + to_string(key) + "'");
+		term.op = (char)expression[i++];
+		if (term.key == Age && term.op == ':')
+			fail("age takes < or >");
+		if (term.key != Age && term.op != ':')
+			fail("'" + to_string(key) + "' takes :");
+
+		// up to the next space outside of quotes
+		wstring value;
+		bool quoted = false;
+		for (; i < n && (quoted || !std::iswspace(expression[i])); i++)
+		{
+			if (expression[i] == L'"')
+				quoted = !quoted;
+			else
+				value += expression[i];
+		}
+		if (quoted)
+			fail("unterminated quote");
+
+		switch (term.key)
+		{
+		case Pid:
+		case Parent:
+		case Session:
+		{
+			size_t end = 0;
+			try { term.number = std::stoull(value, &end); }
+			catch (const std::exception&) {}
+			if (value.empty() || end != value.size())
+				fail("'" + to_string(key) + "' takes a number");
+			break;
+		}
+		case Age:
+		{
+			optional<uint64_t> age = parseDuration(value);
+			if (!age)
+				fail("invalid duration '" + to_string(value) + "'");
+			term.number = *age;
+			break;
+		}
+		default:
+			term.text = value;
+			break;
+		}
+		selector.terms.push_back(std::move(term));
+	}
+
+	if (selector.terms.empty())
+		fail("no terms");
+
+	// what only needs the snapshot goes before what needs a handle to the process
+	std::stable_sort(selector.terms.begin(), selector.terms.end(), [](const Term& a, const Term& b) { return a.key < b.key; });
+	return selector;
+}
+
+bool Selector::uses(Key key) const
+{
+	return std::any_of(terms.begin(), terms.end(), [key](const Term& t) { return t.key == key; });
+}
+
+bool Selector::glob(const wstring& pattern, const wstring& text)
+{
+	// greedy with backtracking to the last *, linear for patterns with one *
+	size_t p = 0, t = 0;
+	size_t star = wstring::npos, mark = 0;
+	while (t < text.size())
+	{
+		if (p < pattern.size() && (pattern[p] == L'?' || std::towlower(pattern[p]) == std::towlower(text[t])))
+		{
+			p++;
+			t++;
+		}
+		else if (p < pattern.size() && pattern[p] == L'*')
+		{
+			star = p++;
+			mark = t;
+		}
+		else if (star != wstring::npos)
+		{
+			p = star + 1;
+			t = ++mark;
+		}
+		else
+			return false;
+	}
+	while (p < pattern.size() && pattern[p] == L'*')
+		p++;
+	return p == pattern.size();
+}
+
+bool Selector::holds(const Term& term, const ProcessSnapshot& snapshot, const ProcessSnapshot::Entry& e) const
+{
+	// a term that can't be decided, e.g. the command line of a process we may not open, fails either way
+	optional<bool> result;
+	switch (term.key)
+	{
+	case Pid:		result = e.pid == term.number; break;
+	case Parent:	result = e.parentPid == term.number; break;
+	case Session:	result = e.session == term.number; break;
+	case Exe:		result = glob(term.text, e.exeName); break;
+	case Age:
+		if (optional<uint64_t> created = snapshot.creationTime(e))
+		{
+			const uint64_t age = snapshot.taken > *created ? snapshot.taken - *created : 0;
+			result = term.op == '<' ? age < term.number : age > term.number;
+		}
+		break;
+	case CmdLine:
+		if (optional<wstring> commandLine = snapshot.commandLine(e))
+			result = boost::icontains(*commandLine, term.text);
+		break;
+	default:
+		break;
+	}
+	return result && *result != term.negate;
+}
+
+bool Selector::windowsHold(const ProcessSnapshot& snapshot, const ProcessSnapshot::Entry& e) const
+{
+	auto matches = [](const Term& term, const ProcessSnapshot::Window& w)
+	{
+		return glob(term.text, term.key == Title ? w.title : w.className);
+	};
+
+	bool anyPositive = false, found = false;
+	const ProcessSnapshot::Window* windows = snapshot.windowsOf(e);
+	for (size_t i = 0; i < e.windowCount; i++)
+	{
+		bool all = true;
+		for (const Term& term : terms)
+		{
+			if (term.key != Title && term.key != Class)
+				continue;
+			// a negated term excludes the process if any of its windows matches
+			if (term.negate && matches(term, windows[i]))
+				return false;
+			if (!term.negate)
+			{
+				anyPositive = true;
+				all = all && matches(term, windows[i]);
+			}
+		}
+		found = found || all;
+	}
+	if (e.windowCount == 0)
+		return std::none_of(terms.begin(), terms.end(), [](const Term& t) { return (t.key == Title || t.key == Class) && !t.negate; });
+	return !anyPositive || found;
+}
+
+vector<ProcessEntry> Selector::select(const ProcessSnapshot& snapshot) const
+{
+	vector<ProcessEntry> matches;
+	for (const ProcessSnapshot::Entry& e : snapshot.processes)
+	{
+		bool ok = true;
+		bool windowsChecked = false;
+		for (const Term& term : terms)
+		{
+			if (term.key == Title || term.key == Class)
+			{
+				if (windowsChecked)
+					continue;
+				windowsChecked = true;
+				ok = windowsHold(snapshot, e);
+			}
+			else
+				ok = holds(term, snapshot, e);
+			if (!ok)
+				break;
+		}
+		if (!ok)
+			continue;
+
+		// with the creation time the match still identifies the process when it is opened later
+		if (optional<uint64_t> created = snapshot.creationTime(e))
+			matches.push_back({ e.pid, *created, e.exeName });
+	}
+	return matches;
+}
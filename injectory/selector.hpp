@@ -0,0 +1,122 @@
+#pragma once
+#include "injectory/common.hpp"
+#include "injectory/process.hpp"
+#include "injectory/watch.hpp"
+#include <unordered_map>
+
+class Selector;
+
+// every process and every top-level window at one moment, windows grouped by their process so a
+// process finds its own in one lookup. what needs a handle to the process, its creation time and
+// command line, is only asked for the processes that got that far in a selection
+class ProcessSnapshot
+{
+public:
+	struct Window
+	{
+		pid_t pid = 0;
+		wstring className;
+		wstring title;
+	};
+
+	struct Entry
+	{
+		pid_t pid = 0;
+		pid_t parentPid = 0;
+		DWORD session = 0;
+		wstring exeName;
+		size_t firstWindow = 0;
+		size_t windowCount = 0;
+
+	private:
+		friend class ProcessSnapshot;
+		mutable Process proc;
+		mutable bool opened = false;
+	};
+
+	vector<Entry> processes;
+	vector<Window> windows;	// sorted by pid
+	std::unordered_map<pid_t, size_t> byPid;
+	uint64_t taken = 0;		// 100ns intervals since 1601, like creation times
+
+	// only what selector asks about is collected, windows and sessions cost a call each
+	static ProcessSnapshot take(const Selector& selector);
+
+	const Window* windowsOf(const Entry& e) const
+	{
+		return windows.data() + e.firstWindow;
+	}
+
+	const Entry* find(pid_t pid) const
+	{
+		auto it = byPid.find(pid);
+		return it == byPid.end() ? nullptr : &processes[it->second];
+	}
+
+	// opened for queries on first use, nullopt if it exited or access was denied
+	optional<uint64_t> creationTime(const Entry& e) const;
+	optional<wstring> commandLine(const Entry& e) const;
+
+private:
+	const Process* open(const Entry& e) const;
+};
+
+
+
+// which processes to target, as terms that all have to hold, e.g.
+//   exe:chrome.exe cmdline:--type=renderer !title:*Incognito* age<10m
+// exe:GLOB, title:GLOB and class:GLOB compare without case, * and ? are wildcards, the title and
+// class terms have to hold for one and the same top-level window of the process. cmdline:TEXT is a
+// substring without case. pid:N, parent:N and session:N are exact. age<DURATION and age>DURATION
+// bound how long ago the process was created, in ms, s, m or h, seconds without a unit. a ! in
+// front negates a term, quotes keep spaces in a value
+class Selector
+{
+public:
+	enum Key
+	{
+		// cheapest first, terms are checked in this order
+		Pid,
+		Parent,
+		Session,
+		Exe,
+		Title,
+		Class,
+		Age,
+		CmdLine,
+	};
+
+	struct Term
+	{
+		Key key;
+		bool negate = false;
+		char op = ':';	// '<' or '>' for age
+		wstring text;
+		uint64_t number = 0;	// a pid or session, or the age in 100ns intervals
+	};
+
+private:
+	vector<Term> terms;
+	wstring expression;
+
+	bool holds(const Term& term, const ProcessSnapshot& snapshot, const ProcessSnapshot::Entry& e) const;
+	bool windowsHold(const ProcessSnapshot& snapshot, const ProcessSnapshot::Entry& e) const;
+
+public:
+	// throws ex_injection for an expression that doesn't parse
+	static Selector parse(const wstring& expression);
+
+	bool uses(Key key) const;
+
+	// every matching process in one pass over the snapshot, in snapshot order. processes that
+	// exited before their creation time could be read are left out
+	vector<ProcessEntry> select(const ProcessSnapshot& snapshot) const;
+
+	const wstring& describe() const
+	{
+		return expression;
+	}
+
+	// case-insensitive, * for any run of characters, ? for one
+	static bool glob(const wstring& pattern, const wstring& text);
+};
@@ -36,9 +36,44 @@ void Thread::setPriority(int priority)
 	}
 }
 
+void Thread::setIdealProcessor(DWORD processor)
+{
+	if (SetThreadIdealProcessor(handle(), processor) == (DWORD)-1)
+	{
+		DWORD errcode = GetLastError();
+		BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("SetThreadIdealProcessor") << e_text("could not set ideal processor") << e_last_error(errcode));
+	}
+}
+
+void Thread::setAffinity(DWORD_PTR mask)
+{
+	if (!SetThreadAffinityMask(handle(), mask))
+	{
+		DWORD errcode = GetLastError();
+		BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("SetThreadAffinityMask") << e_text("could not set thread affinity") << e_last_error(errcode));
+	}
+}
+
+Thread::Times Thread::times() const
+{
+	FILETIME creation, exit, kernel, user;
+	if (!GetThreadTimes(handle(), &creation, &exit, &kernel, &user))
+	{
+		DWORD errcode = GetLastError();
+		BOOST_THROW_EXCEPTION(ex_injection() << e_api_function("GetThreadTimes") << e_text("could not get thread times") << e_last_error(errcode));
+	}
+	auto ticks = [](const FILETIME& ft) { return ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime; };
+	return { ticks(creation), ticks(exit), ticks(kernel), ticks(user) };
+}
+
 DWORD Thread::waitForTermination()
 {
 	wait();
+	return exitCode();
+}
+
+DWORD Thread::exitCode() const
+{
 	DWORD exitCode;
 	if (!GetExitCodeThread(handle(), &exitCode))
 	{
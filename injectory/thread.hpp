@@ -46,9 +46,23 @@ public:
 	void hideFromDebugger() const;
 
 	void setPriority(int priority);
+	void setIdealProcessor(DWORD processor);
+	void setAffinity(DWORD_PTR mask);
+
+	// in 100ns intervals, creation and exit since 1601
+	struct Times
+	{
+		uint64_t creation;
+		uint64_t exit;
+		uint64_t kernel;
+		uint64_t user;
+	};
+	Times times() const;
 
 	// returns the threads exit code
 	DWORD waitForTermination();
+	// exit code of a terminated thread
+	DWORD exitCode() const;
 
 public:
 	static Thread open(const tid_t& tid, bool inheritHandle = false, DWORD desiredAccess = THREAD_SET_INFORMATION);
@@ -0,0 +1,97 @@
+#pragma once
+#include "injectory/common.hpp"
+#include "injectory/exception.hpp"
+#include <boost/algorithm/string.hpp>
+#include <mutex>
+
+// how the threads injectory starts in a target are scheduled. time critical by default to get
+// through a suspended target quickly, but a long DllMain at that priority starves the target's own threads
+struct RemoteThreadPolicy
+{
+	int priority = THREAD_PRIORITY_TIME_CRITICAL;
+	optional<DWORD> idealProcessor;
+	optional<DWORD_PTR> affinity;
+	SIZE_T stackSize = 0; // reserved, 0 for the default of the target's exe
+
+	// a THREAD_PRIORITY_* name like "below-normal" or "time-critical", or a number
+	static int parsePriority(const string& name)
+	{
+		static const map<string, int> names =
+		{
+			{ "idle",			THREAD_PRIORITY_IDLE },
+			{ "lowest",			THREAD_PRIORITY_LOWEST },
+			{ "below-normal",	THREAD_PRIORITY_BELOW_NORMAL },
+			{ "normal",			THREAD_PRIORITY_NORMAL },
+			{ "above-normal",	THREAD_PRIORITY_ABOVE_NORMAL },
+			{ "highest",		THREAD_PRIORITY_HIGHEST },
+			{ "time-critical",	THREAD_PRIORITY_TIME_CRITICAL },
+		};
+
+		auto it = names.find(boost::to_lower_copy(name));
+		if (it != names.end())
+			return it->second;
+		try
+		{
+			size_t end = 0;
+			int priority = std::stoi(name, &end);
+			if (end == name.size())
+				return priority;
+		}
+		catch (const std::exception&)
+		{}
+		BOOST_THROW_EXCEPTION(ex_injection() << e_text("invalid thread priority '" + name + "'"));
+	}
+
+	string describe() const
+	{
+		string s = "priority " + to_string(priority);
+		if (idealProcessor)
+			s += ", ideal cpu " + to_string(*idealProcessor);
+		if (affinity)
+			s += (format(", affinity 0x%x") % *affinity).str();
+		if (stackSize)
+			s += (format(", %d kB stack") % (stackSize / 1024)).str();
+		return s;
+	}
+};
+
+// wall and cpu time of the remote threads in every target, what the target had to give up
+class RemoteThreadTimes
+{
+public:
+	struct Totals
+	{
+		size_t threads = 0;
+		double wallMillis = 0;
+		double maxWallMillis = 0;
+		double cpuMillis = 0;
+	};
+
+private:
+	mutable std::mutex mutex;
+	map<pid_t, Totals> totals_;
+
+public:
+	void record(pid_t pid, double wallMillis, double cpuMillis)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Totals& t = totals_[pid];
+		t.threads++;
+		t.wallMillis += wallMillis;
+		t.maxWallMillis = (std::max)(t.maxWallMillis, wallMillis);
+		t.cpuMillis += cpuMillis;
+	}
+
+	Totals totals(pid_t pid) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = totals_.find(pid);
+		return it == totals_.end() ? Totals() : it->second;
+	}
+
+	static RemoteThreadTimes& instance()
+	{
+		static RemoteThreadTimes times;
+		return times;
+	}
+};
@@ -0,0 +1,122 @@
+#include "injectory/trigger.hpp"
+#include <boost/algorithm/string.hpp>
+#include <chrono>
+
+optional<uintptr_t> TriggerSnapshot::findModule(const fs::path& name) const
+{
+	for (const auto&[base, filename] : modules_)
+	{
+		if (boost::iequals(filename.wstring(), name.wstring()))
+			return base;
+	}
+	return nullopt;
+}
+
+bool ExportTrigger::poll(const Process& proc, const TriggerSnapshot& snapshot)
+{
+	optional<uintptr_t> base = snapshot.findModule(module);
+	if (!base)
+	{
+		address = nullopt;
+		return false;
+	}
+
+	if (!address)
+	{
+		try
+		{
+			// throws until the loader has registered the module
+			Module remote((HMODULE)*base, proc);
+			address = (uintptr_t)remote.getProcAddress(procName);
+		}
+		catch (...)
+		{
+			return false;
+		}
+	}
+
+	const Region* r = snapshot.regions().find(*address);
+	return r && r->state == Region::Commit &&
+		(r->protect & (PAGE_EXECUTE | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY));
+}
+
+bool Triggers::poll(const Process& proc)
+{
+	RegionMap::Diff diff;
+	if (!snapshot.scanned)
+	{
+		snapshot.regions_ = proc.regions();
+		snapshot.scanned = true;
+		for (uintptr_t base : snapshot.regions_.modules())
+			diff.addedModules.push_back(base);
+	}
+	else
+	{
+		// new modules can only show up in free ranges, and protection changes while
+		// the loader finishes a module only in images, so re-query just those
+		vector<RegionMap::Range> windows = snapshot.regions_.freeRanges();
+		for (const Region& r : snapshot.regions_.regions())
+		{
+			if (r.type == Region::Image)
+				windows.push_back({ r.base, r.end() });
+		}
+		diff = proc.refresh(snapshot.regions_, windows);
+	}
+
+	for (uintptr_t base : diff.removedModules)
+	{
+		snapshot.modules_.erase(base);
+		snapshot.unnamed_.erase(base);
+	}
+	snapshot.unnamed_.insert(diff.addedModules.begin(), diff.addedModules.end());
+
+	// the name of a module the loader is still mapping may not be readable yet
+	for (auto it = snapshot.unnamed_.begin(); it != snapshot.unnamed_.end(); )
+	{
+		WCHAR buffer[MAX_PATH + 1] = { 0 };
+		if (GetMappedFileNameW(proc.handle(), (void*)*it, buffer, MAX_PATH))
+		{
+			snapshot.modules_[*it] = fs::path(buffer).filename();
+			it = snapshot.unnamed_.erase(it);
+		}
+		else
+			++it;
+	}
+
+	for (const auto& trigger : triggers)
+	{
+		if (trigger->needsThreadCount())
+		{
+			snapshot.threadCount_ = proc.threadCount();
+			break;
+		}
+	}
+
+	for (const auto& trigger : triggers)
+	{
+		if (!trigger->poll(proc, snapshot))
+			return false;
+	}
+	return true;
+}
+
+bool Triggers::check(const Process& proc, DWORD elapsedMillis, DWORD timeoutMillis)
+{
+	if (poll(proc))
+		return true;
+	if (proc.wait(0) != WAIT_TIMEOUT)
+		BOOST_THROW_EXCEPTION(ex_trigger() << e_text("target exited while waiting for " + describe()) << e_process(proc));
+	if (timeoutMillis != INFINITE && elapsedMillis >= timeoutMillis)
+		BOOST_THROW_EXCEPTION(ex_trigger() << e_text("timed out waiting for " + describe()) << e_process(proc));
+	return false;
+}
+
+void Triggers::wait(const Process& proc, DWORD intervalMillis, DWORD timeoutMillis)
+{
+	auto start = std::chrono::steady_clock::now();
+	while (!check(proc, (DWORD)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(), timeoutMillis))
+	{
+		// sleeping on the process handle returns early if the target exits
+		proc.wait(intervalMillis);
+	}
+}
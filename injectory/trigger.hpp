@@ -0,0 +1,172 @@
+#pragma once
+#include "injectory/common.hpp"
+#include "injectory/exception.hpp"
+#include "injectory/process.hpp"
+#include "injectory/module.hpp"
+#include "injectory/regionmap.hpp"
+#include <set>
+
+// what the triggers get to look at, refreshed incrementally on every poll
+class TriggerSnapshot
+{
+	friend class Triggers;
+private:
+	RegionMap regions_;
+	map<uintptr_t, fs::path> modules_; // base -> filename
+	std::set<uintptr_t> unnamed_;		// modules whose name couldn't be read yet, retried every poll
+	optional<size_t> threadCount_;
+	bool scanned = false;
+
+public:
+	const RegionMap& regions() const
+	{
+		return regions_;
+	}
+
+	const map<uintptr_t, fs::path>& modules() const
+	{
+		return modules_;
+	}
+
+	// only valid when a trigger asked for thread counts
+	size_t threadCount() const
+	{
+		return threadCount_.value_or(0);
+	}
+
+	// base address of a loaded module matching name, compared by filename
+	optional<uintptr_t> findModule(const fs::path& name) const;
+};
+
+
+
+class Trigger
+{
+public:
+	virtual ~Trigger()
+	{}
+
+	virtual bool needsThreadCount() const
+	{
+		return false;
+	}
+
+	virtual bool poll(const Process& proc, const TriggerSnapshot& snapshot) = 0;
+	virtual string describe() const = 0;
+};
+
+// fires once a module with the given filename is mapped
+class ModuleTrigger : public Trigger
+{
+	const fs::path name;
+public:
+	ModuleTrigger(const fs::path& name)
+		: name(name.filename())
+	{}
+
+	bool poll(const Process&, const TriggerSnapshot& snapshot) override
+	{
+		return snapshot.findModule(name).has_value();
+	}
+
+	string describe() const override
+	{
+		return "module " + name.string();
+	}
+};
+
+// fires once the target has at least count threads
+class ThreadCountTrigger : public Trigger
+{
+	const size_t count;
+public:
+	ThreadCountTrigger(size_t count)
+		: count(count)
+	{}
+
+	bool needsThreadCount() const override
+	{
+		return true;
+	}
+
+	bool poll(const Process&, const TriggerSnapshot& snapshot) override
+	{
+		return snapshot.threadCount() >= count;
+	}
+
+	string describe() const override
+	{
+		return to_string(count) + " threads";
+	}
+};
+
+// fires once an export of a module is registered with the loader and its code is mapped executable
+class ExportTrigger : public Trigger
+{
+	const fs::path module;
+	const string procName;
+	optional<uintptr_t> address;
+public:
+	ExportTrigger(const fs::path& module, const string& procName)
+		: module(module.filename())
+		, procName(procName)
+	{}
+
+	// parses MODULE!EXPORT
+	static ExportTrigger parse(const wstring& spec)
+	{
+		size_t sep = spec.find(L'!');
+		if (sep == wstring::npos || sep == 0 || sep + 1 == spec.size())
+			BOOST_THROW_EXCEPTION(ex_injection() << e_text("expected MODULE!EXPORT, got '" + to_string(spec) + "'"));
+		return ExportTrigger(spec.substr(0, sep), to_string(spec.substr(sep + 1)));
+	}
+
+	bool poll(const Process& proc, const TriggerSnapshot& snapshot) override;
+
+	string describe() const override
+	{
+		return "export " + module.string() + "!" + procName;
+	}
+};
+
+
+
+// a set of conditions that all have to hold before continuing,
+// evaluated by cheap incremental polling instead of fixed waits
+class Triggers
+{
+private:
+	vector<std::unique_ptr<Trigger>> triggers;
+	TriggerSnapshot snapshot;
+
+public:
+	template <typename T>
+	void add(T trigger)
+	{
+		triggers.push_back(std::make_unique<T>(std::move(trigger)));
+	}
+
+	bool empty() const
+	{
+		return triggers.empty();
+	}
+
+	string describe() const
+	{
+		string s;
+		for (const auto& trigger : triggers)
+			s += (s.empty() ? "" : " and ") + trigger->describe();
+		return s;
+	}
+
+	// refreshes the snapshot and returns true when all triggers hold
+	bool poll(const Process& proc);
+
+	// polls once, throws if the target has exited or elapsedMillis reached timeoutMillis
+	// without all triggers holding
+	bool check(const Process& proc, DWORD elapsedMillis, DWORD timeoutMillis = INFINITE);
+
+	// polls every intervalMillis until all triggers hold, throws if the target exits first
+	// or timeoutMillis runs out
+	void wait(const Process& proc, DWORD intervalMillis, DWORD timeoutMillis = INFINITE);
+};
@@ -0,0 +1,74 @@
+#include "injectory/waitgroup.hpp"
+#include "injectory/reactor.hpp"
+
+void WaitGroup::add(const Process& proc)
+{
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		state->added++;
+	}
+
+	shared_ptr<State> shared = state;
+	WaitReactor::instance().watch(proc, [shared, proc](DWORD waitResult)
+	{
+		Exit exit = { proc, STILL_ACTIVE, 0, nullptr };
+		try
+		{
+			if (waitResult == WAIT_FAILED)
+				BOOST_THROW_EXCEPTION(ex_wait_for_multiple_objects() << e_api_function("WaitForMultipleObjects") << e_text("could not wait for process to exit") << e_process(proc));
+			exit.exitCode = proc.exitCode();
+			exit.lifetime = proc.exitTime() - proc.creationTime();
+		}
+		catch (...)
+		{
+			exit.error = std::current_exception();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(shared->mutex);
+			shared->exits.push_back(exit);
+			shared->exited++;
+		}
+		shared->cv.notify_all();
+	});
+}
+
+size_t WaitGroup::size() const
+{
+	std::lock_guard<std::mutex> lock(state->mutex);
+	return state->added;
+}
+
+size_t WaitGroup::running() const
+{
+	std::lock_guard<std::mutex> lock(state->mutex);
+	return state->added - state->exited;
+}
+
+optional<WaitGroup::Exit> WaitGroup::waitAny(DWORD millis)
+{
+	std::unique_lock<std::mutex> lock(state->mutex);
+	auto ready = [this] { return !state->exits.empty() || state->exited == state->added; };
+	if (millis == INFINITE)
+		state->cv.wait(lock, ready);
+	else
+		state->cv.wait_for(lock, std::chrono::milliseconds(millis), ready);
+
+	if (state->exits.empty())
+		return nullopt;
+	Exit exit = state->exits.front();
+	state->exits.pop_front();
+	return exit;
+}
+
+bool WaitGroup::waitAll(DWORD millis)
+{
+	std::unique_lock<std::mutex> lock(state->mutex);
+	auto done = [this] { return state->exited == state->added; };
+	if (millis == INFINITE)
+	{
+		state->cv.wait(lock, done);
+		return true;
+	}
+	return state->cv.wait_for(lock, std::chrono::milliseconds(millis), done);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "injectory/common.hpp"
+#include "injectory/process.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// waits for any number of processes, not limited to MAXIMUM_WAIT_OBJECTS. the handles are
+// spread over the WaitReactor's threads, so waiting costs no cpu no matter how many there are
+class WaitGroup
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+	struct Exit
+	{
+		Process proc;
+		DWORD exitCode;
+		uint64_t lifetime; // in 100ns intervals
+		std::exception_ptr error; // the process couldn't be waited for, it may still be running
+
+		double lifetimeMillis() const
+		{
+			return lifetime / 10000.0;
+		}
+	};
+
+private:
+	// outlives the group if processes are still watched when it is destroyed
+	struct State
+	{
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::deque<Exit> exits; // not yet returned by waitAny
+		size_t added = 0;
+		size_t exited = 0;
+	};
+	shared_ptr<State> state = std::make_shared<State>();
+
+public:
+	void add(const Process& proc);
+
+	size_t size() const;
+	size_t running() const;
+
+	// returns the next exit not returned before, nullopt if millis ran out or every exit was returned.
+	// a process that can't be waited for is returned with an error instead of an exit code
+	optional<Exit> waitAny(DWORD millis = INFINITE);
+
+	// true if all processes exited within millis, their exits are still returned by waitAny
+	bool waitAll(DWORD millis = INFINITE);
+};
@@ -0,0 +1,177 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// a process as seen in one snapshot, pid and creation time together
+// identify it even when pids get reused
+struct ProcessEntry
+{
+	uint32_t pid = 0;
+	uint64_t creationTime = 0;
+	std::wstring exeName;
+
+	std::pair<uint32_t, uint64_t> key() const
+	{
+		return { pid, creationTime };
+	}
+};
+
+
+
+// diffs consecutive process snapshots and reports the processes that are new
+class ProcessWatcher
+{
+public:
+	using Source = std::function<std::vector<ProcessEntry>()>;
+
+private:
+	Source source;
+	std::set<std::pair<uint32_t, uint64_t>> known;
+	bool primed = false;
+
+public:
+	explicit ProcessWatcher(Source source)
+		: source(std::move(source))
+	{}
+
+	// the first poll only records what is already running
+	std::vector<ProcessEntry> poll()
+	{
+		std::vector<ProcessEntry> current = source();
+		std::set<std::pair<uint32_t, uint64_t>> keys;
+		std::vector<ProcessEntry> added;
+
+		for (ProcessEntry& e : current)
+		{
+			keys.insert(e.key());
+			if (primed && !known.count(e.key()))
+				added.push_back(std::move(e));
+		}
+
+		known = std::move(keys);
+		primed = true;
+		return added;
+	}
+};
+
+
+
+// starts a job for every new process, at most maxParallel at a time, and measures the
+// time from detection until the job is done. jobs run asynchronously and return a future
+// of the time they finished
+class WatchDispatcher
+{
+public:
+	using clock = std::chrono::steady_clock;
+	using Job = std::function<std::future<clock::time_point>(const ProcessEntry&)>;
+
+	struct Result
+	{
+		ProcessEntry entry;
+		clock::duration latency;
+		std::exception_ptr error;
+	};
+
+private:
+	struct Pending
+	{
+		ProcessEntry entry;
+		clock::time_point detected;
+		std::future<clock::time_point> done;
+	};
+
+	Job job;
+	size_t maxParallel;
+	std::vector<Pending> queued;
+	std::vector<Pending> running;
+
+public:
+	WatchDispatcher(Job job, size_t maxParallel)
+		: job(std::move(job))
+		, maxParallel(maxParallel == 0 ? 1 : maxParallel)
+	{}
+
+	// wraps a blocking job so it runs on its own thread
+	static Job threaded(std::function<void(const ProcessEntry&)> blocking)
+	{
+		return [blocking](const ProcessEntry& entry)
+		{
+			return std::async(std::launch::async, [blocking, entry]
+			{
+				blocking(entry);
+				return clock::now();
+			});
+		};
+	}
+
+	void dispatch(std::vector<ProcessEntry> entries, clock::time_point detected = clock::now())
+	{
+		for (ProcessEntry& e : entries)
+			queued.push_back({ std::move(e), detected, {} });
+		start();
+	}
+
+	// returns the jobs that finished since the last call and starts queued ones
+	std::vector<Result> reap(bool block = false)
+	{
+		std::vector<Result> done;
+		do
+		{
+			for (auto it = running.begin(); it != running.end(); )
+			{
+				if (block || it->done.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+				{
+					Result r{ it->entry, {}, nullptr };
+					try
+					{
+						r.latency = it->done.get() - it->detected;
+					}
+					catch (...)
+					{
+						r.latency = clock::now() - it->detected;
+						r.error = std::current_exception();
+					}
+					done.push_back(std::move(r));
+					it = running.erase(it);
+				}
+				else
+					++it;
+			}
+			start();
+		} while (block && (!running.empty() || !queued.empty()));
+		return done;
+	}
+
+	size_t inFlight() const
+	{
+		return running.size() + queued.size();
+	}
+
+private:
+	void start()
+	{
+		while (running.size() < maxParallel && !queued.empty())
+		{
+			Pending p = std::move(queued.front());
+			queued.erase(queued.begin());
+			try
+			{
+				p.done = job(p.entry);
+			}
+			catch (...)
+			{
+				std::promise<clock::time_point> failed;
+				failed.set_exception(std::current_exception());
+				p.done = failed.get_future();
+			}
+			running.push_back(std::move(p));
+		}
+	}
+};
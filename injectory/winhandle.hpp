@@ -28,9 +28,12 @@ public:
 			return ret;
 	}
 
+	// at most MAXIMUM_WAIT_OBJECTS handles, WaitGroup takes any number of processes
 	static DWORD wait(const vector<handle_t>& handles, bool waitAll, DWORD millis = INFINITE)
 	{
-		DWORD ret = WaitForMultipleObjects(handles.size(), &handles[0], waitAll, millis);
+		if (handles.empty() || handles.size() > MAXIMUM_WAIT_OBJECTS)
+			BOOST_THROW_EXCEPTION(ex_wait_for_multiple_objects() << e_text("can only wait for 1 to " + to_string(MAXIMUM_WAIT_OBJECTS) + " handles at once") << e_handles(handles));
+		DWORD ret = WaitForMultipleObjects((DWORD)handles.size(), &handles[0], waitAll, millis);
 		if (ret == WAIT_FAILED)
 		{
 			DWORD errcode = GetLastError();
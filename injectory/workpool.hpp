@@ -0,0 +1,251 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// a work-stealing pool for cpu-bound preparation work like parsing and relocating payloads.
+// every worker has its own deque it pushes to and pops from at the back, idle workers steal from
+// the front of the others. work submitted from outside goes through a bounded global queue,
+// so a producer that is faster than the pool blocks instead of queueing without limit
+class WorkPool
+{
+public:
+	using Work = std::function<void()>;
+
+	struct Stats
+	{
+		size_t executed;
+		size_t stolen;
+	};
+
+private:
+	struct Worker
+	{
+		std::mutex mutex;
+		std::deque<Work> deque;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::vector<std::thread> threads;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable space;
+	std::deque<Work> global;
+	const size_t capacity;
+	bool stopping = false;
+
+	std::atomic<size_t> pending = 0;
+	std::atomic<size_t> executed = 0;
+	std::atomic<size_t> stolen = 0;
+
+public:
+	// threads == 0 means one per hardware thread
+	explicit WorkPool(unsigned threadCount = 0, size_t capacity = 1024)
+		: capacity((std::max)(capacity, (size_t)1))
+	{
+		if (threadCount == 0)
+			threadCount = (std::max)(std::thread::hardware_concurrency(), 1u);
+		for (unsigned i = 0; i < threadCount; i++)
+			workers.push_back(std::make_unique<Worker>());
+		for (unsigned i = 0; i < threadCount; i++)
+			threads.emplace_back(&WorkPool::worker, this, i);
+	}
+
+	WorkPool(const WorkPool&) = delete;
+	WorkPool& operator=(const WorkPool&) = delete;
+
+	// runs what is still queued, then stops
+	~WorkPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		space.notify_all();
+		for (std::thread& t : threads)
+			t.join();
+	}
+
+	size_t size() const
+	{
+		return threads.size();
+	}
+
+	Stats stats() const
+	{
+		return { executed, stolen };
+	}
+
+	template <typename F>
+	auto submit(F f) -> std::future<decltype(f())>
+	{
+		using R = decltype(f());
+		auto task = std::make_shared<std::packaged_task<R()>>(std::move(f));
+		std::future<R> future = task->get_future();
+		push([task] { (*task)(); });
+		return future;
+	}
+
+	// on a worker of this pool, runs other work until the future is ready instead of blocking,
+	// so work can wait for work it submitted without starving the pool
+	template <typename T>
+	T wait(std::future<T>& future)
+	{
+		const auto[pool, index] = self();
+		if (pool == this)
+		{
+			while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				Work work;
+				if (take(index, work))
+					run(work);
+				else
+					std::this_thread::yield();
+			}
+		}
+		return future.get();
+	}
+
+	// calls fn(begin, end) for consecutive chunks of [0, count) of grain elements each
+	// and returns when all are done, rethrowing the first exception
+	void parallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& fn)
+	{
+		grain = (std::max)(grain, (size_t)1);
+		if (count <= grain)
+		{
+			fn(0, count);
+			return;
+		}
+
+		std::vector<std::future<void>> parts;
+		for (size_t b = 0; b < count; b += grain)
+		{
+			size_t e = (std::min)(b + grain, count);
+			parts.push_back(submit([&fn, b, e] { fn(b, e); }));
+		}
+
+		std::exception_ptr error;
+		for (std::future<void>& part : parts)
+		{
+			try
+			{
+				wait(part);
+			}
+			catch (...)
+			{
+				if (!error)
+					error = std::current_exception();
+			}
+		}
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+private:
+	// the pool and worker index of the calling thread
+	static std::pair<WorkPool*, size_t>& self()
+	{
+		thread_local std::pair<WorkPool*, size_t> current = { nullptr, 0 };
+		return current;
+	}
+
+	void push(Work work)
+	{
+		const auto[pool, index] = self();
+		if (pool == this)
+		{
+			std::lock_guard<std::mutex> lock(workers[index]->mutex);
+			workers[index]->deque.push_back(std::move(work));
+			pending++;
+		}
+		else
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			space.wait(lock, [this] { return stopping || global.size() < capacity; });
+			global.push_back(std::move(work));
+			pending++;
+		}
+
+		// taking the lock orders the notify after a sleeping worker checked pending
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+		}
+		wake.notify_one();
+	}
+
+	// own deque first, newest work is hottest in cache, then the global queue, then steal the oldest
+	bool take(size_t index, Work& out)
+	{
+		{
+			Worker& own = *workers[index];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.deque.empty())
+			{
+				out = std::move(own.deque.back());
+				own.deque.pop_back();
+				pending--;
+				return true;
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!global.empty())
+			{
+				out = std::move(global.front());
+				global.pop_front();
+				pending--;
+				space.notify_one();
+				return true;
+			}
+		}
+		for (size_t i = 1; i < workers.size(); i++)
+		{
+			Worker& victim = *workers[(index + i) % workers.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.deque.empty())
+			{
+				out = std::move(victim.deque.front());
+				victim.deque.pop_front();
+				pending--;
+				stolen++;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void run(Work& work)
+	{
+		work();
+		executed++;
+	}
+
+	void worker(size_t index)
+	{
+		self() = { this, index };
+		for (;;)
+		{
+			Work work;
+			if (take(index, work))
+			{
+				run(work);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stopping || pending > 0; });
+			if (stopping && pending == 0)
+				return;
+		}
+	}
+};
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+
+// the tests are plain programs, a failed check prints where and the test exits with 1 at the end
+inline int& failures()
+{
+	static int n = 0;
+	return n;
+}
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) \
+		{ \
+			std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			failures()++; \
+		} \
+	} while (0)
+
+inline int report(const char* name)
+{
+	if (failures())
+		std::fprintf(stderr, "%s: %d checks failed\n", name, failures());
+	else
+		std::printf("%s: ok\n", name);
+	return failures() ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include "injectory/ioplan.hpp"
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <vector>
+
+// the bytes of a target in memory with pages that can't be read, like a guard page in a gap.
+// readv and writev do what Process::readv and writev do with ReadProcessMemory and
+// WriteProcessMemory, so a plan can be checked and timed without a process
+class FakeMemory
+{
+private:
+	std::vector<uint8_t> bytes;
+	std::set<uintptr_t> unreadable; // page bases
+
+public:
+	static constexpr uintptr_t page = IoPlan::pageSize;
+
+	uintptr_t base;
+	size_t calls = 0;	// remote transfers, failed ones included
+	size_t moved = 0;	// bytes of the transfers that succeeded
+
+	FakeMemory(uintptr_t base, size_t size)
+		: bytes(size), base(base)
+	{
+		for (size_t i = 0; i < size; i++)
+			bytes[i] = (uint8_t)(i * 131 + (i >> 12));
+	}
+
+	size_t size() const
+	{
+		return bytes.size();
+	}
+
+	const uint8_t* at(uintptr_t address) const
+	{
+		return bytes.data() + (address - base);
+	}
+
+	void protect(uintptr_t address)
+	{
+		unreadable.insert(address & ~(page - 1));
+	}
+
+	bool readable(uintptr_t begin, size_t size) const
+	{
+		if (begin < base || begin + size > base + bytes.size())
+			return false;
+		auto it = unreadable.lower_bound(begin & ~(page - 1));
+		return it == unreadable.end() || *it >= begin + size;
+	}
+
+	// all or nothing, like ReadProcessMemory over an unreadable page
+	bool read(uintptr_t begin, void* out, size_t size)
+	{
+		calls++;
+		if (!readable(begin, size))
+			return false;
+		std::memcpy(out, at(begin), size);
+		moved += size;
+		return true;
+	}
+
+	bool write(uintptr_t begin, const void* in, size_t size)
+	{
+		calls++;
+		if (begin < base || begin + size > base + bytes.size())
+			return false;
+		std::memcpy(bytes.data() + (begin - base), in, size);
+		moved += size;
+		return true;
+	}
+
+	// false if a span couldn't be read on its own either
+	bool readv(const std::vector<IoSpan>& spans, uintptr_t maxGap = IoPlan::pageSize)
+	{
+		IoPlan plan = IoPlan::reads(spans, maxGap);
+		std::vector<uint8_t> buffer;
+		for (size_t i = 0; i < plan.transfers().size(); i++)
+		{
+			const IoPlan::Transfer& t = plan.transfers()[i];
+			buffer.resize(t.size());
+			if (read(t.begin, buffer.data(), t.size()))
+				plan.scatter(i, buffer.data());
+			else
+			{
+				for (size_t s : t.spans)
+				{
+					if (!read(spans[s].remote, spans[s].local, spans[s].size))
+						return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	bool writev(const std::vector<IoSpan>& spans)
+	{
+		IoPlan plan = IoPlan::writes(spans);
+		std::vector<uint8_t> buffer;
+		for (size_t i = 0; i < plan.transfers().size(); i++)
+		{
+			const IoPlan::Transfer& t = plan.transfers()[i];
+			buffer.resize(t.size());
+			plan.gather(i, buffer.data());
+			if (!write(t.begin, buffer.data(), buffer.size()))
+				return false;
+		}
+		return true;
+	}
+};
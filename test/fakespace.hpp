@@ -0,0 +1,94 @@
+#pragma once
+#include "injectory/regionmap.hpp"
+#include <iterator>
+#include <map>
+#include <optional>
+
+// an address space in memory that answers RegionMap queries like VirtualQueryEx does: a free
+// region starts at the page of the queried address and runs up to the next allocation
+class FakeSpace
+{
+private:
+	std::map<uintptr_t, Region> regions; // everything that isn't free, by base
+	uintptr_t end_;
+
+public:
+	static constexpr uintptr_t page = 0x1000;
+
+	explicit FakeSpace(uintptr_t end)
+		: end_(end)
+	{}
+
+	uintptr_t end() const
+	{
+		return end_;
+	}
+
+	std::optional<Region> query(uintptr_t address) const
+	{
+		if (address >= end_)
+			return std::nullopt;
+		auto it = regions.upper_bound(address);
+		if (it != regions.begin() && address < std::prev(it)->second.end())
+			return std::prev(it)->second;
+
+		Region r;
+		r.base = address & ~(page - 1);
+		r.size = (it == regions.end() ? end_ : it->first) - r.base;
+		return r;
+	}
+
+	RegionMap::Query querier() const
+	{
+		return [this](uintptr_t address) { return query(address); };
+	}
+
+	bool isFree(uintptr_t base, uintptr_t size) const
+	{
+		auto it = regions.lower_bound(base);
+		if (it != regions.end() && it->first < base + size)
+			return false;
+		return it == regions.begin() || std::prev(it)->second.end() <= base;
+	}
+
+	// private memory or an image of a header page and sections, each a region of its own
+	void allocate(uintptr_t base, uintptr_t size, uint32_t type = Region::Private, unsigned sections = 1)
+	{
+		const uintptr_t part = (std::max)(size / sections / page, (uintptr_t)1) * page;
+		for (uintptr_t b = base; b < base + size; b += part)
+		{
+			Region r;
+			r.base = b;
+			r.size = (std::min)(part, base + size - b);
+			r.allocationBase = base;
+			r.state = Region::Commit;
+			r.type = type;
+			r.protect = b == base ? 0x02 : 0x20;
+			r.allocationProtect = type == Region::Image ? 0x80 : 0x04;
+			regions[b] = r;
+		}
+	}
+
+	// frees the allocation at base, returns its extent
+	RegionMap::Range release(uintptr_t base)
+	{
+		uintptr_t end = base;
+		for (auto it = regions.lower_bound(base); it != regions.end() && it->second.allocationBase == base; )
+		{
+			end = it->second.end();
+			it = regions.erase(it);
+		}
+		return { base, end };
+	}
+
+	std::vector<uintptr_t> allocations() const
+	{
+		std::vector<uintptr_t> bases;
+		for (const auto& [base, r] : regions)
+		{
+			if (base == r.allocationBase)
+				bases.push_back(base);
+		}
+		return bases;
+	}
+};
@@ -0,0 +1,152 @@
+// the read and write planner of Process::readv and writev against a fake target
+#include "check.hpp"
+#include "fakememory.hpp"
+#include <random>
+
+namespace
+{
+	const uintptr_t base = 0x10000;
+
+	void readsMergeAcrossSmallGaps()
+	{
+		uint8_t a[16], b[32], c[8];
+		std::vector<IoSpan> spans =
+		{
+			{ base + 0x3010, c, sizeof(c) },
+			{ base + 0x0100, a, sizeof(a) },
+			{ base + 0x1ff0, b, sizeof(b) },	// crosses into the next page
+		};
+		IoPlan plan = IoPlan::reads(spans);
+
+		// pages 0-2 touch, page 3 is one page away, all within the default gap
+		CHECK(plan.transfers().size() == 1);
+		CHECK(plan.transfers()[0].begin == base && plan.transfers()[0].end == base + 0x4000);
+		CHECK((plan.transfers()[0].spans == std::vector<size_t>{ 0, 1, 2 }));
+
+		// with no gap allowed the page between them splits it
+		plan = IoPlan::reads({ { base, a, 1 }, { base + 0x2000, b, 1 } }, 0);
+		CHECK(plan.transfers().size() == 2);
+		plan = IoPlan::reads({ { base, a, 1 }, { base + 0x1000, b, 1 } }, 0);
+		CHECK(plan.transfers().size() == 1);
+	}
+
+	void readsAreWholePages()
+	{
+		uint8_t a[4];
+		IoPlan plan = IoPlan::reads({ { base + 0x1ffe, a, 4 } });
+		CHECK(plan.transfers().size() == 1);
+		CHECK(plan.transfers()[0].begin == base + 0x1000 && plan.transfers()[0].end == base + 0x3000);
+		CHECK(plan.bytes() == 0x2000);
+
+		// empty spans are left out
+		plan = IoPlan::reads({ { base, a, 0 } });
+		CHECK(plan.transfers().empty());
+	}
+
+	void writesOnlyMergeWhereTheyTouch()
+	{
+		uint8_t a[8], b[8], c[8];
+		IoPlan plan = IoPlan::writes({ { base + 8, b, 8 }, { base, a, 8 }, { base + 17, c, 8 } });
+		CHECK(plan.transfers().size() == 2);
+		CHECK(plan.transfers()[0].begin == base && plan.transfers()[0].end == base + 16);
+		CHECK(plan.transfers()[1].begin == base + 17 && plan.transfers()[1].end == base + 25);
+		CHECK(plan.bytes() == 24);
+	}
+
+	void laterWritesWin()
+	{
+		FakeMemory memory(base, 0x4000);
+		uint8_t first[8] = { 1, 1, 1, 1, 1, 1, 1, 1 };
+		uint8_t second[4] = { 2, 2, 2, 2 };
+		const uint8_t before = *memory.at(base + 0x100 + 12);
+		CHECK(memory.writev({ { base + 0x104, second, 4 }, { base + 0x100, first, 8 }, { base + 0x106, second, 4 } }));
+		CHECK(memory.calls == 1);
+
+		const uint8_t expected[] = { 1, 1, 1, 1, 1, 1, 2, 2, 2, 2 };
+		CHECK(std::memcmp(memory.at(base + 0x100), expected, sizeof(expected)) == 0);
+		CHECK(*memory.at(base + 0x100 + 12) == before);
+	}
+
+	void unreadableGapFallsBackToSpans()
+	{
+		FakeMemory memory(base, 0x8000);
+		memory.protect(base + 0x1000);
+		uint8_t a[16], b[16];
+		CHECK(memory.readv({ { base + 0x10, a, 16 }, { base + 0x2010, b, 16 } }));
+		CHECK(memory.calls == 3);	// the merged read and one per span
+		CHECK(std::memcmp(a, memory.at(base + 0x10), 16) == 0);
+		CHECK(std::memcmp(b, memory.at(base + 0x2010), 16) == 0);
+
+		// a span that is unreadable itself fails
+		CHECK(!memory.readv({ { base + 0x1010, a, 16 } }));
+	}
+
+	void randomized()
+	{
+		std::mt19937 rng(63);
+		for (int round = 0; round < 300; round++)
+		{
+			FakeMemory memory(base, 64 * FakeMemory::page);
+			FakeMemory mirror = memory;
+			if (rng() % 3 == 0)
+			{
+				const uintptr_t p = base + rng() % 64 * FakeMemory::page;
+				memory.protect(p);
+				mirror.protect(p);
+			}
+
+			const size_t n = 1 + rng() % 40;
+			std::vector<std::vector<uint8_t>> locals(n);
+			std::vector<IoSpan> spans;
+			for (size_t i = 0; i < n; i++)
+			{
+				locals[i].resize(rng() % 300);
+				const uintptr_t remote = base + rng() % (memory.size() - locals[i].size());
+				spans.push_back({ remote, locals[i].data(), locals[i].size() });
+			}
+			const uintptr_t maxGap = rng() % 4 * FakeMemory::page;
+
+			// every readable span gets its bytes, whatever the gap
+			bool readable = true;
+			for (const IoSpan& s : spans)
+				readable = readable && memory.readable(s.remote, s.size);
+			CHECK(memory.readv(spans, maxGap) == readable);
+			if (readable)
+			{
+				for (const IoSpan& s : spans)
+					CHECK(std::memcmp(s.local, memory.at(s.remote), s.size) == 0);
+			}
+
+			IoPlan plan = IoPlan::reads(spans, maxGap);
+			for (size_t i = 0; i < plan.transfers().size(); i++)
+			{
+				const IoPlan::Transfer& t = plan.transfers()[i];
+				CHECK(t.begin % FakeMemory::page == 0 && t.end % FakeMemory::page == 0);
+				if (i > 0)
+					CHECK(t.begin > plan.transfers()[i - 1].end + maxGap);
+			}
+
+			// writes leave the gaps alone and match writing the spans one by one in order
+			for (size_t i = 0; i < n; i++)
+			{
+				for (uint8_t& byte : locals[i])
+					byte = (uint8_t)rng();
+			}
+			CHECK(memory.writev(spans));
+			for (const IoSpan& s : spans)
+				mirror.write(s.remote, s.local, s.size);
+			CHECK(std::memcmp(memory.at(base), mirror.at(base), memory.size()) == 0);
+		}
+	}
+}
+
+int main()
+{
+	readsMergeAcrossSmallGaps();
+	readsAreWholePages();
+	writesOnlyMergeWhereTheyTouch();
+	laterWritesWin();
+	unreadableGapFallsBackToSpans();
+	randomized();
+	return report("ioplan_test");
+}
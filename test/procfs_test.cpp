@@ -0,0 +1,110 @@
+// the linux memory and query layer against the test's own process
+#include "check.hpp"
+#include "injectory/procfs.hpp"
+#include <sys/mman.h>
+#include <future>
+#include <thread>
+
+namespace
+{
+	const size_t page = 0x1000;
+
+	void readsAndWrites()
+	{
+		LinuxProcess self = LinuxProcess::self();
+		uint64_t value = 0x1122334455667788;
+		CHECK(self.memory<uint64_t>((uintptr_t)&value) == value);
+
+		uint64_t other = 0;
+		self.write((uintptr_t)&other, &value, sizeof(value));
+		CHECK(other == value);
+
+		char a[16] = "first", b[16] = "second", x[16], y[16];
+		self.readv({ { (uintptr_t)b, y, sizeof(y) }, { (uintptr_t)a, x, sizeof(x) } });
+		CHECK(std::strcmp(x, "first") == 0 && std::strcmp(y, "second") == 0);
+
+		LinuxMemoryArea area(self, (uintptr_t)a, sizeof(a));
+		area.write("third", 6);
+		CHECK(std::strcmp(a, "third") == 0);
+		CHECK(area.read().size() == sizeof(a));
+	}
+
+	void shortTransferIsAFault()
+	{
+		// two pages of which only the first stays mapped, a read over both stops at the second
+		uint8_t* p = (uint8_t*)::mmap(nullptr, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		CHECK(p != MAP_FAILED);
+		::munmap(p + page, page);
+
+		LinuxProcess self = LinuxProcess::self();
+		std::vector<uint8_t> buf(2 * page);
+		int code = 0;
+		errno = 0;
+		try
+		{
+			self.read((uintptr_t)p, buf.data(), buf.size());
+		}
+		catch (const std::system_error& e)
+		{
+			code = e.code().value();
+		}
+		CHECK(code == EFAULT);
+
+		// and so is a write
+		code = 0;
+		errno = 0;
+		try
+		{
+			self.write((uintptr_t)p + page / 2, buf.data(), page);
+		}
+		catch (const std::system_error& e)
+		{
+			code = e.code().value();
+		}
+		CHECK(code == EFAULT);
+
+		// nothing at all there fails in the call itself
+		code = 0;
+		try
+		{
+			self.read((uintptr_t)p + page, buf.data(), 8);
+		}
+		catch (const std::system_error& e)
+		{
+			code = e.code().value();
+		}
+		CHECK(code == EFAULT);
+		::munmap(p, page);
+	}
+
+	void mapsAndThreads()
+	{
+		uint8_t* p = (uint8_t*)::mmap(nullptr, 3 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		CHECK(p != MAP_FAILED);
+		::mprotect(p + page, page, PROT_NONE);
+
+		LinuxProcess self = LinuxProcess::self();
+		RegionMap map = self.regions();
+		const Region* r = map.find((uintptr_t)p);
+		CHECK(r && r->type == Region::Private && r->protect == 0x04);
+		r = map.find((uintptr_t)p + page);
+		CHECK(r && r->protect == 0x01 && r->size == page);
+		CHECK(!map.modules().empty());
+		::munmap(p, 3 * page);
+
+		std::promise<void> done;
+		std::thread t([&] { done.get_future().wait(); });
+		CHECK(self.threads().size() >= 2);
+		done.set_value();
+		t.join();
+		CHECK(self.exe().find("procfs_test") != std::string::npos);
+	}
+}
+
+int main()
+{
+	readsAndWrites();
+	shortTransferIsAFault();
+	mapsAndThreads();
+	return report("procfs_test");
+}
@@ -0,0 +1,136 @@
+// RegionMap::refresh against a fake target: after any changes, refreshing the windows they
+// touched has to give the same regions as a full rescan, and the diff exactly what differs
+#include "check.hpp"
+#include "fakespace.hpp"
+#include <random>
+#include <tuple>
+
+namespace
+{
+	bool less(const Region& a, const Region& b)
+	{
+		return std::tie(a.base, a.size, a.allocationBase, a.state, a.protect, a.allocationProtect, a.type) <
+			std::tie(b.base, b.size, b.allocationBase, b.state, b.protect, b.allocationProtect, b.type);
+	}
+
+	std::vector<Region> sorted(std::vector<Region> v)
+	{
+		std::sort(v.begin(), v.end(), less);
+		return v;
+	}
+
+	std::vector<Region> minus(const std::vector<Region>& a, const std::vector<Region>& b)
+	{
+		std::vector<Region> sa = sorted(a), sb = sorted(b), out;
+		std::set_difference(sa.begin(), sa.end(), sb.begin(), sb.end(), std::back_inserter(out), less);
+		return out;
+	}
+
+	// refreshes map over windows and checks it against a full scan of space
+	void checkRefresh(const FakeSpace& space, RegionMap& map, const std::vector<RegionMap::Range>& windows)
+	{
+		const std::vector<Region> before = map.regions();
+		const std::vector<uintptr_t> modulesBefore = map.modules();
+		RegionMap::Diff diff = map.refresh(space.querier(), windows);
+		const RegionMap full = RegionMap::scan(space.querier(), 0, space.end());
+
+		CHECK(map.regions() == full.regions());
+		CHECK(sorted(diff.added) == minus(full.regions(), before));
+		CHECK(sorted(diff.removed) == minus(before, full.regions()));
+
+		std::vector<uintptr_t> added, removed;
+		const std::vector<uintptr_t> modulesAfter = full.modules();
+		std::set_difference(modulesAfter.begin(), modulesAfter.end(), modulesBefore.begin(), modulesBefore.end(), std::back_inserter(added));
+		std::set_difference(modulesBefore.begin(), modulesBefore.end(), modulesAfter.begin(), modulesAfter.end(), std::back_inserter(removed));
+		CHECK(diff.addedModules == added);
+		CHECK(diff.removedModules == removed);
+	}
+
+	void freedNextToFree()
+	{
+		// | free | private | free |, freeing the private memory leaves one free region
+		FakeSpace space(0x100000);
+		space.allocate(0x10000, 0x4000);
+		space.allocate(0x40000, 0x2000);
+		RegionMap map = RegionMap::scan(space.querier(), 0, space.end());
+
+		checkRefresh(space, map, { space.release(0x10000) });
+		CHECK(map.regions().size() == 3);
+	}
+
+	void imageMapped()
+	{
+		FakeSpace space(0x100000);
+		space.allocate(0x20000, 0x1000);
+		RegionMap map = RegionMap::scan(space.querier(), 0, space.end());
+
+		space.allocate(0x50000, 0x8000, Region::Image, 4);
+		checkRefresh(space, map, { { 0x50000, 0x58000 } });
+		CHECK(map.modules() == std::vector<uintptr_t>{ 0x50000 });
+
+		checkRefresh(space, map, { space.release(0x50000) });
+		CHECK(map.modules().empty());
+	}
+
+	void randomized()
+	{
+		std::mt19937 rng(51);
+		const uintptr_t pages = 256;
+		for (int round = 0; round < 500; round++)
+		{
+			FakeSpace space(pages * FakeSpace::page);
+			for (int i = 0; i < 20; i++)
+			{
+				uintptr_t base = rng() % pages * FakeSpace::page, size = (1 + rng() % 8) * FakeSpace::page;
+				if (base + size <= space.end() && space.isFree(base, size))
+					space.allocate(base, size, rng() % 2 ? Region::Image : Region::Private, 1 + rng() % 3);
+			}
+			RegionMap map = RegionMap::scan(space.querier(), 0, space.end());
+
+			for (int step = 0; step < 10; step++)
+			{
+				std::vector<RegionMap::Range> windows;
+				for (int change = 1 + rng() % 3; change > 0; change--)
+				{
+					std::vector<uintptr_t> bases = space.allocations();
+					if (!bases.empty() && rng() % 2)
+						windows.push_back(space.release(bases[rng() % bases.size()]));
+					else
+					{
+						uintptr_t base = rng() % pages * FakeSpace::page, size = (1 + rng() % 8) * FakeSpace::page;
+						if (base + size <= space.end() && space.isFree(base, size))
+						{
+							space.allocate(base, size, rng() % 2 ? Region::Image : Region::Private, 1 + rng() % 3);
+							windows.push_back({ base, base + size });
+						}
+					}
+				}
+				checkRefresh(space, map, windows);
+			}
+		}
+	}
+
+	void shardedScan()
+	{
+		std::mt19937 rng(52);
+		FakeSpace space(4096 * FakeSpace::page);
+		for (int i = 0; i < 400; i++)
+		{
+			uintptr_t base = rng() % 4096 * FakeSpace::page, size = (1 + rng() % 16) * FakeSpace::page;
+			if (base + size <= space.end() && space.isFree(base, size))
+				space.allocate(base, size, Region::Image, 1 + rng() % 4);
+		}
+		const RegionMap sequential = RegionMap::scan(space.querier(), 0, space.end());
+		for (unsigned shards : { 2u, 3u, 7u, 16u, 64u })
+			CHECK(RegionMap::scan(space.querier(), 0, space.end(), shards).regions() == sequential.regions());
+	}
+}
+
+int main()
+{
+	freedNextToFree();
+	imageMapped();
+	randomized();
+	shardedScan();
+	return report("regionmap_test");
+}
@@ -0,0 +1,117 @@
+// the diff and dispatch core of --watch with a synthetic process source
+#include "check.hpp"
+#include "injectory/watch.hpp"
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+	std::vector<uint32_t> pids(const std::vector<ProcessEntry>& entries)
+	{
+		std::vector<uint32_t> v;
+		for (const ProcessEntry& e : entries)
+			v.push_back(e.pid);
+		return v;
+	}
+
+	void snapshotsAreDiffed()
+	{
+		std::vector<ProcessEntry> running = { { 10, 100, L"a.exe" }, { 11, 100, L"b.exe" } };
+		int polls = 0;
+		ProcessWatcher watcher([&] { polls++; return running; });
+
+		// what runs already when watching starts isn't new
+		CHECK(watcher.poll().empty());
+		CHECK(watcher.poll().empty());
+
+		running.push_back({ 12, 200, L"a.exe" });
+		CHECK(pids(watcher.poll()) == std::vector<uint32_t>{ 12 });
+		CHECK(watcher.poll().empty());
+
+		// exited processes are forgotten, a pid reused with another creation time is new
+		running = { { 10, 100, L"a.exe" }, { 11, 300, L"c.exe" } };
+		std::vector<ProcessEntry> added = watcher.poll();
+		CHECK(pids(added) == std::vector<uint32_t>{ 11 });
+		CHECK(added.size() == 1 && added[0].exeName == L"c.exe");
+
+		running.push_back({ 12, 200, L"a.exe" });
+		CHECK(pids(watcher.poll()) == std::vector<uint32_t>{ 12 });
+		CHECK(polls == 6);
+	}
+
+	void dispatchIsBounded()
+	{
+		std::atomic<int> active = 0, peak = 0, ran = 0;
+		WatchDispatcher dispatcher(WatchDispatcher::threaded([&](const ProcessEntry& e)
+		{
+			int now = ++active;
+			for (int p = peak; now > p && !peak.compare_exchange_weak(p, now); )
+				;
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			ran++;
+			active--;
+			if (e.pid % 5 == 0)
+				throw std::runtime_error("injection failed");
+		}), 3);
+
+		std::vector<ProcessEntry> entries;
+		for (uint32_t pid = 1; pid <= 20; pid++)
+			entries.push_back({ pid, pid * 10, L"w.exe" });
+		dispatcher.dispatch(entries);
+		CHECK(dispatcher.inFlight() == 20);
+
+		std::vector<WatchDispatcher::Result> results = dispatcher.reap(true);
+		CHECK(results.size() == 20);
+		CHECK(ran == 20);
+		CHECK(peak <= 3);
+		CHECK(dispatcher.inFlight() == 0);
+
+		size_t failed = 0;
+		for (const WatchDispatcher::Result& r : results)
+		{
+			CHECK(r.latency >= WatchDispatcher::clock::duration::zero());
+			CHECK((r.error != nullptr) == (r.entry.pid % 5 == 0));
+			failed += r.error != nullptr;
+		}
+		CHECK(failed == 4);
+	}
+
+	void jobThatThrowsIsReported()
+	{
+		// a job that fails before it even returns its future
+		WatchDispatcher dispatcher([](const ProcessEntry&) -> std::future<WatchDispatcher::clock::time_point>
+		{
+			throw std::runtime_error("could not open process");
+		}, 1);
+		dispatcher.dispatch({ { 7, 70, L"x.exe" }, { 8, 80, L"x.exe" } });
+		std::vector<WatchDispatcher::Result> results = dispatcher.reap(true);
+		CHECK(results.size() == 2);
+		for (const WatchDispatcher::Result& r : results)
+			CHECK(r.error != nullptr);
+	}
+
+	void reapWithoutBlocking()
+	{
+		std::promise<WatchDispatcher::clock::time_point> gate;
+		std::shared_future<WatchDispatcher::clock::time_point> opened = gate.get_future().share();
+		WatchDispatcher dispatcher([&](const ProcessEntry&)
+		{
+			return std::async(std::launch::async, [opened] { return opened.get(); });
+		}, 1);
+		dispatcher.dispatch({ { 1, 1, L"a.exe" }, { 2, 2, L"a.exe" } });
+		CHECK(dispatcher.reap().empty());
+		CHECK(dispatcher.inFlight() == 2);
+		gate.set_value(WatchDispatcher::clock::now());
+		CHECK(dispatcher.reap(true).size() == 2);
+	}
+}
+
+int main()
+{
+	snapshotsAreDiffed();
+	dispatchIsBounded();
+	jobThatThrowsIsReported();
+	reapWithoutBlocking();
+	return report("watch_test");
+}